@@ -308,14 +308,14 @@ local function genMakefile(settings, gamepath, soundpath, skinpath)
         end
     end
 
-    out('%%.lua: %%.pas\n')
-    out('\t@echo "Transpiling to Lua: $@"\n')
-    out('\t@$(LUA) "$(ETC)/pas2lua.lua" "-I$(UNITS)" -I. -DHH2 "$<" > "$@"\n\n')
-
     out('%%.bs: %%.lua.gz\n')
     out('\t@echo "Encrypting $@"\n')
     out('\t@$(ETC)/aesenc "ljLvET5KkIYM0ghV4Bvd3MTmJ0QnNpbN" "$<" "$@"\n\n')
 
+    out('%%.pcm: %%.wav\n')
+    out('\t@echo "Resampling $@"\n')
+    out('\t@$(ETC)/wav2pcm $(PCM_RATE) "$<" "$@"\n\n')
+
     out('%%.lua.gz: %%.lua\n')
     out('\t@echo "Compressing $@"\n')
     out('\t@$(LUA) -e "local s=`wc -c \'$<\' | sed \'s/ .*//\'` io.write(string.char(s&255,(s>>8)&255,(s>>16)&255,(s>>24)&255))" > "$@"\n')
@@ -326,12 +326,37 @@ local function genMakefile(settings, gamepath, soundpath, skinpath)
     out('\tLUA_CPATH="$(LUAMODS)/proxyud/src/?.so;$(LUAMODS)/ddlt/?.so" \\\n')
     out('\tlua\n\n')
 
+    -- Sounds are packaged as raw PCM chunks already at the core mix rate
+    out('PCM_RATE ?= 44100\n\n')
+
+    out('PAS_FILES = \\\n')
+    out('\thh2dfm.pas \\\n')
+    out('\thh2main.pas \\\n')
+    out('\tunit1.pas\n\n')
+
+    out('LUA_FILES = $(PAS_FILES:.pas=.lua)\n\n')
+
     out('BS_FILES = \\\n')
     out('\thh2config.bs \\\n')
     out('\thh2dfm.bs \\\n')
     out('\thh2main.bs \\\n')
     out('\tunit1.bs\n\n')
 
+    -- The game modules and the runtime units they use are linked into a single chunk so that the core decrypts,
+    -- uncompresses and loads them all at once, BUNDLE=0 packages each game module separately
+    out('BUNDLE ?= 1\n\n')
+
+    -- The runtime units are transpiled into the game folder, the core's own units folder is left untouched
+    out('UNIT_DIR = hh2units\n\n')
+
+    out('ifeq ($(BUNDLE), 1)\n')
+    out('    UNIT_PAS_FILES = $(wildcard $(UNITS)/*.pas)\n')
+    out('    UNIT_LUA_FILES = $(patsubst $(UNITS)/%%.pas,$(UNIT_DIR)/%%.lua,$(UNIT_PAS_FILES))\n')
+    out('    CHUNK_FILES = hh2bundle.bs\n')
+    out('else\n')
+    out('    CHUNK_FILES = $(BS_FILES)\n')
+    out('endif\n\n')
+
     out('WAV_FILES = \\\n')
     outlist(soundpath, function(name)
         if name:match('.*%.wav$') then
@@ -339,6 +364,8 @@ local function genMakefile(settings, gamepath, soundpath, skinpath)
         end
     end)
 
+    out('PCM_FILES = $(WAV_FILES:.wav=.pcm)\n\n')
+
     out('IMG_FILES = \\\n')
     local images = {}
 
@@ -358,21 +385,154 @@ local function genMakefile(settings, gamepath, soundpath, skinpath)
 
     out('\n\n')
 
-    out('HH2_FILES = $(BS_FILES) $(WAV_FILES) $(IMG_FILES)\n\n')
+    out('HH2_FILES = $(CHUNK_FILES) $(PCM_FILES) $(IMG_FILES)\n\n')
 
     out('all: %s.hh2\n\n', gamepath)
 
     out('%s.hh2: $(HH2_FILES)\n', gamepath)
     out('\t@echo "Packaging $@"\n')
-    out('\t@$(LUA) "$(ETC)/riff.lua" "$@" $+\n\n')
+    -- The PCM chunks keep the WAV names so the game finds them
+    out('\t@$(LUA) "$(ETC)/riff.lua" "$@" $(CHUNK_FILES) $(foreach pcm,$(PCM_FILES),$(pcm)=$(pcm:.pcm=.wav)) $(IMG_FILES)\n\n')
+
+    -- All units are transpiled by one pas2lua process, which parses the units they use only once and caches their
+    -- interfaces in .pas2lua for the next builds
+    out('pas2lua.stamp: $(PAS_FILES) $(UNIT_PAS_FILES)\n')
+    out('\t@echo "Transpiling to Lua: $(LUA_FILES) $(UNIT_LUA_FILES)"\n')
+    out('\t@mkdir -p .pas2lua $(UNIT_DIR)\n')
+    out('\t@$(LUA) "$(ETC)/pas2lua.lua" "-I$(UNITS)" -I. -DHH2 -C.pas2lua $(PAS_FILES) "-o$(UNIT_DIR)" $(UNIT_PAS_FILES)\n')
+    out('\t@touch "$@"\n\n')
+
+    -- The empty recipe makes make look at the Lua files again after pas2lua has run
+    out('$(LUA_FILES) $(UNIT_LUA_FILES): pas2lua.stamp ;\n\n')
+
+    -- Only the runtime units reachable from the game modules end up in the bundle
+    out('hh2bundle.lua: hh2config.lua $(LUA_FILES) $(UNIT_LUA_FILES)\n')
+    out('\t@echo "Bundling $@"\n')
+    out('\t@$(LUA) "$(ETC)/packgame.lua" --bundle "-I$(UNIT_DIR)" hh2config.lua $(LUA_FILES) > "$@"\n\n')
 
     out('clean:\n')
     out('\t@echo "Cleaning up"\n')
-    out('\t@rm -f %s.hh2 $(BS_FILES)\n', gamepath)
+    out('\t@rm -f %s.hh2 $(BS_FILES) hh2bundle.bs hh2bundle.lua $(PCM_FILES) $(LUA_FILES) pas2lua.stamp\n', gamepath)
+    out('\t@rm -rf .pas2lua $(UNIT_DIR)\n')
+end
+
+local function genBundle(paths, searchDirs)
+    local out = function(format, ...)
+        local str = string.format(format, ...)
+        io.write(str)
+    end
+
+    local sources = {}
+    local names = {}
+
+    local function addModule(name, path)
+        local file = assert(io.open(path, 'rb'))
+        local source = file:read('*a')
+        file:close()
+
+        sources[name] = source
+        names[#names + 1] = name
+
+        -- Pull in the runtime units the module uses, modules not found are left to the searchers
+        for required in source:gmatch('require%s*%(?%s*["\']([%w_]+)["\']') do
+            if not sources[required] then
+                for _, dir in ipairs(searchDirs) do
+                    local path = dir .. '/' .. required .. '.lua'
+                    local file = io.open(path, 'rb')
+
+                    if file then
+                        file:close()
+                        addModule(required, path)
+                        break
+                    end
+                end
+            end
+        end
+    end
+
+    for _, path in ipairs(paths) do
+        local name = path:gsub('\\', '/'):match('([^/]+)%.lua$')
+
+        if not name then
+            io.stderr:write(string.format('Error: %s is not a Lua file\n', path))
+            os.exit(1)
+        end
+
+        if not sources[name] then
+            addModule(name, path)
+        end
+    end
+
+    out('-- Generated by packgame.lua, do not edit\n')
+    out('local loaded, preload = package.loaded, package.preload\n')
+    out('local searchRequire = require\n')
+    out('local modules = {}\n\n')
+
+    -- The modules see this require as an upvalue, so modules in the bundle are loaded without going through the
+    -- searchers
+    out('local function require(name)\n')
+    out('    local module = loaded[name]\n\n')
+    out('    if module ~= nil then\n')
+    out('        return module\n')
+    out('    end\n\n')
+    out('    local loader = modules[name]\n\n')
+    out('    if not loader then\n')
+    out('        return searchRequire(name)\n')
+    out('    end\n\n')
+    out('    module = loader(name)\n\n')
+    out('    if module == nil then\n')
+    out('        module = true\n')
+    out('    end\n\n')
+    out('    loaded[name] = module\n')
+    out('    return module\n')
+    out('end\n\n')
+
+    for _, name in ipairs(names) do
+        out('modules[%q] = function(...)\n', name)
+        out('%s', sources[name])
+
+        if not sources[name]:match('\n$') then
+            out('\n')
+        end
+
+        out('end\n\n')
+    end
+
+    -- The entry point makes the modules available to the global require and returns their names
+    out('local names = {}\n\n')
+    out('for name in pairs(modules) do\n')
+    out('    preload[name] = function()\n')
+    out('        return require(name)\n')
+    out('    end\n\n')
+    out('    names[#names + 1] = name\n')
+    out('end\n\n')
+    out('return names\n')
+end
+
+if arg[1] == '--bundle' then
+    local paths = {}
+    local searchDirs = {}
+
+    for i = 2, #arg do
+        if arg[i]:sub(1, 2) == '-I' then
+            searchDirs[#searchDirs + 1] = arg[i]:sub(3)
+        else
+            paths[#paths + 1] = arg[i]
+        end
+    end
+
+    if #paths == 0 then
+        print(string.format('Usage: lua %s --bundle [-I<units folder>...] <lua file>...', arg[0]))
+        os.exit(1)
+    end
+
+    genBundle(paths, searchDirs)
+    return
 end
 
 if #arg ~= 2 then
     print(string.format('Usage: lua %s (--settings | --gfxinit | --makefile) <game folder>', arg[0]))
+    print(string.format('       lua %s --bundle [-I<units folder>...] <lua file>...', arg[0]))
     exit(1)
 end
 
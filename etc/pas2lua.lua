@@ -23,32 +23,70 @@ local function dump(tab, level)
     end
 end
 
-local cache = {}
+-- ASTs already parsed in this run, and interfaces of units loaded from the disk cache
+local cache, interfaces = {}, {}
+
+-- Directory where the interfaces of units are cached between runs, set with -C, and the hash of the parser used to
+-- invalidate the cache when it changes
+local cacheDir, parserHash
+
+local function macrosKey(macros)
+    local list = {}
+
+    for macro in pairs(macros) do
+        list[#list + 1] = macro
+    end
+
+    table.sort(list)
+    return table.concat(list, ',')
+end
+
+local function readFile(path)
+    local file, err = io.open(path, 'rb')
+
+    if not file then
+        return nil, err
+    end
+
+    local contents = file:read('*a')
+    file:close()
+    return contents
+end
+
+-- 64-bit FNV-1a
+local function hash(str, h)
+    h = h or -3750763034362895579
+
+    for i = 1, #str, 64 do
+        local bytes = {str:byte(i, i + 63)}
+
+        for j = 1, #bytes do
+            h = (h ~ bytes[j]) * 1099511628211
+        end
+    end
+
+    return h
+end
 
 local function parse(path, macros)
     assert(type(path) == 'string')
     assert(type(macros) == 'table')
 
-    -- Use absolute path with the cache
-    local abs_path = ddlt.realpath(path)
+    -- Use absolute path and the macros with the cache
+    local key = ddlt.realpath(path) .. ';' .. macrosKey(macros)
+    local ast = cache[key]
 
-    -- Check the cache, assumes the same macros are always used
-    local source = cache[abs_path]
-
-    if source then
-        return source
+    if ast then
+        return ast
     end
 
     -- Load the source code from the file system
-    local file, err = io.open(path, 'r')
+    local source, err = readFile(path)
 
-    if not file then
+    if not source then
         return nil, string.format('%s:0: Error opening input file: %s', path, err)
     end
 
-    local source = file:read('*a')
-    file:close()
-
     -- Pre-process the source code with the macros
     local new_source, err = pascal.preprocess(path, source, macros)
 
@@ -71,6 +109,98 @@ local function parse(path, macros)
     end
 
     -- We have an AST
+    cache[key] = ast
+    return ast
+end
+
+local function serialize(value, out)
+    if type(value) == 'string' or type(value) == 'number' or type(value) == 'boolean' then
+        out[#out + 1] = string.format('%q', value)
+    elseif type(value) == 'userdata' or type(value) == 'table' then
+        out[#out + 1] = '{'
+
+        for k, v in pairs(value) do
+            out[#out + 1] = '['
+            serialize(k, out)
+            out[#out + 1] = ']='
+            serialize(v, out)
+            out[#out + 1] = ','
+        end
+
+        out[#out + 1] = '}\n'
+    else
+        error(string.format('cannot serialize a %s', type(value)))
+    end
+end
+
+local function deserialize(value)
+    if type(value) ~= 'table' then
+        return value
+    end
+
+    for k, v in pairs(value) do
+        value[k] = deserialize(v)
+    end
+
+    return access.const(value)
+end
+
+-- Returns a unit that is only used for its interface, from the disk cache if the unit, the macros and the parser didn't
+-- change since it was cached
+local function parseInterface(path, macros)
+    local key = ddlt.realpath(path) .. ';' .. macrosKey(macros)
+    local ast = cache[key] or interfaces[key]
+
+    if ast or not cacheDir then
+        return ast or parse(path, macros)
+    end
+
+    local source, err = readFile(path)
+
+    if not source then
+        return nil, string.format('%s:0: Error opening input file: %s', path, err)
+    end
+
+    if not parserHash then
+        local parserPath = package.searchpath('pascal', package.path)
+        parserHash = hash(parserPath and readFile(parserPath) or '')
+    end
+
+    local name = string.format('%016x', hash(source, hash(macrosKey(macros), parserHash)))
+    local cachePath = ddlt.join(cacheDir, name, 'lua')
+    local chunk = loadfile(cachePath, 't', {})
+
+    if chunk then
+        local ok, unit = pcall(chunk)
+
+        if ok and type(unit) == 'table' then
+            ast = deserialize(unit)
+            interfaces[key] = ast
+            return ast
+        end
+    end
+
+    ast, err = parse(path, macros)
+
+    if not ast then
+        return nil, err
+    end
+
+    -- Only the interface is needed to use the unit
+    local unit = {type = 'unit', line = ast.line, id = ast.id, path = ast.path, interface = ast.interface}
+    local out = {'return '}
+
+    if pcall(serialize, unit, out) then
+        local file = io.open(cachePath, 'wb')
+
+        if file then
+            file:write(table.concat(out, ''))
+            file:close()
+        else
+            io.stderr:write(string.format('Warning: could not write to the cache at "%s"\n', cachePath))
+        end
+    end
+
     return ast
 end
 
@@ -94,11 +224,12 @@ local function findUnit(unit, searchPaths)
     return nil
 end
 
-local function generate(ast, searchPaths, macros, out)
+local function generate(ast, searchPaths, macros, out, optimize)
     assert(type(ast) == 'userdata')
     assert(type(searchPaths) == 'table')
     assert(type(macros) == 'table')
     assert(type(out) == 'table')
+    assert(type(optimize) == 'boolean')
 
     local defaultValues = {
         real48 = 0,
@@ -124,6 +255,16 @@ local function generate(ast, searchPaths, macros, out)
 
     local scope = false
 
+    -- Classes declared in the unit being generated, mapped to their ids
+    local localClasses = {}
+
+    -- Scopes with the interfaces of other units
+    local unitScopes = {}
+
+    -- Where to declare the locals caching functions from other units, and the references to them
+    local hoistAt = false
+    local hoisted = {}
+
     local function fatal(line, format, ...)
         error(string.format('%s:%u: %s', ast.path, line, string.format(format, ...)))
     end
@@ -293,9 +434,340 @@ local function generate(ast, searchPaths, macros, out)
                 error(string.format('do not know how to push declaration %s', decl.type))
             end
         end
+
+        return ids
+    end
+
+    local genExpression, genDesignator, genArray, typeOf
+
+    -- Types used to infer the Lua representation of expressions
+    local integerTypes = {
+        shortint = true,
+        smallint = true,
+        integer = true,
+        byte = true,
+        longint = true,
+        int64 = true,
+        word = true,
+        longword = true
+    }
+
+    local stringTypes = {
+        char = true,
+        widechar = true,
+        pchar = true
+    }
+
+    local charType = {type = 'ordident', subtype = 'char'}
+
+    -- Follows type identifiers to the actual type, typed constants resolve to their type
+    local function resolveType(t)
+        while type(t) == 'userdata' and (t.type == 'typeid' or (t.type == 'const' and t.subtype)) do
+            local resolved = t.type == 'const' and t.subtype or findId(t.id)
+
+            if resolved == t then
+                return nil
+            end
+
+            t = resolved
+        end
+
+        return t
+    end
+
+    local function findDeclaration(declarations, id)
+        for i = 1, #declarations do
+            local decl = declarations[i]
+
+            if decl.type == 'types' then
+                for j = 1, #decl.types do
+                    if decl.types[j].id:lower() == id then
+                        return decl.types[j].subtype
+                    end
+                end
+            elseif decl.type == 'constants' then
+                for j = 1, #decl.constants do
+                    if decl.constants[j].id:lower() == id then
+                        return decl.constants[j]
+                    end
+                end
+            elseif decl.type == 'variables' or decl.type == 'field' then
+                local list = decl.type == 'field' and {decl} or decl.variables
+
+                for j = 1, #list do
+                    for k = 1, #list[j].ids do
+                        if list[j].ids[k]:lower() == id then
+                            return list[j].subtype
+                        end
+                    end
+                end
+            elseif decl.type == 'prochead' or decl.type == 'funchead' or decl.type == 'consthead' or decl.type == 'desthead' then
+                if decl.qid.id[#decl.qid.id]:lower() == id then
+                    return decl
+                end
+            end
+        end
+    end
+
+    -- Returns the declaration of a field, method or exported identifier of a class, record or unit
+    local function findMember(t, id)
+        t = resolveType(t)
+        id = id:lower()
+
+        if type(t) ~= 'userdata' then
+            return nil
+        elseif t.type == 'unit' then
+            return findDeclaration(t.interface.declarations, id)
+        elseif t.type == 'rectype' then
+            return findDeclaration(t.declarations, id)
+        elseif t.type == 'class' then
+            while t do
+                local member = findDeclaration(t.declarations, id)
+
+                if member then
+                    return member
+                end
+
+                t = t.super and resolveType(findId(t.super))
+
+                if type(t) ~= 'userdata' or t.type ~= 'class' then
+                    return nil
+                end
+            end
+        end
+    end
+
+    -- Returns the result type of calling something, a cast if it's a type
+    local function returnType(t)
+        t = resolveType(t)
+
+        if type(t) ~= 'userdata' then
+            return nil
+        elseif t.type == 'procdecl' then
+            t = t.heading
+        elseif t.type == 'proctype' then
+            t = t.subtype
+        end
+
+        if t.type == 'funchead' then
+            return t.returnType
+        elseif t.type == 'prochead' or t.type == 'consthead' or t.type == 'desthead' then
+            return nil
+        end
+
+        return t
+    end
+
+    -- Reduces a type to how it's represented in Lua: 'integer', 'real', 'boolean', 'string', or nil when unknown
+    local function category(t)
+        t = resolveType(t)
+
+        if type(t) ~= 'userdata' and type(t) ~= 'table' then
+            return nil
+        elseif t.type == 'ordident' then
+            if integerTypes[t.subtype] then
+                return 'integer'
+            elseif stringTypes[t.subtype] then
+                return 'string'
+            elseif t.subtype == 'boolean' then
+                return 'boolean'
+            end
+        elseif t.type == 'realtype' then
+            return 'real'
+        elseif t.type == 'stringtype' then
+            return 'string'
+        elseif t.type == 'subrange' then
+            return typeOf(t.min)
+        elseif t.type == 'const' then
+            if t.subtype then
+                return category(t.subtype)
+            end
+
+            return typeOf(t.value)
+        elseif t.type == 'funchead' or t.type == 'procdecl' then
+            return category(returnType(t))
+        end
+
+        return nil
+    end
+
+    -- Element types of arrays created with hh2rt.createArray, other arrays are nested Lua tables
+    local nativeElementTypes = {
+        shortint = 'int8',
+        byte = 'uint8',
+        smallint = 'int16',
+        word = 'uint16',
+        integer = 'int32',
+        longint = 'int32',
+        longword = 'uint32',
+        boolean = 'boolean'
+    }
+
+    -- Returns the element type of a native array, or nil if the array must be a Lua table
+    local function nativeArrayType(t)
+        t = resolveType(t)
+
+        if type(t) ~= 'userdata' or t.type ~= 'arraytype' or not t.limits then
+            return nil
+        end
+
+        for i = 1, #t.limits do
+            local limit = t.limits[i]
+
+            if limit.type ~= 'subrange' or typeOf(limit.min) ~= 'integer' or typeOf(limit.max) ~= 'integer' then
+                return nil
+            end
+        end
+
+        local subtype = resolveType(t.subtype)
+
+        if type(subtype) ~= 'userdata' then
+            return nil
+        elseif subtype.type == 'ordident' then
+            return nativeElementTypes[subtype.subtype]
+        elseif subtype.type == 'realtype' then
+            return 'double'
+        elseif subtype.type == 'enumerated' then
+            return 'int32'
+        elseif subtype.type == 'subrange' and category(subtype) == 'integer' then
+            return 'int32'
+        end
+    end
+
+    -- Breaks a designator into a list of steps, the qualified identifier becomes a variable followed by field accesses
+    local function designatorSteps(designator)
+        local steps = {{type = 'variable', id = designator.qid.id[1]}}
+
+        for i = 2, #designator.qid.id do
+            steps[#steps + 1] = {type = 'accfield', id = designator.qid.id[i]}
+        end
+
+        local node = designator.next
+
+        while node do
+            local last = steps[#steps]
+
+            -- a[i][j] is the same as a[i, j], merge them so native arrays can be indexed in one go
+            if node.type == 'accindex' and last.type == 'accindex' then
+                local indices = {table.unpack(last.indices)}
+                table.move(node.indices, 1, #node.indices, #indices + 1, indices)
+                steps[#steps] = {type = 'accindex', indices = indices}
+            else
+                steps[#steps + 1] = node
+            end
+
+            node = node.next
+        end
+
+        return steps
+    end
+
+    -- Returns the type of the result of applying a designator step to a value of type t
+    local function stepType(t, step)
+        if step.type == 'variable' then
+            return findId(step.id)
+        elseif step.type == 'accfield' then
+            return findMember(t, step.id)
+        elseif step.type == 'accindex' then
+            local count = #step.indices
+
+            while count > 0 and t do
+                t = resolveType(t)
+
+                if type(t) ~= 'userdata' then
+                    t = nil
+                elseif t.type == 'arraytype' then
+                    count = count - (t.limits and #t.limits or 1)
+                    t = count >= 0 and t.subtype or nil
+                elseif t.type == 'stringtype' then
+                    count = count - 1
+                    t = charType
+                else
+                    t = nil
+                end
+            end
+
+            return t
+        elseif step.type == 'call' then
+            return returnType(t)
+        end
+    end
+
+    local function typeOfDesignator(designator)
+        local steps = designatorSteps(designator)
+        local t
+
+        for i = 1, #steps do
+            t = stepType(t, steps[i])
+        end
+
+        return category(t)
+    end
+
+    typeOf = function(expression)
+        local type = expression.type
+
+        if type == 'literal' then
+            local subtype = expression.subtype
+
+            if subtype == '<decimal>' or subtype == '<hexadecimal>' or subtype == '<binary>' or subtype == '<octal>' then
+                return 'integer'
+            elseif subtype == '<float>' then
+                return 'real'
+            elseif subtype == '<string>' then
+                return 'string'
+            elseif subtype == 'boolean' then
+                return 'boolean'
+            end
+        elseif type == 'variable' then
+            return typeOfDesignator(expression)
+        elseif type == 'cast' then
+            return category(expression.subtype)
+        elseif type == 'not' or type == 'unm' then
+            return typeOf(expression.operand)
+        elseif type == '+' or type == '-' or type == '*' then
+            local left, right = typeOf(expression.left), typeOf(expression.right)
+
+            if type == '+' and (left == 'string' or right == 'string') then
+                return 'string'
+            elseif left == 'integer' and right == 'integer' then
+                return 'integer'
+            elseif (left == 'integer' or left == 'real') and (right == 'integer' or right == 'real') then
+                return 'real'
+            end
+        elseif type == '/' then
+            return 'real'
+        elseif type == 'div' or type == 'mod' or type == 'shl' or type == 'shr' then
+            return 'integer'
+        elseif type == 'and' or type == 'or' or type == 'xor' then
+            local left, right = typeOf(expression.left), typeOf(expression.right)
+
+            if left == right and (left == 'integer' or left == 'boolean') then
+                return left
+            end
+        elseif type == '=' or type == '<>' or type == '<' or type == '<=' or type == '>' or type == '>=' or type == 'in' then
+            return 'boolean'
+        end
+
+        return nil
+    end
+
+    local function stringLiteral(value)
+        value = value:gsub('^\'', '')
+        value = value:gsub('\'$', '')
+        value = value:gsub('\'\'', '\'')
+
+        value = value:gsub('\'#(%d+)\'', function(x) return string.char(tonumber(x)) end)
+        value = value:gsub('#(%d+)\'', function(x) return string.char(tonumber(x)) end)
+        value = value:gsub('\'#(%d+)', function(x) return string.char(tonumber(x)) end)
+
+        return value
     end
 
-    local genExpression, genDesignator, genArray
+    -- %q breaks new lines with a backslash, which doesn't play well with the indentation in out
+    local function quote(value)
+        return (string.format('%q', value):gsub('\\\n', '\\n'))
+    end
 
     local function genLiteral(literal)
         assert(type(literal) == 'userdata')
@@ -308,39 +780,56 @@ local function generate(ast, searchPaths, macros, out)
         elseif literal.subtype == '<float>' then
             out('%s', tostring(literal.value))
         elseif literal.subtype == '<string>' then
-            local value = literal.value
-            value = value:gsub('^\'', '')
-            value = value:gsub('\'$', '')
-            value = value:gsub('\'\'', '\'')
-
-            value = value:gsub('\'#(%d+)\'', function(x) return string.char(tonumber(x)) end)
-            value = value:gsub('#(%d+)\'', function(x) return string.char(tonumber(x)) end)
-            value = value:gsub('\'#(%d+)', function(x) return string.char(tonumber(x)) end)
-
-            out('%q', value)
+            out('%s', quote(stringLiteral(literal.value)))
         elseif literal.subtype == 'boolean' then
             out('%s', tostring(literal.value))
         elseif literal.subtype == 'nil' then
             out('nil')
         elseif literal.subtype == 'set' then
-            out('hh2rt.instantiateSet({')
-            local comma = ''
+            -- Single elements go in one set, ranges are added to it
+            local singles, ranges = {}, {}
 
             for i = 1, #literal.elements do
                 local element = literal.elements[i]
 
-                out(comma)
-                comma = ', '
-
                 if element.value then
-                    genDesignator(element.value)
+                    singles[#singles + 1] = element.value
                 else
-                    dump(element)
-                    error('do not know how to generate literal set element without a value')
+                    ranges[#ranges + 1] = element
                 end
             end
 
-            out('})')
+            local plus = ''
+
+            if #ranges ~= 0 then
+                out('(')
+            end
+
+            if #singles ~= 0 or #ranges == 0 then
+                out('hh2rt.createSet(')
+
+                for i = 1, #singles do
+                    out(i == 1 and '' or ', ')
+                    genExpression(singles[i])
+                end
+
+                out(')')
+                plus = ' + '
+            end
+
+            for i = 1, #ranges do
+                out('%shh2rt.createSetRange(', plus)
+                plus = ' + '
+
+                genExpression(ranges[i].first)
+                out(', ')
+                genExpression(ranges[i].last)
+                out(')')
+            end
+
+            if #ranges ~= 0 then
+                out(')')
+            end
         else
             dump(literal)
             error(string.format('do not know how to generate literal %s', literal.subtype))
@@ -364,115 +853,517 @@ local function generate(ast, searchPaths, macros, out)
         --elseif value.type == 'subrange' then
         --    out('0')
         elseif value.type == 'set' then
-            out('hh2rt.instantiateSet(%s)', accessId(value.id))
+            out('hh2rt.createSet()')
         elseif value.type == 'stringtype' then
             out('""')
+        elseif value.type == 'arraytype' then
+            genArray(value)
         else
             dump(value)
             error(string.format('do not know how to initialize field %s', value.type))
         end
-    end
+    end
+
+    local function genConstValue(value)
+        local function genValue(v)
+            if type(v) ~= 'userdata' then
+                out('%s', tostring(v))
+            elseif #v ~= 0 then
+                out('{')
+                genValue(v[1])
+
+                for i = 2, #v do
+                    out(', ')
+                    genValue(v[i])
+                end
+
+                out('}')
+            elseif v.type == 'arrayconst' then
+                out('\n')
+                out:indent()
+                genValue(v.value)
+                out:unindent()
+            else
+                genLiteral(v)
+            end
+        end
+
+        if value.type == 'arrayconst' then
+            genValue(value.value)
+        else
+            genLiteral(value)
+        end
+    end
+
+    -- Folds constant expressions, returns nil when the expression isn't constant
+    local folded = {}
+    local constValue
+
+    local function foldDesignator(designator)
+        local steps = designatorSteps(designator)
+        local t
+
+        for i = 1, #steps do
+            if steps[i].type ~= 'variable' and steps[i].type ~= 'accfield' then
+                return nil
+            end
+
+            t = stepType(t, steps[i])
+        end
+
+        if type(t) ~= 'userdata' then
+            return nil
+        end
+
+        -- Evaluate the constant in the scope where it was declared, or without a scope when qualified
+        local declared = #steps == 1 and findScope(steps[1].id)
+        local saved = scope
+        local value
+
+        if t.type == 'const' and not t.subtype then
+            scope = declared
+            value = constValue(t.value)
+        elseif t.type == 'enumerated' and #steps == 1 then
+            -- Same values as genEnumElements, the identifier can also be the type itself
+            local id = steps[1].id:lower()
+            local last
+            scope = declared
+
+            for i = 1, #t.elements do
+                local element = t.elements[i]
+
+                if element.value then
+                    last = constValue(element.value)
+                else
+                    last = math.type(last) == 'integer' and last + 1 or (i == 1 and 0 or nil)
+                end
+
+                if last == nil then
+                    break
+                elseif element.id:lower() == id then
+                    value = last
+                    break
+                end
+            end
+        end
+
+        scope = saved
+        return value
+    end
+
+    local function foldBinary(op, left, right)
+        local tl, tr = math.type(left), math.type(right)
+
+        if op == '+' then
+            if type(left) == 'string' and type(right) == 'string' then
+                return left .. right
+            elseif tl and tr then
+                return left + right
+            end
+        elseif op == '-' then
+            return tl and tr and left - right or nil
+        elseif op == '*' then
+            return tl and tr and left * right or nil
+        elseif op == '/' then
+            return tl and tr and right ~= 0 and left / right or nil
+        elseif op == 'div' then
+            -- Fold with the same floored operators genDiv and genModulus emit, so folding never changes the result
+            return tl == 'integer' and tr == 'integer' and right ~= 0 and left // right or nil
+        elseif op == 'mod' then
+            return tl == 'integer' and tr == 'integer' and right ~= 0 and left % right or nil
+        elseif op == 'shl' then
+            return tl == 'integer' and tr == 'integer' and left << right or nil
+        elseif op == 'shr' then
+            return tl == 'integer' and tr == 'integer' and left >> right or nil
+        elseif op == 'and' or op == 'or' or op == 'xor' then
+            if tl == 'integer' and tr == 'integer' then
+                return op == 'and' and left & right or op == 'or' and left | right or left ~ right
+            elseif type(left) == 'boolean' and type(right) == 'boolean' then
+                if op == 'and' then
+                    return left and right
+                elseif op == 'or' then
+                    return left or right
+                end
+
+                return left ~= right
+            end
+        elseif type(left) == type(right) or (tl and tr) then
+            if op == '=' then
+                return left == right
+            elseif op == '<>' then
+                return left ~= right
+            elseif type(left) ~= 'boolean' then
+                if op == '<' then
+                    return left < right
+                elseif op == '<=' then
+                    return left <= right
+                elseif op == '>' then
+                    return left > right
+                elseif op == '>=' then
+                    return left >= right
+                end
+            end
+        end
+
+        return nil
+    end
+
+    local binaryOps = {
+        ['+'] = true, ['-'] = true, ['*'] = true, ['/'] = true, div = true, mod = true, shl = true, shr = true,
+        ['and'] = true, ['or'] = true, xor = true, ['='] = true, ['<>'] = true, ['<'] = true, ['<='] = true,
+        ['>'] = true, ['>='] = true
+    }
+
+    constValue = function(expression)
+        local value = folded[expression]
+
+        if value == folded then
+            return nil
+        elseif value ~= nil then
+            return value
+        end
+
+        local op = expression.type
+
+        if op == 'literal' then
+            local subtype = expression.subtype
+
+            if subtype == '<decimal>' then
+                value = math.tointeger(tonumber(expression.value))
+            elseif subtype == '<hexadecimal>' then
+                value = tonumber((expression.value:gsub('[^%x]', '')), 16)
+            elseif subtype == '<float>' then
+                value = tonumber(expression.value)
+            elseif subtype == '<string>' then
+                value = stringLiteral(expression.value)
+            elseif subtype == 'boolean' then
+                value = expression.value == 'true'
+            end
+        elseif op == 'variable' then
+            value = foldDesignator(expression)
+        elseif op == 'not' then
+            value = constValue(expression.operand)
+
+            if math.type(value) == 'integer' then
+                value = ~value
+            elseif type(value) == 'boolean' then
+                value = not value
+            else
+                value = nil
+            end
+        elseif op == 'unm' then
+            value = constValue(expression.operand)
+            value = math.type(value) and -value or nil
+        elseif binaryOps[op] then
+            local left, right = constValue(expression.left), constValue(expression.right)
+
+            if left ~= nil and right ~= nil then
+                value = foldBinary(op, left, right)
+            end
+        end
+
+        -- Don't fold to values that can't be written back as literals
+        if math.type(value) == 'float' and (value ~= value or value == math.huge or value == -math.huge) then
+            value = nil
+        end
+
+        if value == nil then
+            folded[expression] = folded
+        else
+            folded[expression] = value
+        end
+
+        return value
+    end
+
+    -- Returns the ordinal values of a set known at compile time, and whether they are chars, booleans or integers
+    local function constSet(expression)
+        if expression.type == 'variable' then
+            -- Untyped constants, evaluated in the scope where they were declared
+            local steps = designatorSteps(expression)
+            local t = #steps == 1 and findId(steps[1].id)
+
+            if type(t) ~= 'userdata' or t.type ~= 'const' or t.subtype then
+                return nil
+            end
+
+            local saved = scope
+            scope = findScope(steps[1].id)
+            local values, kind = constSet(t.value)
+            scope = saved
+
+            return values, kind
+        elseif expression.type ~= 'literal' or expression.subtype ~= 'set' then
+            return nil
+        end
+
+        local values, kind = {}, 'integer'
+
+        local function ordinal(value)
+            if type(value) == 'string' and #value == 1 then
+                kind = 'char'
+                return value:byte()
+            elseif type(value) == 'boolean' then
+                kind = 'boolean'
+                return value and 1 or 0
+            end
+
+            return math.type(value) == 'integer' and value >= 0 and value <= 255 and value or nil
+        end
+
+        for i = 1, #expression.elements do
+            local element = expression.elements[i]
+            local first, last
+
+            if element.value then
+                first = ordinal(constValue(element.value))
+                last = first
+            else
+                first, last = ordinal(constValue(element.first)), ordinal(constValue(element.last))
+            end
+
+            if not first or not last then
+                return nil
+            end
+
+            for value = first, last do
+                values[#values + 1] = value
+            end
+        end
+
+        return values, kind
+    end
+
+    local function genConstant(value)
+        if math.type(value) == 'integer' then
+            out(value < 0 and '(%d)' or '%d', value)
+        elseif math.type(value) == 'float' then
+            local str = string.format('%.17g', value)
+
+            if not str:find('[%.eEn]') then
+                str = str .. '.0'
+            end
+
+            out(value < 0 and '(%s)' or '%s', str)
+        elseif type(value) == 'string' then
+            out('%s', quote(value))
+        else
+            out('%s', tostring(value))
+        end
+    end
+
+    -- Returns how to access a method with static dispatch, only done for methods of classes declared in this unit
+    -- since classes from other units can be replaced by the runtime
+    local function staticMethod(t, id)
+        t = resolveType(t)
+        id = id:lower()
+
+        while type(t) == 'userdata' and t.type == 'class' do
+            local member = findDeclaration(t.declarations, id)
+
+            if member then
+                if localClasses[t] and (member.type == 'prochead' or member.type == 'funchead') then
+                    return string.format('%s.%s', accessId(localClasses[t]), id)
+                end
+
+                return nil
+            end
+
+            t = t.super and resolveType(findId(t.super))
+        end
+    end
+
+    local function isFunction(t)
+        return type(t) == 'userdata' and (t.type == 'prochead' or t.type == 'funchead')
+    end
+
+    local function genArguments(arguments, comma)
+        if arguments then
+            for i = 1, #arguments do
+                out(comma)
+                comma = ', '
+
+                genExpression(arguments[i])
+            end
+        end
+    end
+
+    -- Generates a designator, arguments are for an implicit call at the end like in procedure call statements, and value
+    -- is assigned to the designator when it needs a method call to do it; returns true if value was used
+    genDesignator = function(designator, arguments, value)
+        if designator.type ~= 'variable' then
+            dump(designator)
+            error(string.format('do not know how to generate designator %s', designator.type))
+        end
+
+        local steps = designatorSteps(designator)
+        local types = {}
+        local t
+
+        for i = 1, #steps do
+            t = stepType(t, steps[i])
+            types[i] = t
+        end
+
+        -- Functions and constructors are called even without parenthesis
+        if not arguments and type(t) == 'userdata' and steps[#steps].type ~= 'call' then
+            if t.type == 'funchead' or t.type == 'consthead' or (t.type == 'procdecl' and t.heading.type == 'funchead') then
+                arguments = false
+            end
+        end
+
+        if arguments ~= nil then
+            steps[#steps + 1] = {type = 'call', arguments = arguments}
+            types[#steps] = stepType(t, steps[#steps])
+        end
+
+        -- Native multi-dimensional arrays indexed with all dimensions use get and set to avoid creating slices
+        local function nativeIndex(i)
+            local t = resolveType(types[i - 1])
+            local step = steps[i]
+
+            return step.type == 'accindex' and nativeArrayType(t) and #t.limits > 1 and #step.indices == #t.limits
+        end
 
-    local function genConstValue(value)
-        local function genValue(v)
-            if type(v) ~= 'userdata' then
-                out('%s', tostring(v))
-            elseif #v ~= 0 then
-                out('{')
-                genValue(v[1])
+        local function genStep(i)
+            local step = steps[i]
 
-                for i = 2, #v do
-                    out(', ')
-                    genValue(v[i])
+            if step.type == 'variable' then
+                local acc = accessId(step.id)
+
+                if not acc then
+                    fatal(designator.line, 'unknown identifier: %q', step.id)
                 end
 
-                out('}')
-            elseif v.type == 'arrayconst' then
-                out('\n')
-                out:indent()
-                genValue(v.value)
-                out:unindent()
+                out('%s', acc)
+            elseif step.type == 'accfield' then
+                out('.%s', step.id:lower())
+            elseif nativeIndex(i) then
+                out(':get(')
+                genArguments(step.indices, '')
+                out(')')
+            elseif step.type == 'accindex' then
+                out('[')
+                genExpression(step.indices[1])
+
+                for i = 2, #step.indices do
+                    out('][')
+                    genExpression(step.indices[i])
+                end
+
+                out(']')
+            elseif step.type == 'call' then
+                out('(')
+                genArguments(step.arguments, '')
+                out(')')
             else
-                genLiteral(v)
+                dump(step)
+                error(string.format('do not know how to generate designator %s', step.type))
             end
         end
 
-        if value.type == 'arrayconst' then
-            genValue(value.value)
-        else
-            genLiteral(value)
-        end
-    end
+        local function genSteps(last)
+            -- Call the last method that doesn't need dynamic dispatch directly, passing the object as self
+            for i = last - 1, 1, -1 do
+                if steps[i + 1].type == 'call' and (steps[i].type == 'variable' or steps[i].type == 'accfield') then
+                    local method
 
-    genDesignator = function(designator)
-        if designator.type == 'variable' then
-            local acc = accessId(designator.qid.id[1])
+                    if i == 1 then
+                        local scope = findScope(steps[1].id)
 
-            if not acc then
-                fatal(designator.line, 'unknown identifier: %q', designator.qid.id[1])
-            end
+                        if scope and scope.access == 'self.%s' then
+                            method = staticMethod(findId('self'), steps[1].id)
+                        end
+                    else
+                        method = staticMethod(types[i - 1], steps[i].id)
+                    end
 
-            out('%s', acc)
+                    if method then
+                        out('%s(', method)
 
-            for i = 2, #designator.qid.id do
-                out('.%s', designator.qid.id[i]:lower())
-            end
+                        if i == 1 then
+                            out('self')
+                        else
+                            genSteps(i - 1)
+                        end
 
-            if not designator.next then
-                local t = findId(designator.qid.id[1])
+                        genArguments(steps[i + 1].arguments, ', ')
+                        out(')')
+
+                        for j = i + 2, last do
+                            genStep(j)
+                        end
 
-                if type(t) == 'userdata' and t.type == 'funchead' then
-                    out('()')
+                        return
+                    end
                 end
             end
-        elseif designator.type == 'accfield' then
-            out('.%s', designator.id:lower())
-        elseif designator.type == 'accindex' then
-            out('[')
-            genExpression(designator.indices[1])
 
-            for i = 2, #designator.indices do
-                out('][')
-                genExpression(designator.indices[i])
-            end
+            -- Functions from other units are cached in locals, declared when the unit is done
+            local first = 1
 
-            out(']')
-        elseif designator.type == 'call' then
-            out('(')
+            if hoistAt then
+                local ref
+                local declared = findScope(steps[1].id)
 
-            if designator.arguments then
-                local comma = ''
+                if isFunction(types[1]) and declared and unitScopes[declared.ids] then
+                    ref, first = accessId(steps[1].id), 2
+                elseif type(types[1]) == 'userdata' and types[1].type == 'unit' and last >= 2 and steps[2].type == 'accfield'
+                    and isFunction(types[2]) then
 
-                for i = 1, #designator.arguments do
-                    out(comma)
-                    comma = ', '
+                    ref, first = string.format('%s.%s', accessId(steps[1].id), steps[2].id:lower()), 3
+                end
 
-                    genExpression(designator.arguments[i])
+                if ref then
+                    out('%s', ref)
+
+                    local pieces = hoisted[ref] or {}
+                    hoisted[ref] = pieces
+                    pieces[#pieces + 1] = out:last()
                 end
             end
 
-            out(')')
-        else
-            dump(designator)
-            error(string.format('do not know how to generate designator %s', designator.type))
+            for i = first, last do
+                genStep(i)
+            end
         end
 
-        if designator.next then
-            genDesignator(designator.next)
+        if value and nativeIndex(#steps) then
+            genSteps(#steps - 1)
+            out(':set(')
+            genArguments(steps[#steps].indices, '')
+            out(', ')
+            genExpression(value)
+            out(')')
+            return true
+        elseif value and nativeArrayType(t) then
+            -- Arrays are assigned by value
+            genSteps(#steps)
+            out(':copy(')
+            genExpression(value)
+            out(')')
+            return true
         end
+
+        genSteps(#steps)
+        return false
     end
 
     genExpression = function(expression)
         local function genNot(notop)
-            out('(not ')
+            -- Integer operands are complemented, anything else is a logical not
+            out(typeOf(notop.operand) == 'integer' and '(~' or '(not ')
             genExpression(notop.operand)
             out(')')
         end
 
         local function genAdd(add)
+            -- Strings are concatenated, only fall back to the __add metamethod when the types are unknown
+            local concat = typeOf(add.left) == 'string' or typeOf(add.right) == 'string'
+
             out('(')
             genExpression(add.left)
-            out(' + ')
+            out(concat and ' .. ' or ' + ')
             genExpression(add.right)
             out(')')
         end
@@ -480,7 +1371,7 @@ local function generate(ast, searchPaths, macros, out)
         local function genAnd(andop)
             out('(')
             genExpression(andop.left)
-            out(' and ')
+            out(typeOf(andop) == 'integer' and ' & ' or ' and ')
             genExpression(andop.right)
             out(')')
         end
@@ -546,8 +1437,45 @@ local function generate(ast, searchPaths, macros, out)
         end
 
         local function genIn(inop)
+            local values, kind
+
+            if optimize then
+                values, kind = constSet(inop.right)
+            end
+
+            if values and kind ~= 'boolean' then
+                -- Test the element's bit in a mask relative to the smallest element if they all fit in an integer,
+                -- elements out of the mask shift it by a negative amount or by 64 or more and give zero
+                local min, max = math.min(255, table.unpack(values)), math.max(0, table.unpack(values))
+
+                if max - min < 64 then
+                    local mask = 0
+
+                    for i = 1, #values do
+                        mask = mask | (1 << (values[i] - min))
+                    end
+
+                    out(min ~= 0 and '((0x%x >> (' or '((0x%x >> ', mask)
+
+                    if kind == 'char' then
+                        out('(')
+                        genExpression(inop.left)
+                        out('):byte()')
+                    else
+                        genExpression(inop.left)
+                    end
+
+                    if min ~= 0 then
+                        out(' - %d)', min)
+                    end
+
+                    out(') & 1 ~= 0)')
+                    return
+                end
+            end
+
             genExpression(inop.right)
-            out('.containts(')
+            out(':contains(')
             genExpression(inop.left)
             out(')')
         end
@@ -609,11 +1537,44 @@ local function generate(ast, searchPaths, macros, out)
         local function genOr(node)
             out('(')
             genExpression(node.left)
-            out(' or ')
+            out(typeOf(node) == 'integer' and ' | ' or ' or ')
+            genExpression(node.right)
+            out(')')
+        end
+
+        local function genXor(node)
+            out('(')
+            genExpression(node.left)
+            out(typeOf(node) == 'integer' and ' ~ ' or ' ~= ')
+            genExpression(node.right)
+            out(')')
+        end
+
+        local function genShiftLeft(node)
+            out('(')
+            genExpression(node.left)
+            out(' << ')
+            genExpression(node.right)
+            out(')')
+        end
+
+        local function genShiftRight(node)
+            out('(')
+            genExpression(node.left)
+            out(' >> ')
             genExpression(node.right)
             out(')')
         end
 
+        if optimize and expression.type ~= 'literal' then
+            local value = constValue(expression)
+
+            if value ~= nil then
+                genConstant(value)
+                return
+            end
+        end
+
         local type = expression.type
 
         if type == 'literal' then
@@ -656,6 +1617,12 @@ local function generate(ast, searchPaths, macros, out)
             genModulus(expression)
         elseif type == 'or' then
             genOr(expression)
+        elseif type == 'xor' then
+            genXor(expression)
+        elseif type == 'shl' then
+            genShiftLeft(expression)
+        elseif type == 'shr' then
+            genShiftRight(expression)
         else
             dump(expression)
             error(string.format('do not know how to generate expression %s', type))
@@ -663,6 +1630,19 @@ local function generate(ast, searchPaths, macros, out)
     end
 
     local function genStatement(statement)
+        -- Returns the value of conditions known at compile time, nil otherwise
+        local function constCondition(expression)
+            if optimize then
+                local value = constValue(expression)
+
+                if type(value) == 'boolean' then
+                    return value
+                end
+            end
+
+            return nil
+        end
+
         local function genCompound(stmt)
             for i = 1, #stmt.statements do
                 genStatement(stmt.statements[i])
@@ -701,13 +1681,37 @@ local function generate(ast, searchPaths, macros, out)
         end
 
         local function genAssignment(assignment)
-            genDesignator(assignment.designator)
-            out(' = ')
-            genExpression(assignment.value)
+            if not genDesignator(assignment.designator, nil, assignment.value) then
+                out(' = ')
+                genExpression(assignment.value)
+            end
+
             out('\n')
         end
 
         local function genIf(ifstmt)
+            local condition = constCondition(ifstmt.condition)
+
+            if condition ~= nil then
+                -- Only generate the branch that can run
+                local branch = ifstmt.onfalse
+
+                if condition then
+                    branch = ifstmt.ontrue
+                end
+
+                if branch then
+                    out('\n')
+                    out('do\n')
+                    out:indent()
+                    genStatement(branch)
+                    out:unindent()
+                    out('end\n\n')
+                end
+
+                return
+            end
+
             out('\n')
             out('if ')
             genExpression(ifstmt.condition)
@@ -728,8 +1732,6 @@ local function generate(ast, searchPaths, macros, out)
         end
 
         local function genProcedureCall(call)
-            genDesignator(call.designator)
-
             local designator = call.designator
 
             while designator.next do
@@ -737,18 +1739,9 @@ local function generate(ast, searchPaths, macros, out)
             end
 
             if designator.type ~= 'call' then
-                out('(')
-
-                local comma = ''
-
-                for i = 1, #call.arguments do
-                    out('%s', comma)
-                    comma = ', '
-
-                    genExpression(call.arguments[i])
-                end
-
-                out(')')
+                genDesignator(call.designator, call.arguments)
+            else
+                genDesignator(call.designator)
             end
 
             out('\n')
@@ -875,6 +1868,10 @@ local function generate(ast, searchPaths, macros, out)
         end
 
         local function genWhile(node)
+            if constCondition(node.condition) == false then
+                return
+            end
+
             out('\n')
             out('while ')
             genExpression(node.condition)
@@ -896,13 +1893,26 @@ local function generate(ast, searchPaths, macros, out)
         local function genInherited(node)
             assert(node.designator.type == 'variable')
 
-            out('hh2rt.callInherited(%q, self', node.designator.qid.id[1]:lower())
+            local id = node.designator.qid.id[1]:lower()
+            local call = node.designator.next
+
+            if call and (call.type ~= 'call' or call.next) then
+                dump(call)
+                error(string.format('do not know how to generate inherited %s', call.type))
+            end
+
+            -- Methods are resolved to the super class here, constructors and destructors still go through the runtime
+            local class = resolveType(findId('self'))
+            local super = type(class) == 'userdata' and class.super
+            local method = super and findMember(findId(super), id)
 
-            if node.designator.next then
-                dump(node.designator.next)
-                (nil)()
+            if type(method) == 'userdata' and (method.type == 'prochead' or method.type == 'funchead') and accessId(super) then
+                out('%s.%s(self', accessId(super), id)
+            else
+                out('hh2rt.callInherited(%q, self', id)
             end
 
+            genArguments(call and call.arguments, ', ')
             out(')\n')
         end
 
@@ -913,6 +1923,17 @@ local function generate(ast, searchPaths, macros, out)
         end
 
         local function genRepeat(node)
+            if constCondition(node.condition) == true then
+                -- Runs only once
+                out('\n')
+                out('do\n')
+                out:indent()
+                genStatement(node.body)
+                out:unindent()
+                out('end\n\n')
+                return
+            end
+
             out('\n')
             out('repeat\n')
             out:indent()
@@ -1043,7 +2064,7 @@ local function generate(ast, searchPaths, macros, out)
         end
     end
 
-    local function genProcedureDeclaration(procedure, ismethod)
+    local function genProcedureDeclaration(procedure, class)
         local heading = procedure.heading
 
         if heading.type == 'consthead' then
@@ -1055,15 +2076,15 @@ local function generate(ast, searchPaths, macros, out)
         local saved = scope
         local ids = push(nil, '%s')
 
-        if ismethod then
+        if class then
             out('self')
-            ids.self = 'self'
+            ids.self = class
         end
 
         local params = procedure.heading.parameters
 
         if params then
-            local comma = ismethod and ', ' or ''
+            local comma = class and ', ' or ''
 
             for i = 1, #params do
                 local param = params[i]
@@ -1113,8 +2134,14 @@ local function generate(ast, searchPaths, macros, out)
 
     genArray = function(array, value)
         local subtype = array.subtype
+        local native = nativeArrayType(array)
+
+        if native then
+            out('hh2rt.createArray(%q, {', native)
+        else
+            out('hh2rt.newArray({')
+        end
 
-        out('hh2rt.newArray({')
         local comma = ''
 
         for i = 1, #array.limits do
@@ -1128,16 +2155,19 @@ local function generate(ast, searchPaths, macros, out)
             out('}')
         end
 
-        out('}, ')
+        out('}')
 
-        if subtype.type == 'typeid' then
-            out('nil --[[%s]]', subtype.id)
+        if native then
+            -- Native arrays are initialized with zeroes or false
+        elseif subtype.type == 'typeid' then
+            out(', nil --[[%s]]', subtype.id)
         elseif subtype.type == 'ordident' or subtype.type == 'realtype' then
-            out('%s --[[%s]]', defaultValues[subtype.subtype], subtype.subtype)
+            out(', %s --[[%s]]', defaultValues[subtype.subtype], subtype.subtype)
         elseif subtype.type == 'rectype' then
+            out(', ')
             genRecord(subtype)
         elseif subtype.type == 'stringtype' then
-            out('"" --[[%s]]', subtype.type)
+            out(', "" --[[%s]]', subtype.type)
         else
             dump(array)
             dump(subtype)
@@ -1171,20 +2201,48 @@ local function generate(ast, searchPaths, macros, out)
             out(', ')
             genValue(value.value)
             out(')\n\n')
+        elseif native then
+            out(')')
         else
             out(', nil)')
         end
     end
 
     genDeclarations = function(declarations, interface)
-        local function genClass(class, id)
-            if class.super then
-                out('hh2rt.newClass(%q, %s, function(self)\n', id, accessId(class.super))
-            else
-                out('hh2rt.newClass(%q, nil, function(self)\n', id)
+        -- Returns the Lua code to initialize a field of the given type, or nil if it's not known
+        local function fieldInitializer(subtype)
+            if subtype.type == 'typeid' then
+                local t = findId(subtype.id)
+
+                if type(t) ~= 'userdata' then
+                    return nil
+                elseif t.type == 'enumerated' then
+                    return accessId(t.elements[1].id)
+                elseif t.type == 'class' then
+                    local acc = accessId(subtype.id)
+                    return acc and string.format('%s.create()', acc)
+                elseif t.type == 'proctype' then
+                    return 'function() end'
+                elseif t.type == 'ordident' then
+                    return tostring(defaultValues[t.subtype])
+                elseif t.type == 'subrange' then
+                    return '0'
+                elseif t.type == 'set' then
+                    return 'hh2rt.createSet()'
+                end
+            elseif subtype.type == 'ordident' then
+                return tostring(defaultValues[subtype.subtype])
+            elseif subtype.type == 'stringtype' then
+                return '""'
             end
 
-            out:indent()
+            return nil
+        end
+
+        -- Returns a list with the fields of a class and their initializers, or nil and the declaration that can't be
+        -- initialized
+        local function classFields(class)
+            local fields = {}
 
             for i = 1, #class.declarations do
                 local decl = class.declarations[i]
@@ -1192,51 +2250,67 @@ local function generate(ast, searchPaths, macros, out)
                 if decl.type == 'consthead' or decl.type == 'desthead' or decl.type == 'prochead' or decl.type == 'funchead' then
                     -- nothing
                 elseif decl.type == 'field' then
-                    local subtype = decl.subtype
+                    local init = fieldInitializer(decl.subtype)
+
+                    if not init then
+                        return nil, decl
+                    end
 
                     for i = 1, #decl.ids do
-                        out('self.%s = ', decl.ids[i]:lower())
+                        fields[#fields + 1] = {id = decl.ids[i]:lower(), init = init}
+                    end
+                else
+                    return nil, decl
+                end
+            end
 
-                        if subtype.type == 'typeid' then
-                            local type = findId(subtype.id)
-
-                            if type.type == 'enumerated' then
-                                out('%s', accessId(type.elements[1].id))
-                            elseif type.type == 'class' then
-                                out('%s.create()', accessId(subtype.id))
-                            elseif type.type == 'proctype' then
-                                out('function() end')
-                            elseif type.type == 'ordident' then
-                                out('%s', defaultValues[type.subtype])
-                            elseif type.type == 'subrange' then
-                                out('0')
-                            elseif type.type == 'set' then
-                                out('hh2rt.instantiateSet(%s)', accessId(subtype.id))
-                            else
-                                dump(decl)
-                                dump(subtype)
-                                dump(type)
-                                error(string.format('do not know how to initialize type %s', type.type))
-                            end
-                        elseif subtype.type == 'ordident' then
-                            out('%s', defaultValues[subtype.subtype])
-                        elseif subtype.type == 'stringtype' then
-                            out('""')
-                        else
-                            dump(decl)
-                            dump(subtype)
-                            error(string.format('do not know how to initialize field %s', subtype.type))
-                        end
+            return fields
+        end
 
-                        out('\n')
-                    end
+        local function genClass(class, id)
+            local fields, decl = classFields(class)
+
+            if not fields then
+                dump(decl)
+                error(string.format('do not know how to initialize declaration %s', decl.type))
+            end
+
+            -- Initialize the fields of all the super classes here too when they're known, so that constructors only
+            -- have to call one init function
+            local flat = true
+            local super = class.super
+
+            while super and flat do
+                local t = resolveType(findId(super))
+                local inherited = type(t) == 'userdata' and t.type == 'class' and classFields(t)
+
+                if inherited then
+                    table.move(fields, 1, #fields, #inherited + 1, inherited)
+                    fields = inherited
+                    super = t.super
                 else
-                    error(string.format('do not know how to initialize declaration %s', decl.type))
+                    flat = false
                 end
             end
 
+            if not flat then
+                fields = classFields(class)
+            end
+
+            if class.super then
+                out('hh2rt.newClass(%q, %s, function(self)\n', id, accessId(class.super))
+            else
+                out('hh2rt.newClass(%q, nil, function(self)\n', id)
+            end
+
+            out:indent()
+
+            for i = 1, #fields do
+                out('self.%s = %s\n', fields[i].id, fields[i].init)
+            end
+
             out:unindent()
-            out('end)\n\n')
+            out(flat and 'end, true)\n\n' or 'end)\n\n')
         end
 
         local function genEnumElements(enum)
@@ -1366,7 +2440,13 @@ local function generate(ast, searchPaths, macros, out)
 
                         if interface then
                             if subtype.type == 'typeid' then
-                                out('%s = nil -- %s\n', declareId(id), subtype.id)
+                                local t = resolveType(subtype)
+
+                                if type(t) == 'userdata' and t.type == 'set' then
+                                    out('%s = hh2rt.createSet() -- %s\n', declareId(id), subtype.id)
+                                else
+                                    out('%s = nil -- %s\n', declareId(id), subtype.id)
+                                end
                             elseif subtype.type == 'arraytype' then
                                 out('%s = ', declareId(id))
                                 genArray(subtype)
@@ -1397,6 +2477,7 @@ local function generate(ast, searchPaths, macros, out)
                     out(' = ')
 
                     local type = findId(decl.heading.qid.id[1])
+                    local class = type.type == 'class' and type
                     local saved = scope
 
                     if type.type == 'class' then
@@ -1410,7 +2491,7 @@ local function generate(ast, searchPaths, macros, out)
                         end
                     end
 
-                    genProcedureDeclaration(decl, type.type == 'class')
+                    genProcedureDeclaration(decl, class)
                     scope = saved
                 end
             elseif decl.type == 'prochead' or decl.type == 'funchead' or decl.type == 'consthead' or decl.type == 'desthead' then
@@ -1457,13 +2538,13 @@ local function generate(ast, searchPaths, macros, out)
                 unit = unit:lower()
                 out('local %s = require "%s"\n', unit, unit)
 
-                local ast, err = parse(path, macros)
+                local ast, err = parseInterface(path, macros)
 
                 if not ast then
                     fatal(uses.line, err)
                 end
 
-                pushDeclarations(ast.interface.declarations, nil, unit .. '.%s')
+                unitScopes[pushDeclarations(ast.interface.declarations, nil, unit .. '.%s')] = true
                 push(nil, '%s')[unit:lower()] = ast
             end
 
@@ -1471,6 +2552,46 @@ local function generate(ast, searchPaths, macros, out)
         end
     end
 
+    local function genHoisted()
+        -- Most referenced first
+        local refs = {}
+
+        for ref in pairs(hoisted) do
+            refs[#refs + 1] = ref
+        end
+
+        table.sort(refs, function(ref1, ref2)
+            local count1, count2 = #hoisted[ref1], #hoisted[ref2]
+
+            if count1 ~= count2 then
+                return count1 > count2
+            end
+
+            return ref1 < ref2
+        end)
+
+        -- Stay well below the limit of 200 locals in the main chunk
+        local _, locals = out:result():gsub('\nlocal ', '')
+        local count = math.min(#refs, math.max(0, 180 - locals))
+        local decls = {'-- Cache functions from other units\n'}
+
+        for i = 1, count do
+            local ref = refs[i]
+            local id = 'hh2_' .. ref:gsub('%.', '_')
+            decls[#decls + 1] = string.format('local %s = %s\n', id, ref)
+
+            local pieces = hoisted[ref]
+
+            for j = 1, #pieces do
+                out:replace(pieces[j], id)
+            end
+        end
+
+        if count ~= 0 then
+            out:replace(hoistAt, table.concat(decls, '') .. '\n')
+        end
+    end
+
     local function genUnit(unit)
         out('-- Generated code for Pascal unit "%s"\n\n', unit.id)
         out('-- Our exported module\n')
@@ -1491,16 +2612,31 @@ local function generate(ast, searchPaths, macros, out)
                 fatal(node.line, 'Cannot find the path to unit "system"')
             end
 
-            local ast, err = parse(path, macros)
+            local ast, err = parseInterface(path, macros)
 
             if not ast then
                 fatal(unit.line, err)
             end
 
-            pushDeclarations(ast.interface.declarations, nil, 'system.%s')
+            unitScopes[pushDeclarations(ast.interface.declarations, nil, 'system.%s')] = true
             push(nil, '%s')['system'] = ast
         end
 
+        -- Methods of the classes declared in this unit can be called directly
+        for _, declarations in ipairs({unit.interface.declarations, unit.implementation.declarations}) do
+            for i = 1, #declarations do
+                local decl = declarations[i]
+
+                if decl.type == 'types' then
+                    for j = 1, #decl.types do
+                        if decl.types[j].subtype.type == 'class' then
+                            localClasses[decl.types[j].subtype] = decl.types[j].id
+                        end
+                    end
+                end
+            end
+        end
+
         out('\n')
         out('-- Interface section\n')
         genUses(unit.interface.uses)
@@ -1510,6 +2646,12 @@ local function generate(ast, searchPaths, macros, out)
         out('\n')
         out('-- Implementation section\n')
         genUses(unit.implementation.uses)
+
+        if optimize then
+            out('')
+            hoistAt = out:last()
+        end
+
         pushDeclarations(unit.implementation.declarations, 'local %s', '%s')
         genDeclarations(unit.implementation.declarations, false)
 
@@ -1522,6 +2664,10 @@ local function generate(ast, searchPaths, macros, out)
             end
         end
 
+        if hoistAt then
+            genHoisted()
+        end
+
         out('\n')
         out('-- Return the module\n')
         out('return M\n')
@@ -1532,30 +2678,56 @@ local function generate(ast, searchPaths, macros, out)
 end
 
 if #arg == 0 then
-    print(string.format('Usage: lua %s [-D<macro>...] [-I<include_dir_path>...] <input_file_path>', arg[0]))
+    print(string.format(
+        'Usage: lua %s [-D<macro>...] [-I<include_dir_path>...] [-C<cache_dir_path>] [-O0] [-diff] ' ..
+        '[-o<output_dir_path>] <input_file_path>...',
+        arg[0]
+    ))
+
+    print('    -C     cache the interfaces of used units in the given directory, so unchanged units are not parsed again')
+    print('    -O0    disable constant folding, dead branch elimination and caching of functions from other units')
+    print('    -diff  output the differences between the unoptimized and the optimized code')
+    print('    -o     write the .lua files of the input files that follow it to the given directory')
+    print('With more than one input file, each .lua file is written next to its input file, or in the -o directory')
     os.exit(1)
 end
 
 -- Pasrse command line arguments
 local macros, searchPaths = {}, {}
-local input_path
+local inputs, outputDirs = {}, {}
+local outputDir = nil
+local optimize, diff = true, false
 
 for i = 1, #arg do
     if arg[i]:sub(1, 2) == '-D' then
         macros[arg[i]:sub(3, -1):lower()] = true
     elseif arg[i]:sub(1, 2) == '-I' then
         searchPaths[#searchPaths + 1] = arg[i]:sub(3, -1)
+    elseif arg[i]:sub(1, 2) == '-C' then
+        cacheDir = arg[i]:sub(3, -1)
+    elseif arg[i] == '-O0' then
+        optimize = false
+    elseif arg[i] == '-diff' then
+        diff = true
+    elseif arg[i]:sub(1, 2) == '-o' then
+        outputDir = arg[i]:sub(3, -1)
     else
-        input_path = arg[i]
+        inputs[#inputs + 1] = arg[i]
+        outputDirs[#inputs] = outputDir
     end
 end
 
--- Add the path to the input file to the search paths
+-- Add the paths to the input files to the search paths
 do
-    local dir, _, _ = ddlt.split(input_path)
+    local added = {}
+
+    for i = 1, #inputs do
+        local dir, _, _ = ddlt.split(inputs[i])
 
-    if dir then
-        searchPaths[#searchPaths + 1] = dir
+        if dir and not added[dir] then
+            added[dir] = true
+            searchPaths[#searchPaths + 1] = dir
+        end
     end
 end
 
@@ -1565,7 +2737,7 @@ for i = 1, #searchPaths do
     local entries, err = ddlt.scandir(search_path)
 
     if not entries then
-        print(string.format('%s:0: Error listing files in "%s": %s', input_path, search_path, err))
+        print(string.format('%s:0: Error listing files in "%s": %s', inputs[1], search_path, err))
         os.exit(1)
     end
 
@@ -1583,18 +2755,8 @@ for i = 1, #searchPaths do
     searchPaths[i] = set
 end
 
--- Parse the main file
-local ast, err = parse(input_path, macros)
-
-if not ast then
-    print(err)
-    os.exit(1)
-end
-
 -- Generate code
-local out
-
-do
+local function newOutput()
     local props = {
         level = 0,
         code = {},
@@ -1611,6 +2773,15 @@ do
             return string.rep('    ', self.level)
         end,
 
+        -- Pieces of code can be replaced after they were generated
+        last = function(self)
+            return #self.code
+        end,
+
+        replace = function(self, index, str)
+            self.code[index] = str
+        end,
+
         result = function(self)
             local str = table.concat(self.code, '')
 
@@ -1664,7 +2835,7 @@ do
         end,
     }
 
-    out = debug.setmetatable(props, mt)
+    return debug.setmetatable(props, mt)
 end
 
 --[[local ok, err = pcall(generate, ast, out)
@@ -1674,10 +2845,66 @@ if not ok then
     os.exit(1)
 end]]
 
-local ok, err = xpcall(generate, debug.traceback, ast, searchPaths, macros, out)
+local function transpile(ast, optimize)
+    local out = newOutput()
+    local ok, err = xpcall(generate, debug.traceback, ast, searchPaths, macros, out, optimize)
 
-print(out:result())
+    if not ok then
+        io.stderr:write(err, '\n')
+    end
 
-if not ok then
-    io.stderr:write(err, '\n')
+    return out:result(), ok
+end
+
+-- All the input files are transpiled in this process, so the units they use are only parsed once
+local failed = false
+
+for i = 1, #inputs do
+    local input_path = inputs[i]
+    local ast, err = parse(input_path, macros)
+
+    if not ast then
+        print(err)
+        os.exit(1)
+    end
+
+    if diff then
+        -- Show what the optimizations change in the generated code
+        local unoptimized, optimized = os.tmpname(), os.tmpname()
+
+        for path, code in pairs({[unoptimized] = transpile(ast, false), [optimized] = transpile(ast, true)}) do
+            local file = assert(io.open(path, 'w'))
+            file:write(code)
+            file:close()
+        end
+
+        os.execute(string.format('diff -u -L unoptimized -L optimized "%s" "%s"', unoptimized, optimized))
+        os.remove(unoptimized)
+        os.remove(optimized)
+    elseif #inputs == 1 then
+        print((transpile(ast, optimize)))
+    else
+        local code, ok = transpile(ast, optimize)
+
+        if ok then
+            local dir, name, _ = ddlt.split(input_path)
+            local output_path = ddlt.join(outputDirs[i] or dir, name, 'lua')
+            local file, err = io.open(output_path, 'w')
+
+            if not file then
+                print(string.format('%s:0: Error opening output file: %s', output_path, err))
+                os.exit(1)
+            end
+
+            -- Same as print in the single file case
+            file:write(code, '\n')
+            file:close()
+        else
+            failed = true
+        end
+    end
+end
+
+if failed then
+    os.exit(1)
 end
@@ -20,7 +20,7 @@ local function tokenize(path, source)
         keywords = {
             'real48', 'real', 'single', 'double', 'extended', 'currency', 'comp', 'shortint', 'smallint', 'integer', 'byte',
             'longint', 'int64', 'word', 'boolean', 'char', 'widechar', 'longword', 'pchar', 'string',
-            'div', 'mod', 'and', 'or', 'in', 'is',
+            'div', 'mod', 'and', 'or', 'xor', 'shl', 'shr', 'in', 'is',
             'unit', 'interface', 'uses', 'type', 'true', 'false', 'class', 'end', 'procedure', 'function', 'var', 'const', 'array',
             'initialization', 'nil',
             'of', 'record', 'implementation', 'begin', 'not',
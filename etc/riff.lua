@@ -73,7 +73,7 @@ local function main(args)
         local entry
 
         if path:find('=', 1, true) then
-            path, entry = path:match('(.*)=(.-)')
+            path, entry = path:match('^(.*)=(.*)$')
         else
             entry = path
         end
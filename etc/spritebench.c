@@ -0,0 +1,205 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "canvas.h"
+#include "image.h"
+#include "pixelsrc.h"
+#include "sprite.h"
+
+// Same layout as the help overlays in module.lua: the canvas covered with white75 tiles and lines of text on top
+#define GLYPH_WIDTH 8
+#define GLYPH_HEIGHT 16
+#define TEXT_LINES 20
+#define TEXT_COLUMNS 60
+
+static hh2_PixelSource readPng(char const* const path) {
+    FILE* const file = fopen(path, "rb");
+
+    if (file == NULL) {
+        fprintf(stderr, "Error opening \"%s\": %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long const size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    void* const data = malloc(size);
+
+    if (data == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        fclose(file);
+        return NULL;
+    }
+
+    if (fread(data, 1, size, file) != (size_t)size) {
+        fprintf(stderr, "Error reading \"%s\": %s\n", path, strerror(errno));
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+
+    hh2_PixelSource const source = hh2_initPixelSource(data, size);
+    free(data);
+
+    if (source == NULL) {
+        fprintf(stderr, "Error decoding \"%s\"\n", path);
+    }
+
+    return source;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t checksum(hh2_Canvas const canvas) {
+    uint32_t hash = 5381;
+
+    for (unsigned y = 0; y < hh2_canvasHeight(canvas); y++) {
+        for (unsigned x = 0; x < hh2_canvasWidth(canvas); x++) {
+            hash = hash * 33 + *hh2_canvasPixel(canvas, x, y);
+        }
+    }
+
+    return hash;
+}
+
+int main(int argc, char const* const argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "USAGE: spritebench <white75.png> <font.png> [width height frames max_threads]\n");
+        return EXIT_FAILURE;
+    }
+
+    unsigned const width = argc > 3 ? (unsigned)strtoul(argv[3], NULL, 10) : 640;
+    unsigned const height = argc > 4 ? (unsigned)strtoul(argv[4], NULL, 10) : 480;
+    unsigned const frames = argc > 5 ? (unsigned)strtoul(argv[5], NULL, 10) : 1000;
+    long const cores = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned const max_threads = argc > 6 ? (unsigned)strtoul(argv[6], NULL, 10) : cores > 0 ? (unsigned)cores : 1;
+
+    hh2_PixelSource const white75_source = readPng(argv[1]);
+    hh2_PixelSource const font_source = readPng(argv[2]);
+
+    if (white75_source == NULL || font_source == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    hh2_Image const white75 = hh2_createImage(white75_source);
+    hh2_Canvas const canvas = hh2_createCanvas(width, height);
+
+    // Use the glyphs in the first row of the font, packed in an atlas like module.lua does
+    unsigned const glyph_count = hh2_pixelSourceWidth(font_source) / GLYPH_WIDTH;
+    hh2_AtlasRect* const rects = (hh2_AtlasRect*)malloc(glyph_count * sizeof(hh2_AtlasRect));
+
+    if (white75 == NULL || canvas == NULL || rects == NULL || glyph_count == 0) {
+        fprintf(stderr, "Error creating the scene\n");
+        return EXIT_FAILURE;
+    }
+
+    for (unsigned i = 0; i < glyph_count; i++) {
+        rects[i].x = i * GLYPH_WIDTH;
+        rects[i].y = 0;
+        rects[i].width = GLYPH_WIDTH;
+        rects[i].height = GLYPH_HEIGHT;
+    }
+
+    hh2_Atlas const glyphs = hh2_createAtlas(font_source, rects, glyph_count);
+
+    if (glyphs == NULL) {
+        fprintf(stderr, "Error creating the glyph atlas\n");
+        return EXIT_FAILURE;
+    }
+
+    unsigned sprite_count = 0;
+
+    for (unsigned y = 0; y < height; y += hh2_imageHeight(white75)) {
+        for (unsigned x = 0; x < width; x += hh2_imageWidth(white75)) {
+            hh2_Sprite const sprite = hh2_createSprite();
+            hh2_setImage(sprite, white75);
+            hh2_setPosition(sprite, x, y);
+            hh2_setLayer(sprite, 1);
+            hh2_setVisibility(sprite, true);
+            sprite_count++;
+        }
+    }
+
+    // Each line of text is a single sprite
+    for (unsigned line = 0; line < TEXT_LINES; line++) {
+        unsigned indices[TEXT_COLUMNS];
+        int xs[TEXT_COLUMNS];
+
+        for (unsigned column = 0; column < TEXT_COLUMNS; column++) {
+            indices[column] = (line * TEXT_COLUMNS + column) % glyph_count;
+            xs[column] = column * GLYPH_WIDTH;
+        }
+
+        hh2_Sprite const sprite = hh2_createSprite();
+
+        if (!hh2_setRun(sprite, glyphs, indices, xs, TEXT_COLUMNS)) {
+            fprintf(stderr, "Error creating line %u\n", line);
+            return EXIT_FAILURE;
+        }
+
+        hh2_setPosition(sprite, 16, 16 + line * (GLYPH_HEIGHT + 4));
+        hh2_setLayer(sprite, 2);
+        hh2_setVisibility(sprite, true);
+        sprite_count++;
+    }
+
+#ifdef HH2_LEGACY_RLE
+    char const* const format = "legacy RLE";
+#else
+    char const* const format = "span list";
+#endif
+
+    printf("%ux%u canvas, %u sprites, %u frames, %s images\n", width, height, sprite_count, frames, format);
+
+    double base = 0.0;
+    uint32_t expected = 0;
+
+    for (unsigned threads = 1; threads <= max_threads; threads++) {
+        if (!hh2_setSpriteThreads(threads)) {
+            fprintf(stderr, "Could not use %u threads, was it compiled with SPRITE_THREADS=1?\n", threads);
+            break;
+        }
+
+        hh2_clearCanvas(canvas, HH2_COLOR_RGB565(32, 64, 128));
+        double const start = now();
+
+        for (unsigned i = 0; i < frames; i++) {
+            hh2_blitSprites(canvas);
+            hh2_unblitSprites(canvas);
+        }
+
+        double const elapsed = now() - start;
+
+        // Check that the bands compose the same frame
+        hh2_blitSprites(canvas);
+        uint32_t const hash = checksum(canvas);
+        hh2_unblitSprites(canvas);
+
+        if (threads == 1) {
+            base = elapsed;
+            expected = hash;
+        }
+
+        printf(
+            "%2u threads: %8.3f ms/frame, %5.2fx%s\n", threads, elapsed * 1000.0 / frames, base / elapsed,
+            hash == expected ? "" : " (MISMATCH)"
+        );
+    }
+
+    hh2_setSpriteThreads(1);
+    return EXIT_SUCCESS;
+}
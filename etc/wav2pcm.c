@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <speex_resampler.h>
+
+#define DR_WAV_IMPLEMENTATION
+#include <dr_wav.h>
+
+// Offline resampling can afford the best quality
+#define QUALITY SPEEX_RESAMPLER_QUALITY_MAX
+
+static void writeU16(uint8_t* const bytes, uint32_t const x) {
+    bytes[0] = x & 0xff;
+    bytes[1] = (x >> 8) & 0xff;
+}
+
+static void writeU32(uint8_t* const bytes, uint32_t const x) {
+    bytes[0] = x & 0xff;
+    bytes[1] = (x >> 8) & 0xff;
+    bytes[2] = (x >> 16) & 0xff;
+    bytes[3] = (x >> 24) & 0xff;
+}
+
+static int16_t* resample(
+    int16_t const* const samples, unsigned const channels, uint32_t const in_rate, size_t const in_frames,
+    uint32_t const out_rate, size_t* const out_frames) {
+
+    int error;
+    SpeexResamplerState* const resampler = speex_resampler_init(channels, in_rate, out_rate, QUALITY, &error);
+
+    if (resampler == NULL) {
+        fprintf(stderr, "Error initializing resampler: %s\n", speex_resampler_strerror(error));
+        return NULL;
+    }
+
+    // Skip the filter delay at the start, and feed it with silence at the end to flush it
+    speex_resampler_skip_zeros(resampler);
+    spx_uint32_t const latency = speex_resampler_get_input_latency(resampler);
+
+    *out_frames = (size_t)((uint64_t)in_frames * out_rate / in_rate);
+    int16_t* const resampled = (int16_t*)malloc(*out_frames * channels * sizeof(int16_t));
+    int16_t* const padded = (int16_t*)calloc((in_frames + latency) * channels, sizeof(int16_t));
+
+    if (resampled == NULL || padded == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        free(padded);
+        free(resampled);
+        speex_resampler_destroy(resampler);
+        return NULL;
+    }
+
+    memcpy(padded, samples, in_frames * channels * sizeof(int16_t));
+
+    spx_uint32_t in_count = in_frames + latency;
+    spx_uint32_t out_count = *out_frames;
+    error = speex_resampler_process_interleaved_int(resampler, padded, &in_count, resampled, &out_count);
+
+    free(padded);
+    speex_resampler_destroy(resampler);
+
+    if (error != RESAMPLER_ERR_SUCCESS) {
+        fprintf(stderr, "Error resampling: %s\n", speex_resampler_strerror(error));
+        free(resampled);
+        return NULL;
+    }
+
+    // Should not happen, but don't leave garbage at the end if the resampler came up short
+    memset(resampled + out_count * channels, 0, (*out_frames - out_count) * channels * sizeof(int16_t));
+    return resampled;
+}
+
+static int writePcm(
+    char const* const path, int16_t const* const samples, unsigned const channels, uint32_t const rate,
+    size_t const frames) {
+
+    // "HH2P", channels (u16), reserved (u16), sample rate (u32), frame count (u32), interleaved little endian samples
+    uint8_t header[16];
+    memcpy(header, "HH2P", 4);
+    writeU16(header + 4, channels);
+    writeU16(header + 6, 0);
+    writeU32(header + 8, rate);
+    writeU32(header + 12, frames);
+
+    FILE* file = fopen(path, "wb");
+
+    if (file == NULL) {
+        fprintf(stderr, "Error opening file: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        fprintf(stderr, "Error writing file: %s\n", strerror(errno));
+        fclose(file);
+        return -1;
+    }
+
+    for (size_t i = 0; i < frames * channels; i++) {
+        uint8_t bytes[2];
+        writeU16(bytes, (uint16_t)samples[i]);
+
+        if (fwrite(bytes, 1, sizeof(bytes), file) != sizeof(bytes)) {
+            fprintf(stderr, "Error writing file: %s\n", strerror(errno));
+            fclose(file);
+            return -1;
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+int main(int argc, char const* const argv[]) {
+    if (argc < 4) {
+        fprintf(stderr, "USAGE: wav2pcm <sample rate> <infile> <outfile>\n");
+        return EXIT_FAILURE;
+    }
+
+    uint32_t const out_rate = (uint32_t)strtoul(argv[1], NULL, 10);
+
+    if (out_rate == 0) {
+        fprintf(stderr, "Error, invalid sample rate: %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    unsigned channels;
+    unsigned in_rate;
+    drwav_uint64 in_frames;
+    int16_t* const samples = drwav_open_file_and_read_pcm_frames_s16(argv[2], &channels, &in_rate, &in_frames, NULL);
+
+    if (samples == NULL) {
+        fprintf(stderr, "Error reading WAV: %s\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    int16_t* resampled = samples;
+    size_t out_frames = in_frames;
+
+    if (in_rate != out_rate) {
+        resampled = resample(samples, channels, in_rate, in_frames, out_rate, &out_frames);
+
+        if (resampled == NULL) {
+            drwav_free(samples, NULL);
+            return EXIT_FAILURE;
+        }
+    }
+
+    int const result = writePcm(argv[3], resampled, channels, out_rate, out_frames);
+
+    if (resampled != samples) {
+        free(resampled);
+    }
+
+    drwav_free(samples, NULL);
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
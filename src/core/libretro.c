@@ -1,5 +1,6 @@
 #include "libretro.h"
 
+#include "bootimage.h"
 #include "filesys.h"
 #include "log.h"
 #include "state.h"
@@ -28,6 +29,7 @@ static void* content;
 static hh2_Filesys filesys;
 static hh2_State state;
 static bool first_frame;
+static bool audio_callback;
 static bool error;
 
 // The logger function to hh2_setLogger
@@ -58,6 +60,17 @@ void retro_get_system_info(struct retro_system_info* const info) {
 void retro_set_environment(retro_environment_t const cb) {
     environment_cb = cb;
 
+    static struct retro_variable const variables[] = {
+        {"hh2_sample_rate", "Audio sample rate (restart); 44100|48000|32000|22050"},
+        {"hh2_audio_thread", "Mix audio in a separate thread (restart); disabled|enabled"},
+        {"hh2_sprite_threads", "Sprite composition threads (restart); 1|2|3|4|6|8"},
+        {"hh2_background_layer", "Restore sprites from a background layer (restart); disabled|enabled"},
+        {"hh2_boot_image", "Keep decoded images in the save directory (restart); enabled|disabled"},
+        {NULL, NULL}
+    };
+
+    cb(RETRO_ENVIRONMENT_SET_VARIABLES, (void*)variables);
+
     struct retro_log_callback log;
 
     if (cb(RETRO_ENVIRONMENT_GET_LOG_INTERFACE, &log)) {
@@ -98,6 +111,39 @@ void retro_set_video_refresh(retro_video_refresh_t const cb) {
     video_refresh_cb = cb;
 }
 
+static void audio_callback_cb(void) {
+    // Called by the front-end from its audio thread, hand over whatever the mixer thread has ready
+    int16_t frames[1024 * 2];
+    size_t const count = hh2_soundRead(frames, sizeof(frames) / sizeof(frames[0]) / 2);
+
+    if (count != 0) {
+        audio_sample_batch_cb(frames, count);
+    }
+}
+
+static void audio_set_state_cb(bool const enabled) {
+    (void)enabled;
+}
+
+static void start_audio_thread(void) {
+    struct retro_variable variable = {"hh2_audio_thread", NULL};
+
+    if (!environment_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &variable) || variable.value == NULL ||
+        strcmp(variable.value, "enabled") != 0) {
+
+        return;
+    }
+
+    if (!hh2_startAudioThread()) {
+        // Error already logged, mix in retro_run
+        return;
+    }
+
+    // Let front-ends that can pull audio asynchronously do so, otherwise retro_run pushes it
+    struct retro_audio_callback const callback = {audio_callback_cb, audio_set_state_cb};
+    audio_callback = environment_cb(RETRO_ENVIRONMENT_SET_AUDIO_CALLBACK, (void*)&callback);
+}
+
 void retro_set_audio_sample(retro_audio_sample_t const cb) {
     (void)cb;
 }
@@ -106,6 +152,47 @@ void retro_set_audio_sample_batch(retro_audio_sample_batch_t const cb) {
     audio_sample_batch_cb = cb;
 }
 
+static hh2_BootImage create_boot_image(struct retro_game_info const* const info, char* const path, size_t const size) {
+    struct retro_variable variable = {"hh2_boot_image", NULL};
+
+    if (environment_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &variable) && variable.value != NULL &&
+        strcmp(variable.value, "disabled") == 0) {
+
+        return NULL;
+    }
+
+    char const* save_dir = NULL;
+
+    if (!environment_cb(RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY, &save_dir) || save_dir == NULL) {
+        HH2_LOG(HH2_LOG_WARN, TAG "no save directory, booting without a boot image");
+        return NULL;
+    }
+
+    // Name the image after the content file, images from other contents with the same name just fail to match
+    char const* name = "hh2";
+    size_t name_len = 3;
+
+    if (info->path != NULL) {
+        name = info->path;
+
+        for (char const* c = info->path; *c != 0; c++) {
+            if (*c == '/' || *c == '\\') {
+                name = c + 1;
+            }
+        }
+
+        char const* const dot = strrchr(name, '.');
+        name_len = dot != NULL ? (size_t)(dot - name) : strlen(name);
+    }
+
+    if ((size_t)snprintf(path, size, "%s/%.*s.hh2boot", save_dir, (int)name_len, name) >= size) {
+        HH2_LOG(HH2_LOG_WARN, TAG "save directory path is too long, booting without a boot image");
+        return NULL;
+    }
+
+    return hh2_createBootImage(info->data, info->size, HH2_VERSION " " HH2_GITHASH);
+}
+
 bool retro_load_game(struct retro_game_info const* const info) {
     if (get_time_usec_cb == NULL) {
         HH2_LOG(HH2_LOG_ERROR, TAG "get_time_usec_cb is NULL");
@@ -131,6 +218,18 @@ bool retro_load_game(struct retro_game_info const* const info) {
         return false;
     }
 
+    // Sounds are resampled to the mix rate while the game loads, so it can only change on restarts
+    struct retro_variable variable = {"hh2_sample_rate", NULL};
+
+    if (environment_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &variable) && variable.value != NULL) {
+        hh2_setMixRate((unsigned)strtoul(variable.value, NULL, 10));
+    }
+
+    variable.key = "hh2_background_layer";
+    variable.value = NULL;
+    state.background_layer = environment_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &variable) && variable.value != NULL &&
+                             strcmp(variable.value, "enabled") == 0;
+
     memcpy(content, info->data, info->size);
     filesys = hh2_createFilesystem(content, info->size);
 
@@ -140,13 +239,44 @@ bool retro_load_game(struct retro_game_info const* const info) {
         return false;
     }
 
-    if (!hh2_initState(&state, filesys)) {
+    // The boot image is matched against the content and the core version, and recreated when either changes
+    char boot_image_path[1024];
+    hh2_BootImage const boot_image = create_boot_image(info, boot_image_path, sizeof(boot_image_path));
+    state.boot_image = boot_image;
+
+    if (boot_image != NULL) {
+        hh2_loadBootImage(boot_image, boot_image_path);
+    }
+
+    bool const ok = hh2_initState(&state, filesys);
+    state.boot_image = NULL;
+
+    if (boot_image != NULL) {
+        if (ok && !hh2_bootImageLoaded(boot_image)) {
+            hh2_saveBootImage(boot_image, boot_image_path);
+        }
+
+        hh2_destroyBootImage(boot_image);
+    }
+
+    if (!ok) {
         // Error already logged
         hh2_destroyFilesystem(filesys);
         free(content);
         return false;
     }
 
+    audio_callback = false;
+    start_audio_thread();
+
+    variable.key = "hh2_sprite_threads";
+    variable.value = NULL;
+
+    if (environment_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &variable) && variable.value != NULL) {
+        // Falls back to composing in this thread on errors
+        hh2_setSpriteThreads((unsigned)strtoul(variable.value, NULL, 10));
+    }
+
     first_frame = true;
     error = false;
     return true;
@@ -168,7 +298,7 @@ void retro_get_system_av_info(struct retro_system_av_info* const info) {
     info->geometry.max_height = 192;
     info->geometry.aspect_ratio = 0.0f;
     info->timing.fps = 60.0;
-    info->timing.sample_rate = 44100.0;
+    info->timing.sample_rate = hh2_mixRate();
 }
 
 unsigned retro_get_region() {
@@ -222,7 +352,7 @@ void retro_run() {
         info.geometry.max_height = height;
         info.geometry.aspect_ratio = 0.0f;
         info.timing.fps = 60.0;
-        info.timing.sample_rate = 44100.0;
+        info.timing.sample_rate = hh2_mixRate();
 
         environment_cb(RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO, &info);
     }
@@ -271,9 +401,14 @@ void retro_run() {
 
     video_refresh_cb(framebuffer, width, height, pitch);
 
-    size_t frames;
-    int16_t const* const samples = hh2_soundMix(&frames);
-    audio_sample_batch_cb(samples, frames);
+    if (audio_callback) {
+        hh2_soundUpdate();
+    }
+    else {
+        size_t frames;
+        int16_t const* const samples = hh2_soundMix(&frames);
+        audio_sample_batch_cb(samples, frames);
+    }
 }
 
 void retro_set_controller_port_device(unsigned const port, unsigned const device) {
@@ -306,6 +441,9 @@ void retro_cheat_set(unsigned const a, bool const b, char const* const c) {
 }
 
 void retro_unload_game() {
+    // Streams still playing read from the file system
+    hh2_stopAudioThread();
+    hh2_setSpriteThreads(1);
     hh2_destroyFilesystem(filesys);
     free(content);
     hh2_destroyState(&state);
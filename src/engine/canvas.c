@@ -2,6 +2,7 @@
 #include "log.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #define TAG "CNV "
 
@@ -68,3 +69,48 @@ void hh2_clearCanvas(hh2_Canvas const canvas, hh2_RGB565 const color) {
 hh2_RGB565* hh2_canvasPixel(hh2_Canvas canvas, unsigned x, unsigned y) {
     return (hh2_RGB565*)((uint8_t*)canvas->pixels + y * canvas->pitch) + x;
 }
+
+void hh2_copyCanvasRect(
+    hh2_Canvas const canvas, hh2_Canvas const source, int x0, int y0, unsigned width, unsigned height) {
+
+    // Clip the rectangle to the canvas
+    if (x0 < 0) {
+        if ((unsigned)-x0 >= width) {
+            return;
+        }
+
+        width += x0;
+        x0 = 0;
+    }
+
+    if (y0 < 0) {
+        if ((unsigned)-y0 >= height) {
+            return;
+        }
+
+        height += y0;
+        y0 = 0;
+    }
+
+    if ((unsigned)x0 >= canvas->width || (unsigned)y0 >= canvas->height) {
+        return;
+    }
+
+    if (x0 + width > canvas->width) {
+        width = canvas->width - x0;
+    }
+
+    if (y0 + height > canvas->height) {
+        height = canvas->height - y0;
+    }
+
+    size_t const offset = y0 * canvas->pitch + x0 * sizeof(hh2_RGB565);
+    uint8_t* dst = (uint8_t*)canvas->pixels + offset;
+    uint8_t const* src = (uint8_t const*)source->pixels + offset;
+
+    for (unsigned y = 0; y < height; y++) {
+        memcpy(dst, src, width * sizeof(hh2_RGB565));
+        dst += canvas->pitch;
+        src += canvas->pitch;
+    }
+}
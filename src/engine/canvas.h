@@ -20,4 +20,7 @@ void hh2_clearCanvas(hh2_Canvas canvas, hh2_RGB565 color);
 
 hh2_RGB565* hh2_canvasPixel(hh2_Canvas canvas, unsigned x, unsigned y);
 
+// Copies the pixels inside the rectangle from source, which must have the same dimensions as canvas
+void hh2_copyCanvasRect(hh2_Canvas canvas, hh2_Canvas source, int x0, int y0, unsigned width, unsigned height);
+
 #endif // HH2_CANVAS_H__
@@ -0,0 +1,300 @@
+#include "hitgrid.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define TAG "HIT "
+
+// Grid cells are HH2_CELL_SIZE x HH2_CELL_SIZE pixels
+#define HH2_CELL_SHIFT 5
+#define HH2_CELL_SIZE (1 << HH2_CELL_SHIFT)
+
+#define HH2_EVENT_QUEUE_SIZE 64
+
+// Make sure the event queue size is a power of 2
+typedef char hh2_staticAssertEventQueueSizeMustBePowerOf2[
+    (HH2_EVENT_QUEUE_SIZE & (HH2_EVENT_QUEUE_SIZE - 1)) == 0 ? 1 : -1];
+
+typedef struct {
+    int x0, y0, x1, y1; // x1 and y1 are exclusive
+    int tag;
+    bool active;
+}
+hh2_HitRegion;
+
+struct hh2_HitGrid {
+    unsigned columns, rows;
+
+    hh2_HitRegion* regions;
+    unsigned region_count;
+    unsigned reserved_regions;
+
+    // Region ids in each cell, cell i has the ids in [cell_start[i], cell_start[i + 1]) of cell_items in the order
+    // they were added. Rebuilt at the next update after the regions change
+    unsigned* cell_start;
+    unsigned* cell_items;
+    bool dirty;
+
+    int current; // Region being pressed, -1 for none
+
+    hh2_HitEvent events[HH2_EVENT_QUEUE_SIZE];
+    unsigned head, tail;
+};
+
+hh2_HitGrid hh2_createHitGrid(void) {
+    hh2_HitGrid const grid = (hh2_HitGrid)malloc(sizeof(*grid));
+
+    if (grid == NULL) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+        return NULL;
+    }
+
+    grid->columns = grid->rows = 0;
+    grid->cell_start = NULL;
+    grid->regions = NULL;
+    grid->region_count = grid->reserved_regions = 0;
+    grid->cell_items = NULL;
+    grid->dirty = false;
+    grid->current = -1;
+    grid->head = grid->tail = 0;
+    return grid;
+}
+
+void hh2_destroyHitGrid(hh2_HitGrid const grid) {
+    free(grid->regions);
+    free(grid->cell_start);
+    free(grid->cell_items);
+    free(grid);
+}
+
+static bool hh2_regionCells(
+    hh2_HitGrid const grid, hh2_HitRegion const* const region, unsigned* const c0, unsigned* const r0,
+    unsigned* const c1, unsigned* const r1) {
+
+    int const width = grid->columns << HH2_CELL_SHIFT;
+    int const height = grid->rows << HH2_CELL_SHIFT;
+
+    if (!region->active || region->x1 <= 0 || region->y1 <= 0 || region->x0 >= width || region->y0 >= height) {
+        return false;
+    }
+
+    *c0 = region->x0 > 0 ? (unsigned)region->x0 >> HH2_CELL_SHIFT : 0;
+    *r0 = region->y0 > 0 ? (unsigned)region->y0 >> HH2_CELL_SHIFT : 0;
+    *c1 = region->x1 < width ? (unsigned)(region->x1 - 1) >> HH2_CELL_SHIFT : grid->columns - 1;
+    *r1 = region->y1 < height ? (unsigned)(region->y1 - 1) >> HH2_CELL_SHIFT : grid->rows - 1;
+    return true;
+}
+
+static bool hh2_rebuildHitGrid(hh2_HitGrid const grid) {
+    // Cover all active regions from the origin, nothing can be hit at negative coordinates
+    int width = 0, height = 0;
+
+    for (unsigned id = 0; id < grid->region_count; id++) {
+        hh2_HitRegion const* const region = grid->regions + id;
+
+        if (region->active) {
+            width = region->x1 > width ? region->x1 : width;
+            height = region->y1 > height ? region->y1 : height;
+        }
+    }
+
+    unsigned const columns = (width + HH2_CELL_SIZE - 1) >> HH2_CELL_SHIFT;
+    unsigned const rows = (height + HH2_CELL_SIZE - 1) >> HH2_CELL_SHIFT;
+    unsigned const cell_count = columns * rows;
+    unsigned* const start = (unsigned*)realloc(grid->cell_start, (cell_count + 1) * sizeof(unsigned));
+
+    if (start == NULL) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+        return false;
+    }
+
+    grid->cell_start = start;
+    grid->columns = columns;
+    grid->rows = rows;
+
+    // Count the regions in each cell
+    for (unsigned i = 0; i <= cell_count; i++) {
+        start[i] = 0;
+    }
+
+    for (unsigned id = 0; id < grid->region_count; id++) {
+        unsigned c0, r0, c1, r1;
+
+        if (hh2_regionCells(grid, grid->regions + id, &c0, &r0, &c1, &r1)) {
+            for (unsigned row = r0; row <= r1; row++) {
+                for (unsigned column = c0; column <= c1; column++) {
+                    start[row * grid->columns + column + 1]++;
+                }
+            }
+        }
+    }
+
+    for (unsigned i = 0; i < cell_count; i++) {
+        start[i + 1] += start[i];
+    }
+
+    unsigned* const items = (unsigned*)realloc(grid->cell_items, (start[cell_count] + 1) * sizeof(unsigned));
+
+    if (items == NULL) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+        return false;
+    }
+
+    grid->cell_items = items;
+
+    // Fill the cells, using the start of the next cell as the insertion point and moving it back in place
+    for (unsigned id = 0; id < grid->region_count; id++) {
+        unsigned c0, r0, c1, r1;
+
+        if (hh2_regionCells(grid, grid->regions + id, &c0, &r0, &c1, &r1)) {
+            for (unsigned row = r0; row <= r1; row++) {
+                for (unsigned column = c0; column <= c1; column++) {
+                    unsigned const cell = row * grid->columns + column;
+                    items[start[cell]++] = id;
+                }
+            }
+        }
+    }
+
+    for (unsigned i = cell_count; i > 0; i--) {
+        start[i] = start[i - 1];
+    }
+
+    start[0] = 0;
+    grid->dirty = false;
+    return true;
+}
+
+int hh2_addHitRegion(
+    hh2_HitGrid const grid, int const x0, int const y0, unsigned const width, unsigned const height, int const tag) {
+
+    if (grid->region_count == grid->reserved_regions) {
+        unsigned const new_reserved = grid->reserved_regions == 0 ? 16 : grid->reserved_regions * 2;
+        hh2_HitRegion* const new_regions = realloc(grid->regions, sizeof(hh2_HitRegion) * new_reserved);
+
+        if (new_regions == NULL) {
+            HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+            return -1;
+        }
+
+        grid->reserved_regions = new_reserved;
+        grid->regions = new_regions;
+    }
+
+    // Ids are never reused, so regions stay in the order they were added
+    hh2_HitRegion* const region = grid->regions + grid->region_count;
+    region->x0 = x0;
+    region->y0 = y0;
+    region->x1 = x0 + (int)width;
+    region->y1 = y0 + (int)height;
+    region->tag = tag;
+    region->active = true;
+
+    grid->dirty = true;
+    return grid->region_count++;
+}
+
+static void hh2_pushHitEvent(hh2_HitGrid const grid, int const id, bool const pressed, int const x, int const y) {
+    if (((grid->tail + 1) & (HH2_EVENT_QUEUE_SIZE - 1)) == grid->head) {
+        HH2_LOG(HH2_LOG_WARN, TAG "event queue full, dropping event for region %d", id);
+        return;
+    }
+
+    hh2_HitEvent* const event = grid->events + grid->tail;
+    event->tag = grid->regions[id].tag;
+    event->pressed = pressed;
+    event->x = x;
+    event->y = y;
+
+    grid->tail = (grid->tail + 1) & (HH2_EVENT_QUEUE_SIZE - 1);
+}
+
+bool hh2_removeHitRegion(hh2_HitGrid const grid, int const id, int* const tag) {
+    if (id < 0 || (unsigned)id >= grid->region_count || !grid->regions[id].active) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "invalid hit region %d", id);
+        return false;
+    }
+
+    *tag = grid->regions[id].tag;
+
+    // Drop the events that would reach the region after it's gone
+    unsigned tail = grid->head;
+
+    for (unsigned i = grid->head; i != grid->tail; i = (i + 1) & (HH2_EVENT_QUEUE_SIZE - 1)) {
+        if (grid->events[i].tag != *tag) {
+            grid->events[tail] = grid->events[i];
+            tail = (tail + 1) & (HH2_EVENT_QUEUE_SIZE - 1);
+        }
+    }
+
+    grid->tail = tail;
+
+    if (grid->current == id) {
+        grid->current = -1;
+    }
+
+    grid->regions[id].active = false;
+    grid->dirty = true;
+    return true;
+}
+
+static int hh2_findHitRegion(hh2_HitGrid const grid, int const x, int const y) {
+    if (x < 0 || y < 0) {
+        return -1;
+    }
+
+    unsigned const column = (unsigned)x >> HH2_CELL_SHIFT;
+    unsigned const row = (unsigned)y >> HH2_CELL_SHIFT;
+
+    if (column >= grid->columns || row >= grid->rows) {
+        return -1;
+    }
+
+    unsigned const cell = row * grid->columns + column;
+
+    // The last region added is on top
+    for (unsigned i = grid->cell_start[cell + 1]; i-- > grid->cell_start[cell];) {
+        unsigned const id = grid->cell_items[i];
+        hh2_HitRegion const* const region = grid->regions + id;
+
+        if (x >= region->x0 && x < region->x1 && y >= region->y0 && y < region->y1) {
+            return id;
+        }
+    }
+
+    return -1;
+}
+
+void hh2_updateHitGrid(hh2_HitGrid const grid, int const x, int const y, bool const pressed) {
+    if (grid->dirty && !hh2_rebuildHitGrid(grid)) {
+        // Error already logged
+        return;
+    }
+
+    int const id = pressed ? hh2_findHitRegion(grid, x, y) : -1;
+
+    if (id == grid->current) {
+        return;
+    }
+
+    if (grid->current >= 0) {
+        hh2_pushHitEvent(grid, grid->current, false, x, y);
+    }
+
+    if (id >= 0) {
+        hh2_pushHitEvent(grid, id, true, x, y);
+    }
+
+    grid->current = id;
+}
+
+bool hh2_nextHitEvent(hh2_HitGrid const grid, hh2_HitEvent* const event) {
+    if (grid->head == grid->tail) {
+        return false;
+    }
+
+    *event = grid->events[grid->head];
+    grid->head = (grid->head + 1) & (HH2_EVENT_QUEUE_SIZE - 1);
+    return true;
+}
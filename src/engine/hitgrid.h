@@ -0,0 +1,31 @@
+#ifndef HH2_HITGRID_H__
+#define HH2_HITGRID_H__
+
+#include <stdbool.h>
+
+typedef struct hh2_HitGrid* hh2_HitGrid;
+
+typedef struct {
+    int tag;      // The tag given when the region was added
+    bool pressed; // false when the region was released
+    int x, y;     // Pointer position when the region was pressed or released
+}
+hh2_HitEvent;
+
+// Finds which rectangular region the pointer is on, and queues press and release events when that changes. The grid
+// covers the regions' extents, so it doesn't depend on the canvas size
+hh2_HitGrid hh2_createHitGrid(void);
+void hh2_destroyHitGrid(hh2_HitGrid grid);
+
+// Regions added later are on top of the ones added before. Returns the region id, or -1 on error
+int hh2_addHitRegion(hh2_HitGrid grid, int x0, int y0, unsigned width, unsigned height, int tag);
+
+// Removes the region and any events for it still in the queue, tag receives the tag the region was added with
+bool hh2_removeHitRegion(hh2_HitGrid grid, int id, int* tag);
+
+// Sets the pointer position and state, sliding from one region to another while pressed releases the first and
+// presses the second
+void hh2_updateHitGrid(hh2_HitGrid grid, int x, int y, bool pressed);
+bool hh2_nextHitEvent(hh2_HitGrid grid, hh2_HitEvent* event);
+
+#endif // HH2_HITGRID_H__
@@ -6,6 +6,7 @@
 
 #define TAG "IMG "
 
+#ifdef HH2_LEGACY_RLE
 typedef enum {
     HH2_RLE_COMPOSE = 0,
     HH2_RLE_SKIP,
@@ -22,6 +23,7 @@ struct hh2_Image {
     unsigned width;
     unsigned height;
     size_t pixels_used;
+    size_t const* bg_offsets; // where the saved background of each row starts, so rows can be blitted independently
 
 #ifdef HH2_DEBUG
     char const* path;
@@ -168,46 +170,257 @@ static size_t hh2_rleRow(hh2_Rle* rle, hh2_PixelSource const source, int const y
     return words;
 }
 
-static hh2_RGB565 hh2_compose(hh2_RGB565 const src, hh2_RGB565 const dst, uint8_t const inv_alpha) {
-    uint32_t const src32 = (src & 0xf81fU) | (uint32_t)(src & 0x07e0U) << 16;
-    uint32_t const dst32 = (dst & 0xf81fU) | (uint32_t)(dst & 0x07e0U) << 16;
-    uint32_t const composed = src32 + (dst32 * inv_alpha) / 32;
-    return (composed & 0xf81fU) | ((composed >> 16) & 0x07e0U);
-}
-
-hh2_Image hh2_createImage(hh2_PixelSource const source) {
+static size_t hh2_imageSize(hh2_PixelSource const source) {
     size_t total_words = 0;
-    size_t total_pixels_used = 0;
+    unsigned const height = hh2_pixelSourceHeight(source);
+
+    for (unsigned y = 0; y < height; y++) {
+        size_t pixels_used;
+        total_words += hh2_rleRowDryRun(&pixels_used, source, y);
+    }
 
+    size_t const rows_size = sizeof(hh2_Rle const*) * (height - 1);
+    size_t const offsets_size = sizeof(size_t) * height;
+    return sizeof(struct hh2_Image) + rows_size + offsets_size + total_words * 2;
+}
+
+// Encodes the image in memory with hh2_imageSize bytes
+static void hh2_encodeImage(hh2_Image const image, hh2_PixelSource const source) {
     unsigned const height = hh2_pixelSourceHeight(source);
 
+    size_t const rows_size = sizeof(hh2_Rle const*) * (height - 1);
+    size_t const offsets_size = sizeof(size_t) * height;
+
+    size_t* const bg_offsets = (size_t*)((uint8_t*)image + sizeof(*image) + rows_size);
+    hh2_Rle* rle = (hh2_Rle*)((uint8_t*)bg_offsets + offsets_size);
+    size_t bg_offset = 0;
+
     for (unsigned y = 0; y < height; y++) {
         size_t pixels_used;
-        size_t const words = hh2_rleRowDryRun(&pixels_used, source, y);
+        hh2_rleRowDryRun(&pixels_used, source, y);
 
-        total_words += words;
-        total_pixels_used += pixels_used;
+        bg_offsets[y] = bg_offset;
+        bg_offset += pixels_used;
+
+        image->rows[y] = rle;
+        size_t const words = hh2_rleRow(rle, source, y);
+        rle += words;
     }
 
-    hh2_Image const image = (hh2_Image)malloc(sizeof(*image) + sizeof(image->rows[0]) * (height - 1) + total_words * 2);
+    image->width = hh2_pixelSourceWidth(source);
+    image->height = height;
+    image->pixels_used = bg_offset;
+    image->bg_offsets = bg_offsets;
+}
+#else
+// Spans with an inverse alpha of zero are opaque and copied, the others are composed, transparent pixels have no spans
+typedef struct {
+    uint32_t header; // length << 6 | inverse alpha
+    uint32_t x; // column of the first pixel, spans in a row are sorted by it so clipping can do a binary search
+    uint32_t pixels; // offset of the premultiplied pixels in the payload, always aligned to HH2_SPAN_ALIGN pixels
+    uint32_t bg; // offset of the first pixel in the saved background
+}
+hh2_Span;
 
-    if (image == NULL) {
-        HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
-        return NULL;
+// Payloads start at 16-byte boundaries so copying and composing them can use aligned vector loads
+#define HH2_SPAN_ALIGN 8
+
+// Make sure the alignment is 16 bytes
+typedef char hh2_staticAssertSpanAlignMustBe16Bytes[HH2_SPAN_ALIGN * sizeof(hh2_RGB565) == 16 ? 1 : -1];
+
+struct hh2_Image {
+    unsigned width;
+    unsigned height;
+    size_t pixels_used;
+    hh2_Span const* spans;
+    hh2_RGB565 const* payload;
+
+#ifdef HH2_DEBUG
+    char const* path;
+#endif
+
+    uint32_t rows[1]; // height + 1 entries, the spans of row y are [rows[y], rows[y + 1])
+};
+
+static uint32_t hh2_spanLength(hh2_Span const* const span) {
+    return span->header >> 6;
+}
+
+static uint8_t hh2_spanInvAlpha(hh2_Span const* const span) {
+    return span->header & 63;
+}
+
+static uint8_t hh2_realAlpha(hh2_PixelSource const source, unsigned const x, int const y) {
+    uint8_t const alpha = HH2_ARGB8888_A(hh2_getPixel(source, x, y));
+    return ((uint16_t)alpha + 4) / 8;
+}
+
+// Encodes a row into spans and payload, or only counts them if spans is NULL
+static size_t hh2_spanRow(
+    hh2_Span* spans, hh2_RGB565* const payload, size_t* const payload_pos, size_t* const bg_pos,
+    hh2_PixelSource const source, int const y) {
+
+    unsigned const width = hh2_pixelSourceWidth(source);
+    size_t count = 0;
+
+    for (unsigned x = 0; x < width;) {
+        uint8_t const real_alpha = hh2_realAlpha(source, x, y);
+        unsigned xx = x + 1;
+
+        while (xx < width && hh2_realAlpha(source, xx, y) == real_alpha) {
+            xx++;
+        }
+
+        unsigned const length = xx - x;
+
+        if (real_alpha != 0) {
+            if (spans != NULL) {
+                hh2_Span* const span = spans + count;
+                span->header = length << 6 | (32 - real_alpha);
+                span->x = x;
+                span->pixels = *payload_pos;
+                span->bg = *bg_pos;
+
+                for (unsigned i = 0; i < length; i++) {
+                    hh2_ARGB8888 const pixel = hh2_getPixel(source, x + i, y);
+
+                    // Pixels that round to opaque are copied as they are, the others are premultiplied
+                    uint8_t const alpha = real_alpha == 32 ? 255 : HH2_ARGB8888_A(pixel);
+                    uint8_t const r = HH2_ARGB8888_R(pixel) * alpha / 255;
+                    uint8_t const g = HH2_ARGB8888_G(pixel) * alpha / 255;
+                    uint8_t const b = HH2_ARGB8888_B(pixel) * alpha / 255;
+                    payload[*payload_pos + i] = HH2_COLOR_RGB565(r, g, b);
+                }
+            }
+
+            *payload_pos += (length + HH2_SPAN_ALIGN - 1) & ~(size_t)(HH2_SPAN_ALIGN - 1);
+            *bg_pos += length;
+            count++;
+        }
+
+        x = xx;
     }
 
+    return count;
+}
+
+static size_t hh2_imageSize(hh2_PixelSource const source) {
+    unsigned const height = hh2_pixelSourceHeight(source);
+
+    size_t span_count = 0;
+    size_t payload_size = 0;
+    size_t pixels_used = 0;
+
+    for (unsigned y = 0; y < height; y++) {
+        span_count += hh2_spanRow(NULL, NULL, &payload_size, &pixels_used, source, y);
+    }
+
+    // Reserve room to align the payload
+    size_t const rows_size = sizeof(uint32_t) * height;
+    size_t const spans_size = sizeof(hh2_Span) * span_count;
+    return sizeof(struct hh2_Image) + rows_size + spans_size + 15 + payload_size * sizeof(hh2_RGB565);
+}
+
+// Encodes the image in memory with hh2_imageSize bytes
+static void hh2_encodeImage(hh2_Image const image, hh2_PixelSource const source) {
+    unsigned const height = hh2_pixelSourceHeight(source);
+
+    size_t span_count = 0;
+    size_t payload_size = 0;
+    size_t pixels_used = 0;
+
+    for (unsigned y = 0; y < height; y++) {
+        span_count += hh2_spanRow(NULL, NULL, &payload_size, &pixels_used, source, y);
+    }
+
+    size_t const rows_size = sizeof(uint32_t) * height;
+    size_t const spans_size = sizeof(hh2_Span) * span_count;
+
     image->width = hh2_pixelSourceWidth(source);
     image->height = height;
-    image->pixels_used = total_pixels_used;
+    image->pixels_used = pixels_used;
+
+    hh2_Span* const spans = (hh2_Span*)((uint8_t*)image + sizeof(*image) + rows_size);
+    uintptr_t const payload_address = (uintptr_t)((uint8_t*)spans + spans_size);
+    hh2_RGB565* const payload = (hh2_RGB565*)((payload_address + 15) & ~(uintptr_t)15);
 
-    hh2_Rle* rle = (hh2_Rle*)((uint8_t*)image + sizeof(*image) + sizeof(image->rows[0]) * (height - 1));
+    // Zero the padding between payloads
+    memset(payload, 0, payload_size * sizeof(hh2_RGB565));
+
+    size_t span_index = 0;
+    size_t payload_pos = 0;
+    size_t bg_pos = 0;
 
     for (unsigned y = 0; y < height; y++) {
-        image->rows[y] = rle;
-        size_t const words = hh2_rleRow(rle, source, y);
-        rle += words;
+        image->rows[y] = span_index;
+        span_index += hh2_spanRow(spans + span_index, payload, &payload_pos, &bg_pos, source, y);
+    }
+
+    image->rows[height] = span_index;
+    image->spans = spans;
+    image->payload = payload;
+}
+#endif
+
+// Composes count pixels with the same inverse alpha over the destination, src is premultiplied
+typedef void (*hh2_ComposeKernel)(hh2_RGB565* dst, hh2_RGB565 const* src, unsigned count);
+
+static hh2_RGB565 hh2_compose(hh2_RGB565 const src, hh2_RGB565 const dst, uint16_t const inv_alpha) {
+    // Each channel in its own 16-bit lane vectorizes well, premultiplied sources never carry into the next channel
+    uint16_t const r = ((dst >> 11) * inv_alpha) >> 5;
+    uint16_t const g = (((dst >> 5) & 63) * inv_alpha) >> 5;
+    uint16_t const b = ((dst & 31) * inv_alpha) >> 5;
+    return src + (r << 11 | g << 5 | b);
+}
+
+static void hh2_copy(hh2_RGB565* const dst, hh2_RGB565 const* const src, unsigned const count) {
+    memcpy(dst, src, count * sizeof(*dst));
+}
+
+// One kernel per inverse alpha level, so the multiplication is by a constant the compiler can fold
+#define HH2_COMPOSE_KERNEL(inv_alpha) \
+    static void hh2_compose ## inv_alpha(hh2_RGB565* const dst, hh2_RGB565 const* const src, unsigned const count) { \
+        for (unsigned i = 0; i < count; i++) { \
+            dst[i] = hh2_compose(src[i], dst[i], inv_alpha); \
+        } \
     }
 
+HH2_COMPOSE_KERNEL(1) HH2_COMPOSE_KERNEL(2) HH2_COMPOSE_KERNEL(3) HH2_COMPOSE_KERNEL(4)
+HH2_COMPOSE_KERNEL(5) HH2_COMPOSE_KERNEL(6) HH2_COMPOSE_KERNEL(7) HH2_COMPOSE_KERNEL(8)
+HH2_COMPOSE_KERNEL(9) HH2_COMPOSE_KERNEL(10) HH2_COMPOSE_KERNEL(11) HH2_COMPOSE_KERNEL(12)
+HH2_COMPOSE_KERNEL(13) HH2_COMPOSE_KERNEL(14) HH2_COMPOSE_KERNEL(15) HH2_COMPOSE_KERNEL(16)
+HH2_COMPOSE_KERNEL(17) HH2_COMPOSE_KERNEL(18) HH2_COMPOSE_KERNEL(19) HH2_COMPOSE_KERNEL(20)
+HH2_COMPOSE_KERNEL(21) HH2_COMPOSE_KERNEL(22) HH2_COMPOSE_KERNEL(23) HH2_COMPOSE_KERNEL(24)
+HH2_COMPOSE_KERNEL(25) HH2_COMPOSE_KERNEL(26) HH2_COMPOSE_KERNEL(27) HH2_COMPOSE_KERNEL(28)
+HH2_COMPOSE_KERNEL(29) HH2_COMPOSE_KERNEL(30) HH2_COMPOSE_KERNEL(31)
+
+// An inverse alpha of zero means opaque pixels, which are just copied
+static hh2_ComposeKernel const hh2_composeKernels[32] = {
+    hh2_copy, hh2_compose1, hh2_compose2, hh2_compose3, hh2_compose4, hh2_compose5, hh2_compose6, hh2_compose7,
+    hh2_compose8, hh2_compose9, hh2_compose10, hh2_compose11, hh2_compose12, hh2_compose13, hh2_compose14,
+    hh2_compose15, hh2_compose16, hh2_compose17, hh2_compose18, hh2_compose19, hh2_compose20, hh2_compose21,
+    hh2_compose22, hh2_compose23, hh2_compose24, hh2_compose25, hh2_compose26, hh2_compose27, hh2_compose28,
+    hh2_compose29, hh2_compose30, hh2_compose31
+};
+
+// Atlas images start at 16-byte boundaries so their payloads can be aligned within the reserved padding
+#define HH2_ATLAS_ALIGN(size) (((size) + 15) & ~(size_t)15)
+
+struct hh2_Atlas {
+    unsigned count;
+    hh2_Image images[1];
+};
+
+hh2_Image hh2_createImage(hh2_PixelSource const source) {
+    hh2_Image const image = (hh2_Image)malloc(hh2_imageSize(source));
+
+    if (image == NULL) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+        return NULL;
+    }
+
+    hh2_encodeImage(image, source);
+
 #ifdef HH2_DEBUG
     {
         char const* const path = hh2_getPixelSourcePath(source);
@@ -238,6 +451,84 @@ void hh2_destroyImage(hh2_Image const image) {
     free(image);
 }
 
+static void hh2_destroySubSources(hh2_PixelSource* const subs, unsigned const count) {
+    for (unsigned i = 0; i < count; i++) {
+        if (subs[i] != NULL) {
+            hh2_destroyPixelSource(subs[i]);
+        }
+    }
+
+    free(subs);
+}
+
+hh2_Atlas hh2_createAtlas(hh2_PixelSource const source, hh2_AtlasRect const* const rects, unsigned const count) {
+    if (count == 0) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "empty atlas");
+        return NULL;
+    }
+
+    hh2_PixelSource* const subs = (hh2_PixelSource*)calloc(count, sizeof(hh2_PixelSource));
+
+    if (subs == NULL) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+        return NULL;
+    }
+
+    size_t const header_size = HH2_ATLAS_ALIGN(sizeof(struct hh2_Atlas) + sizeof(hh2_Image) * (count - 1));
+    size_t size = header_size;
+
+    for (unsigned i = 0; i < count; i++) {
+        subs[i] = hh2_subPixelSource(source, rects[i].x, rects[i].y, rects[i].width, rects[i].height);
+
+        if (subs[i] == NULL) {
+            // Error already logged
+            hh2_destroySubSources(subs, count);
+            return NULL;
+        }
+
+        size += HH2_ATLAS_ALIGN(hh2_imageSize(subs[i]));
+    }
+
+    // All images live in the same allocation, right after the atlas header
+    hh2_Atlas const atlas = (hh2_Atlas)malloc(size);
+
+    if (atlas == NULL) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+        hh2_destroySubSources(subs, count);
+        return NULL;
+    }
+
+    atlas->count = count;
+    uint8_t* image_address = (uint8_t*)atlas + header_size;
+
+    for (unsigned i = 0; i < count; i++) {
+        hh2_Image const image = (hh2_Image)image_address;
+        hh2_encodeImage(image, subs[i]);
+
+#ifdef HH2_DEBUG
+        image->path = NULL;
+#endif
+
+        atlas->images[i] = image;
+        image_address += HH2_ATLAS_ALIGN(hh2_imageSize(subs[i]));
+    }
+
+    hh2_destroySubSources(subs, count);
+    return atlas;
+}
+
+void hh2_destroyAtlas(hh2_Atlas const atlas) {
+    free(atlas);
+}
+
+unsigned hh2_atlasCount(hh2_Atlas const atlas) {
+    return atlas->count;
+}
+
+hh2_Image hh2_atlasImage(hh2_Atlas const atlas, unsigned const index) {
+    return atlas->images[index];
+}
+
 unsigned hh2_imageWidth(hh2_Image const image) {
     return image->width;
 }
@@ -250,14 +541,20 @@ size_t hh2_changedPixels(hh2_Image const image) {
     return image->pixels_used;
 }
 
+// Clips the image to the canvas rows in [top, bottom)
 static bool hh2_clip(
-    hh2_Image const image, hh2_Canvas const canvas, int* const x0, int* const y0, unsigned* const width, unsigned* const height) {
+    hh2_Image const image, hh2_Canvas const canvas, unsigned const top, unsigned const bottom, int* const x0, int* const y0,
+    unsigned* const width, unsigned* const height) {
 
     unsigned const image_width = hh2_imageWidth(image);
     unsigned const image_height = hh2_imageHeight(image);
 
     unsigned const canvas_width = hh2_canvasWidth(canvas);
-    unsigned const canvas_height = hh2_canvasHeight(canvas);
+    unsigned const canvas_height = bottom < hh2_canvasHeight(canvas) ? bottom : hh2_canvasHeight(canvas);
+
+    if (top >= canvas_height) {
+        return false;
+    }
 
     if (*x0 < 0) {
         if ((unsigned)-*x0 > image_width) {
@@ -268,8 +565,8 @@ static bool hh2_clip(
         return false;
     }
 
-    if (*y0 < 0) {
-        if ((unsigned)-*y0 > image_height) {
+    if (*y0 < (int)top) {
+        if ((unsigned)((int)top - *y0) > image_height) {
             return false;
         }
     }
@@ -289,9 +586,9 @@ static bool hh2_clip(
         *width = canvas_width - *x0;
     }
 
-    if (*y0 < 0) {
-        *height += *y0;
-        *y0 = 0;
+    if (*y0 < (int)top) {
+        *height -= top - *y0;
+        *y0 = top;
     }
 
     if (*y0 + *height > canvas_height) {
@@ -302,12 +599,25 @@ static bool hh2_clip(
 }
 
 hh2_RGB565* hh2_blit(hh2_Image const image, hh2_Canvas const canvas, int const x0, int const y0, hh2_RGB565* bg) {
+    hh2_blitBand(image, canvas, x0, y0, bg, 0, hh2_canvasHeight(canvas));
+    return bg + image->pixels_used;
+}
+
+void hh2_unblit(hh2_Image const image, hh2_Canvas const canvas, int const x0, int const y0, hh2_RGB565 const* bg) {
+    hh2_unblitBand(image, canvas, x0, y0, bg, 0, hh2_canvasHeight(canvas));
+}
+
+#ifdef HH2_LEGACY_RLE
+void hh2_blitBand(
+    hh2_Image const image, hh2_Canvas const canvas, int const x0, int const y0, hh2_RGB565* const bg, unsigned const top,
+    unsigned const bottom) {
+
     int new_x0 = x0, new_y0 = y0;
     unsigned width, height;
     
-    // Clip the image to the canvas
-    if (!hh2_clip(image, canvas, &new_x0, &new_y0, &width, &height)) {
-        return bg;
+    // Clip the image to the canvas band
+    if (!hh2_clip(image, canvas, top, bottom, &new_x0, &new_y0, &width, &height)) {
+        return;
     }
 
     // Evaluate the pixel on the canvas to blit to
@@ -316,7 +626,9 @@ hh2_RGB565* hh2_blit(hh2_Image const image, hh2_Canvas const canvas, int const x
 
     for (unsigned y = 0; y < height; y++) {
         hh2_RGB565* const saved_pixel = pixel;
-        hh2_Rle const* rle = image->rows[new_y0 - y0 + y];
+        unsigned const row = new_y0 - y0 + y;
+        hh2_Rle const* rle = image->rows[row];
+        hh2_RGB565* row_bg = bg + image->bg_offsets[row];
 
         hh2_RleOp op = hh2_rleOp(*rle);
         unsigned length = hh2_rleLength(*rle);
@@ -328,6 +640,7 @@ hh2_RGB565* hh2_blit(hh2_Image const image, hh2_Canvas const canvas, int const x
 
             if (op != HH2_RLE_SKIP) {
                 rle += count;
+                row_bg += count;
             }
 
             length -= count;
@@ -346,46 +659,45 @@ hh2_RGB565* hh2_blit(hh2_Image const image, hh2_Canvas const canvas, int const x
             unsigned const count = length <= remaining ? length : remaining;
 
             if (op == HH2_RLE_BLIT) {
-                memcpy(bg, pixel, count * sizeof(*bg));
-                bg += count;
+                memcpy(row_bg, pixel, count * sizeof(*row_bg));
+                row_bg += count;
                 memcpy(pixel, rle, count * sizeof(*pixel));
                 rle += count;
             }
             else if (op == HH2_RLE_COMPOSE) {
-                memcpy(bg, pixel, count * sizeof(*bg));
-                bg += count;
+                memcpy(row_bg, pixel, count * sizeof(*row_bg));
+                row_bg += count;
 
-                for (unsigned i = 0; i < count; i++) {
-                    pixel[i] = hh2_compose(*rle, pixel[i], inv_alpha);
-                    rle++;
-                }
+                hh2_composeKernels[inv_alpha](pixel, rle, count);
+                rle += count;
             }
 
             pixel += count;
             length -= count;
+            remaining -= count;
 
-            if (length == 0) {
+            // Don't read past the end of the last row
+            if (length == 0 && remaining != 0) {
                 op = hh2_rleOp(*rle);
                 length = hh2_rleLength(*rle);
                 inv_alpha = hh2_rleInvAlpha(*rle);
                 rle++;
             }
-
-            remaining -= count;
         }
 
         pixel = (hh2_RGB565*)((uint8_t*)saved_pixel + pitch);
     }
-
-    return bg;
 }
 
-void hh2_unblit(hh2_Image const image, hh2_Canvas const canvas, int const x0, int const y0, hh2_RGB565 const* bg) {
+void hh2_unblitBand(
+    hh2_Image const image, hh2_Canvas const canvas, int const x0, int const y0, hh2_RGB565 const* const bg,
+    unsigned const top, unsigned const bottom) {
+
     int new_x0 = x0, new_y0 = y0;
     unsigned width, height;
     
-    // Clip the image to the canvas
-    if (!hh2_clip(image, canvas, &new_x0, &new_y0, &width, &height)) {
+    // Clip the image to the canvas band
+    if (!hh2_clip(image, canvas, top, bottom, &new_x0, &new_y0, &width, &height)) {
         return;
     }
 
@@ -395,7 +707,9 @@ void hh2_unblit(hh2_Image const image, hh2_Canvas const canvas, int const x0, in
 
     for (unsigned y = 0; y < height; y++) {
         hh2_RGB565* const saved_pixel = pixel;
-        hh2_Rle const* rle = image->rows[new_y0 - y0 + y];
+        unsigned const row = new_y0 - y0 + y;
+        hh2_Rle const* rle = image->rows[row];
+        hh2_RGB565 const* row_bg = bg + image->bg_offsets[row];
 
         hh2_RleOp op = hh2_rleOp(*rle);
         unsigned length = hh2_rleLength(*rle);
@@ -406,6 +720,7 @@ void hh2_unblit(hh2_Image const image, hh2_Canvas const canvas, int const x0, in
 
             if (op != HH2_RLE_SKIP) {
                 rle += count;
+                row_bg += count;
             }
 
             length -= count;
@@ -423,33 +738,127 @@ void hh2_unblit(hh2_Image const image, hh2_Canvas const canvas, int const x0, in
             unsigned const count = length <= remaining ? length : remaining;
 
             if (op != HH2_RLE_SKIP) {
-                memcpy(pixel, bg, count * sizeof(*bg));
-                bg += count;
+                memcpy(pixel, row_bg, count * sizeof(*row_bg));
+                row_bg += count;
                 rle += count;
             }
 
             pixel += count;
             length -= count;
+            remaining -= count;
 
-            if (length == 0) {
+            // Don't read past the end of the last row
+            if (length == 0 && remaining != 0) {
                 op = hh2_rleOp(*rle);
                 length = hh2_rleLength(*rle);
                 rle++;
             }
-
-            remaining -= count;
         }
 
         pixel = (hh2_RGB565*)((uint8_t*)saved_pixel + pitch);
     }
 }
+#else
+// Returns the first span that ends after column x, spans don't overlap so their ends are sorted too
+static hh2_Span const* hh2_findSpan(hh2_Span const* begin, hh2_Span const* end, unsigned const x) {
+    while (begin < end) {
+        hh2_Span const* const middle = begin + (end - begin) / 2;
+
+        if (middle->x + hh2_spanLength(middle) <= x) {
+            begin = middle + 1;
+        }
+        else {
+            end = middle;
+        }
+    }
+
+    return begin;
+}
+
+void hh2_blitBand(
+    hh2_Image const image, hh2_Canvas const canvas, int const x0, int const y0, hh2_RGB565* const bg, unsigned const top,
+    unsigned const bottom) {
+
+    int new_x0 = x0, new_y0 = y0;
+    unsigned width, height;
+
+    // Clip the image to the canvas band
+    if (!hh2_clip(image, canvas, top, bottom, &new_x0, &new_y0, &width, &height)) {
+        return;
+    }
+
+    // Columns of the image that are visible
+    unsigned const first = new_x0 - x0;
+    unsigned const last = first + width;
+
+    for (unsigned y = 0; y < height; y++) {
+        unsigned const row = new_y0 - y0 + y;
+        hh2_RGB565* const pixels = hh2_canvasPixel(canvas, new_x0, new_y0 + y) - first;
+
+        hh2_Span const* const end = image->spans + image->rows[row + 1];
+        hh2_Span const* span = hh2_findSpan(image->spans + image->rows[row], end, first);
+
+        for (; span < end && span->x < last; span++) {
+            unsigned const span_end = span->x + hh2_spanLength(span);
+            unsigned const begin = span->x > first ? span->x : first;
+            unsigned const count = (span_end < last ? span_end : last) - begin;
+
+            hh2_RGB565 const* const src = image->payload + span->pixels + (begin - span->x);
+            hh2_RGB565* const dst = pixels + begin;
+
+            memcpy(bg + span->bg + (begin - span->x), dst, count * sizeof(*dst));
+            hh2_composeKernels[hh2_spanInvAlpha(span)](dst, src, count);
+        }
+    }
+}
+
+void hh2_unblitBand(
+    hh2_Image const image, hh2_Canvas const canvas, int const x0, int const y0, hh2_RGB565 const* const bg,
+    unsigned const top, unsigned const bottom) {
+
+    int new_x0 = x0, new_y0 = y0;
+    unsigned width, height;
+
+    // Clip the image to the canvas band
+    if (!hh2_clip(image, canvas, top, bottom, &new_x0, &new_y0, &width, &height)) {
+        return;
+    }
+
+    // Columns of the image that are visible
+    unsigned const first = new_x0 - x0;
+    unsigned const last = first + width;
+
+    for (unsigned y = 0; y < height; y++) {
+        unsigned const row = new_y0 - y0 + y;
+        hh2_RGB565* const pixels = hh2_canvasPixel(canvas, new_x0, new_y0 + y) - first;
+
+        hh2_Span const* const end = image->spans + image->rows[row + 1];
+        hh2_Span const* span = hh2_findSpan(image->spans + image->rows[row], end, first);
+
+        for (; span < end && span->x < last; span++) {
+            unsigned const span_end = span->x + hh2_spanLength(span);
+            unsigned const begin = span->x > first ? span->x : first;
+            unsigned const count = (span_end < last ? span_end : last) - begin;
+
+            memcpy(pixels + begin, bg + span->bg + (begin - span->x), count * sizeof(*bg));
+        }
+    }
+}
+#endif
 
 void hh2_stamp(hh2_Image const image, hh2_Canvas const canvas, int const x0, int const y0) {
+    hh2_stampBand(image, canvas, x0, y0, 0, hh2_canvasHeight(canvas));
+}
+
+#ifdef HH2_LEGACY_RLE
+void hh2_stampBand(
+    hh2_Image const image, hh2_Canvas const canvas, int const x0, int const y0, unsigned const top, unsigned const bottom) {
+
     int new_x0 = x0, new_y0 = y0;
     unsigned width, height;
     
-    // Clip the image to the canvas
-    if (!hh2_clip(image, canvas, &new_x0, &new_y0, &width, &height)) {
+    // Clip the image to the canvas band
+    if (!hh2_clip(image, canvas, top, bottom, &new_x0, &new_y0, &width, &height)) {
         return;
     }
 
@@ -493,28 +902,61 @@ void hh2_stamp(hh2_Image const image, hh2_Canvas const canvas, int const x0, int
                 rle += count;
             }
             else if (op == HH2_RLE_COMPOSE) {
-                for (unsigned i = 0; i < count; i++) {
-                    pixel[i] = hh2_compose(*rle, pixel[i], inv_alpha);
-                    rle++;
-                }
+                hh2_composeKernels[inv_alpha](pixel, rle, count);
+                rle += count;
             }
 
             pixel += count;
             length -= count;
+            remaining -= count;
 
-            if (length == 0) {
+            // Don't read past the end of the last row
+            if (length == 0 && remaining != 0) {
                 op = hh2_rleOp(*rle);
                 length = hh2_rleLength(*rle);
                 inv_alpha = hh2_rleInvAlpha(*rle);
                 rle++;
             }
-
-            remaining -= count;
         }
 
         pixel = (hh2_RGB565*)((uint8_t*)saved_pixel + pitch);
     }
 }
+#else
+void hh2_stampBand(
+    hh2_Image const image, hh2_Canvas const canvas, int const x0, int const y0, unsigned const top, unsigned const bottom) {
+
+    int new_x0 = x0, new_y0 = y0;
+    unsigned width, height;
+
+    // Clip the image to the canvas band
+    if (!hh2_clip(image, canvas, top, bottom, &new_x0, &new_y0, &width, &height)) {
+        return;
+    }
+
+    // Columns of the image that are visible
+    unsigned const first = new_x0 - x0;
+    unsigned const last = first + width;
+
+    for (unsigned y = 0; y < height; y++) {
+        unsigned const row = new_y0 - y0 + y;
+        hh2_RGB565* const pixels = hh2_canvasPixel(canvas, new_x0, new_y0 + y) - first;
+
+        hh2_Span const* const end = image->spans + image->rows[row + 1];
+        hh2_Span const* span = hh2_findSpan(image->spans + image->rows[row], end, first);
+
+        for (; span < end && span->x < last; span++) {
+            unsigned const span_end = span->x + hh2_spanLength(span);
+            unsigned const begin = span->x > first ? span->x : first;
+            unsigned const count = (span_end < last ? span_end : last) - begin;
+
+            hh2_RGB565 const* const src = image->payload + span->pixels + (begin - span->x);
+            hh2_RGB565* const dst = pixels + begin;
+            hh2_composeKernels[hh2_spanInvAlpha(span)](dst, src, count);
+        }
+    }
+}
+#endif
 
 #ifdef HH2_DEBUG
 char const* hh2_getImagePath(hh2_Image image) {
@@ -5,10 +5,24 @@
 #include "canvas.h"
 
 typedef struct hh2_Image* hh2_Image;
+typedef struct hh2_Atlas* hh2_Atlas;
+
+typedef struct {
+    unsigned x, y, width, height;
+}
+hh2_AtlasRect;
 
 hh2_Image hh2_createImage(hh2_PixelSource source);
 void hh2_destroyImage(hh2_Image image);
 
+// Encodes the rectangles of source as images in one allocation, the images belong to the atlas and must not be
+// destroyed with hh2_destroyImage
+hh2_Atlas hh2_createAtlas(hh2_PixelSource source, hh2_AtlasRect const* rects, unsigned count);
+void hh2_destroyAtlas(hh2_Atlas atlas);
+
+unsigned hh2_atlasCount(hh2_Atlas atlas);
+hh2_Image hh2_atlasImage(hh2_Atlas atlas, unsigned index);
+
 unsigned hh2_imageWidth(hh2_Image image);
 unsigned hh2_imageHeight(hh2_Image image);
 size_t hh2_changedPixels(hh2_Image image);
@@ -16,7 +30,14 @@ size_t hh2_changedPixels(hh2_Image image);
 hh2_RGB565* hh2_blit(hh2_Image image, hh2_Canvas canvas, int x0, int y0, hh2_RGB565* bg);
 void hh2_unblit(hh2_Image image, hh2_Canvas canvas, int x0, int y0, hh2_RGB565 const* bg);
 
+// Same as hh2_blit and hh2_unblit, but only touch the canvas rows in [top, bottom), so different bands can be composed
+// at the same time
+void hh2_blitBand(hh2_Image image, hh2_Canvas canvas, int x0, int y0, hh2_RGB565* bg, unsigned top, unsigned bottom);
+void hh2_unblitBand(
+    hh2_Image image, hh2_Canvas canvas, int x0, int y0, hh2_RGB565 const* bg, unsigned top, unsigned bottom);
+
 void hh2_stamp(hh2_Image image, hh2_Canvas canvas, int x0, int y0);
+void hh2_stampBand(hh2_Image image, hh2_Canvas canvas, int x0, int y0, unsigned top, unsigned bottom);
 
 #ifdef HH2_DEBUG
 char const* hh2_getImagePath(hh2_Image image);
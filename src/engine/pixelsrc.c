@@ -370,6 +370,34 @@ hh2_PixelSource hh2_readPixelSource(hh2_Filesys const filesys, char const* const
     return source;
 }
 
+hh2_PixelSource hh2_createPixelSource(unsigned const width, unsigned const height, void const* const pixels) {
+    if (width == 0 || height == 0) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "empty pixel source");
+        return NULL;
+    }
+
+    size_t const num_pixels = (size_t)width * height;
+    hh2_PixelSource const source = malloc(sizeof(*source) + sizeof(source->data[0]) * (num_pixels - 1));
+
+    if (source == NULL) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+        return NULL;
+    }
+
+    source->width = width;
+    source->height = height;
+    source->pitch = width;
+    source->parent = NULL;
+    source->abgr = source->data;
+    memcpy(source->data, pixels, sizeof(source->data[0]) * num_pixels);
+
+#ifdef HH2_DEBUG
+    source->path = NULL;
+#endif
+
+    return source;
+}
+
 hh2_PixelSource hh2_subPixelSource(hh2_PixelSource const parent, unsigned const x0, unsigned const y0, unsigned const width, unsigned const height) {
     if ((x0 + width) > parent->width) {
         HH2_LOG(HH2_LOG_ERROR, TAG "empty sub pixel source");
@@ -16,6 +16,8 @@ typedef struct hh2_PixelSource* hh2_PixelSource;
 
 hh2_PixelSource hh2_initPixelSource(void const* data, size_t size);
 hh2_PixelSource hh2_readPixelSource(hh2_Filesys filesys, char const* path);
+// Copies width * height ARGB8888 pixels in native byte order, pixels doesn't have to be aligned
+hh2_PixelSource hh2_createPixelSource(unsigned width, unsigned height, void const* pixels);
 hh2_PixelSource hh2_subPixelSource(hh2_PixelSource parent, unsigned x0, unsigned y0, unsigned width, unsigned height);
 void hh2_destroyPixelSource(hh2_PixelSource source);
 
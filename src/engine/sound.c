@@ -1,3 +1,8 @@
+#ifdef HH2_AUDIO_THREAD
+    // For pthreads and nanosleep
+    #define _POSIX_C_SOURCE 200112L
+#endif
+
 #include "sound.h"
 #include "filesys.h"
 #include "log.h"
@@ -8,11 +13,60 @@
 #include <dr_wav.h>
 
 #include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HH2_AUDIO_THREAD
+    #include <pthread.h>
+    #include <time.h>
+#endif
 
-#define HH2_SAMPLE_RATE 44100
-#define HH2_SAMPLES_PER_VIDEO_FRAME (HH2_SAMPLE_RATE / 60)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define HH2_MIX_SSE2
+    #include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define HH2_MIX_NEON
+    #include <arm_neon.h>
+#endif
+
+#define HH2_DEFAULT_SAMPLE_RATE 44100
+#define HH2_MIN_SAMPLE_RATE 8000
+#define HH2_MAX_SAMPLE_RATE 48000
+#define HH2_VIDEO_FPS 60
+#define HH2_MAX_FRAMES_PER_VIDEO_FRAME ((HH2_MAX_SAMPLE_RATE + HH2_VIDEO_FPS - 1) / HH2_VIDEO_FPS)
 #define HH2_MAX_CHANNELS 8
-#define HH2_MAX_VOICES 16
+#define HH2_DEFAULT_VOICES 16
+#define HH2_MAX_VOICES 256 // must fit in the lower 16 bits of a voice handle
+
+// Sounds longer than this many seconds are streamed from the file system instead of being decoded at load time
+#define HH2_DEFAULT_STREAM_THRESHOLD 10.0f
+#define HH2_STREAM_RING_FRAMES 4096 // must be a power of two
+#define HH2_STREAM_BLOCK_FRAMES 512
+
+// WAVs are decoded in blocks of this many frames when they have to be downmixed
+#define HH2_DECODE_BLOCK_FRAMES 1024
+
+// Raw PCM chunks created by etc/wav2pcm, see hh2_openSource for the header layout
+#define HH2_RAW_PCM_MAGIC "HH2P"
+#define HH2_RAW_PCM_HEADER_SIZE 16
+
+// Commands go from the API to the mixer, events with the voices that ended go back, both queues must be powers of two
+#define HH2_COMMAND_QUEUE_SIZE 256
+#define HH2_EVENT_QUEUE_SIZE 512
+
+// The audio thread mixes blocks of frames into a ring, staying at most HH2_THREAD_FILL_FRAMES ahead of the reader
+#define HH2_THREAD_RING_FRAMES 4096 // must be a power of two
+#define HH2_THREAD_BLOCK_FRAMES 256
+#define HH2_THREAD_FILL_FRAMES 2048
+#define HH2_THREAD_SLEEP_NS 1000000
+
+// Queue positions are written by one thread only, and read by the other
+#define HH2_ATOMIC_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define HH2_ATOMIC_STORE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+
+// Voice gains are Q2.14 fixed point, so unity gain is exact and the product of a sample with a gain fits in 32 bits
+#define HH2_GAIN_SHIFT 14
+#define HH2_GAIN_ONE (1 << HH2_GAIN_SHIFT)
 
 #define TAG "SND "
 
@@ -23,19 +77,150 @@ typedef char hh2_staticAssertSoundSampleMustBeInt16[sizeof(hh2_Sample) == sizeof
 // Make sure Speex sample has the same number of bits as we have
 typedef char hh2_staticAssertSpeexSampleMustBeHh2Sample[sizeof(spx_int16_t) == sizeof(hh2_Sample) ? 1 : -1];
 
+// Make sure the stream ring buffer can always hold a video frame worth of frames
+typedef char hh2_staticAssertStreamRingMustHoldAVideoFrame[HH2_STREAM_RING_FRAMES > HH2_MAX_FRAMES_PER_VIDEO_FRAME ? 1 : -1];
+// Make sure the mixer can always post the events for the commands it runs and the voices that end while mixing
+typedef char hh2_staticAssertEventQueueMustHoldAllEvents[HH2_EVENT_QUEUE_SIZE >= HH2_COMMAND_QUEUE_SIZE + HH2_MAX_VOICES ? 1 : -1];
+// Make sure blocks never wrap around the end of the audio thread ring
+typedef char hh2_staticAssertThreadBlocksMustNotWrap[HH2_THREAD_RING_FRAMES % HH2_THREAD_BLOCK_FRAMES == 0 ? 1 : -1];
+
+// Where the samples come from, a WAV decoded by dr_wav or a raw PCM chunk
+typedef struct {
+    hh2_File file;
+    drwav wav; // Not initialized for raw PCM chunks
+    bool raw;
+    unsigned channels;
+    unsigned sample_rate;
+    size_t frame_count;
+}
+hh2_Source;
+
 struct hh2_Pcm {
-    size_t sample_count;
+    // Streamed PCMs have a path and are decoded from the file system while playing, samples is empty
+    hh2_Filesys filesys;
+    char* path;
+
+    unsigned channels; // 1 or 2, stereo samples are interleaved
+    size_t frame_count;
+    unsigned voices; // number of voices playing this PCM
     hh2_Sample samples[1];
 };
 
 typedef struct {
-    hh2_Pcm pcm;
+    hh2_Source source;
+    SpeexResamplerState* resampler; // NULL if the source is already at the mix rate
+    unsigned channels;
+
+    // Decoded frames not yet consumed by the resampler
+    size_t in_pos;
+    size_t in_count;
+    bool eof;
+    bool loop;
+
+    // Frames at the mix rate ready to be mixed, read and write only ever increase
+    size_t read;
+    size_t write;
+    hh2_Sample ring[HH2_STREAM_RING_FRAMES * 2];
+
+    drwav_int16 frames[HH2_STREAM_BLOCK_FRAMES * HH2_MAX_CHANNELS];
+    hh2_Sample in[HH2_STREAM_BLOCK_FRAMES * 2];
+}
+hh2_Stream;
+
+// Voice state used to allocate voices, only touched by the thread calling the API
+typedef struct {
+    hh2_Pcm pcm; // NULL if the slot is free
+    int priority;
+    uint32_t sequence; // voices that started earlier are stolen first among the same priority
+    uint16_t generation; // bumped every time the slot is freed so stale handles don't match
+    unsigned active_index; // position in hh2_active while playing
+}
+hh2_VoiceSlot;
+
+// Voice state used to mix, only touched by the mixer which runs in the audio thread if there is one
+typedef struct {
+    hh2_Pcm pcm; // NULL if the voice is not playing
+    hh2_Stream* stream; // NULL for preloaded PCMs
     size_t position;
+    int16_t gains[2]; // left and right
+    bool loop;
+    uint16_t generation;
+    unsigned active_index; // position in hh2_mixerActive while playing
+}
+hh2_MixerVoice;
+
+typedef enum {
+    HH2_COMMAND_PLAY,
+    HH2_COMMAND_STOP,
+    HH2_COMMAND_DESTROY_PCM
+}
+hh2_CommandType;
+
+typedef struct {
+    hh2_CommandType type;
+    unsigned index;
+    uint16_t generation;
+    hh2_Pcm pcm;
+    hh2_Stream* stream;
+    int16_t gains[2];
+    bool loop;
+}
+hh2_Command;
+
+// A voice stopped playing in the mixer, its stream must be closed by the API side
+typedef struct {
+    unsigned index;
+    uint16_t generation;
+    hh2_Stream* stream;
+}
+hh2_Event;
+
+typedef struct {
+    SpeexResamplerState* state;
+    unsigned channels;
+    bool in_use;
 }
-hh2_Voice;
+hh2_Resampler;
+
+static int16_t hh2_audioFrames[HH2_MAX_FRAMES_PER_VIDEO_FRAME * 2];
+
+// Voice slots, the indices of the ones that are playing, and a stack with the indices of the free ones
+static hh2_VoiceSlot hh2_slots[HH2_MAX_VOICES];
+static unsigned hh2_active[HH2_MAX_VOICES];
+static unsigned hh2_free[HH2_MAX_VOICES];
+static unsigned hh2_capacity = 0;
+static unsigned hh2_activeCount = 0;
+static unsigned hh2_freeCount = 0;
+static uint32_t hh2_sequence = 0;
+
+// The mixer side of the voices
+static hh2_MixerVoice hh2_mixerVoices[HH2_MAX_VOICES];
+static unsigned hh2_mixerActive[HH2_MAX_VOICES];
+static unsigned hh2_mixerActiveCount = 0;
+
+// Single producer, single consumer queues, read and write positions only ever increase
+static hh2_Command hh2_commands[HH2_COMMAND_QUEUE_SIZE];
+static size_t hh2_commandRead = 0, hh2_commandWrite = 0;
+static hh2_Event hh2_events[HH2_EVENT_QUEUE_SIZE];
+static size_t hh2_eventRead = 0, hh2_eventWrite = 0;
+
+// Mixed frames produced by the audio thread
+static int16_t hh2_ring[HH2_THREAD_RING_FRAMES * 2];
+static size_t hh2_ringRead = 0, hh2_ringWrite = 0;
+static bool hh2_threadRunning = false;
 
-static int16_t hh2_audioFrames[HH2_SAMPLES_PER_VIDEO_FRAME * 2];
-static hh2_Voice hh2_voices[HH2_MAX_VOICES] = {{NULL, 0}};
+#ifdef HH2_AUDIO_THREAD
+static pthread_t hh2_thread;
+static bool hh2_threadQuit;
+#endif
+
+static float hh2_streamThreshold = HH2_DEFAULT_STREAM_THRESHOLD;
+static unsigned hh2_sampleRate = HH2_DEFAULT_SAMPLE_RATE;
+static unsigned hh2_frameRemainder = 0; // sample rate units left over from previous video frames
+
+// Resamplers are reused, the pool grows to the number of streams playing plus the sound being loaded
+static hh2_Resampler* hh2_resamplers = NULL;
+static unsigned hh2_resamplerCount = 0;
 
 static size_t hh2_wavRead(void* const userdata, void* const buffer, size_t const count) {
     hh2_File const file = (hh2_File)userdata;
@@ -107,100 +292,378 @@ static char const* hh2_wavError(drwav_result const error) {
     }
 }
 
+
+// Downmix weights in percent, indexed by the WAVE_FORMAT_EXTENSIBLE speaker order FL FR FC LFE BL BR SL SR
+static int32_t const hh2_downmixLeft[HH2_MAX_CHANNELS] = {100, 0, 71, 0, 71, 0, 71, 0};
+static int32_t const hh2_downmixRight[HH2_MAX_CHANNELS] = {0, 100, 71, 0, 0, 71, 0, 71};
+
+// Mixes count frames with in_channels down to out_channels (1 or 2), normalized so it never clips
+static void hh2_downmix(
+    hh2_Sample* out, unsigned const out_channels,
+    drwav_int16 const* in, unsigned const in_channels, size_t const count) {
+
+    int32_t left_total = 0, right_total = 0;
+
+    for (unsigned c = 0; c < in_channels; c++) {
+        left_total += hh2_downmixLeft[c];
+        right_total += hh2_downmixRight[c];
+    }
+
+    if (out_channels == 1) {
+        int32_t const total = left_total + right_total;
+
+        for (size_t i = 0; i < count; i++, in += in_channels) {
+            int32_t sum = 0;
+
+            for (unsigned c = 0; c < in_channels; c++) {
+                sum += in[c] * (hh2_downmixLeft[c] + hh2_downmixRight[c]);
+            }
+
+            *out++ = (hh2_Sample)(sum / total);
+        }
+    }
+    else {
+        for (size_t i = 0; i < count; i++, in += in_channels) {
+            int32_t left = 0, right = 0;
+
+            for (unsigned c = 0; c < in_channels; c++) {
+                left += in[c] * hh2_downmixLeft[c];
+                right += in[c] * hh2_downmixRight[c];
+            }
+
+            *out++ = (hh2_Sample)(left / left_total);
+            *out++ = (hh2_Sample)(right / right_total);
+        }
+    }
+}
+
+// Mono assets stay mono, everything else is kept as stereo unless a downmix to mono was asked for
+static unsigned hh2_outputChannels(unsigned const source_channels, bool const downmix) {
+    return downmix || source_channels == 1 ? 1 : 2;
+}
+
+static bool hh2_isLittleEndian(void) {
+    static uint16_t const one = 1;
+    return *(uint8_t const*)&one == 1;
+}
+
+static unsigned long hh2_readU32(uint8_t const* const bytes) {
+    return (unsigned long)bytes[0] | (unsigned long)bytes[1] << 8 |
+           (unsigned long)bytes[2] << 16 | (unsigned long)bytes[3] << 24;
+}
+
+static bool hh2_openSource(hh2_Source* const source, hh2_Filesys const filesys, char const* const path) {
+    source->file = hh2_openFile(filesys, path);
+
+    if (source->file == NULL) {
+        // Error already logged
+        return false;
+    }
+
+    // Raw PCM chunks have "HH2P", channels (u16), reserved (u16), sample rate (u32) and frame count (u32)
+    uint8_t header[HH2_RAW_PCM_HEADER_SIZE];
+
+    if (hh2_read(source->file, header, sizeof(header)) == sizeof(header) && memcmp(header, HH2_RAW_PCM_MAGIC, 4) == 0) {
+        source->raw = true;
+        source->channels = header[4] | header[5] << 8;
+        source->sample_rate = hh2_readU32(header + 8);
+        source->frame_count = hh2_readU32(header + 12);
+
+        if (source->channels == 0 || source->channels > HH2_MAX_CHANNELS || source->sample_rate == 0) {
+            HH2_LOG(HH2_LOG_ERROR, TAG "invalid raw PCM header in \"%s\"", path);
+            hh2_close(source->file);
+            return false;
+        }
+
+        return true;
+    }
+
+    hh2_seek(source->file, 0, SEEK_SET);
+
+    if (!drwav_init(&source->wav, hh2_wavRead, hh2_wavSeek, source->file, NULL)) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "error loading WAV: %s", hh2_wavError(drwav_uninit(&source->wav)));
+        hh2_close(source->file);
+        return false;
+    }
+
+    if (source->wav.channels > HH2_MAX_CHANNELS) {
+        HH2_LOG(
+            HH2_LOG_ERROR, TAG "too many channels in WAV: %u, we only support %d",
+            source->wav.channels, HH2_MAX_CHANNELS
+        );
+
+        drwav_uninit(&source->wav);
+        hh2_close(source->file);
+        return false;
+    }
+
+    source->raw = false;
+    source->channels = source->wav.channels;
+    source->sample_rate = source->wav.sampleRate;
+    source->frame_count = source->wav.totalPCMFrameCount;
+    return true;
+}
+
+static bool hh2_rewindSource(hh2_Source* const source) {
+    if (source->raw) {
+        return hh2_seek(source->file, HH2_RAW_PCM_HEADER_SIZE, SEEK_SET) == 0;
+    }
+
+    return drwav_seek_to_pcm_frame(&source->wav, 0);
+}
+
+static void hh2_closeSource(hh2_Source* const source) {
+    if (!source->raw) {
+        drwav_uninit(&source->wav);
+    }
+
+    hh2_close(source->file);
+}
+
+// Reads up to count frames, dr_wav converts 8-bit, float and ADPCM data straight to 16 bits
+static size_t hh2_readSource(hh2_Source* const source, drwav_int16* const frames, size_t const count) {
+    if (!source->raw) {
+        return drwav_read_pcm_frames_s16(&source->wav, count, frames);
+    }
+
+    size_t const frame_size = source->channels * sizeof(drwav_int16);
+    size_t const num_read = hh2_read(source->file, frames, count * frame_size) / frame_size;
+
+    if (!hh2_isLittleEndian()) {
+        uint16_t* const samples = (uint16_t*)frames;
+
+        for (size_t i = 0; i < num_read * source->channels; i++) {
+            samples[i] = (uint16_t)(samples[i] << 8 | samples[i] >> 8);
+        }
+    }
+
+    return num_read;
+}
+
+// Reads count frames into out, going through the downmix in blocks if the channel count changes
+static bool hh2_decode(hh2_Source* const source, hh2_Sample* out, unsigned const out_channels, size_t count) {
+    if (source->channels == out_channels) {
+        return hh2_readSource(source, out, count) == count;
+    }
+
+    drwav_int16 block[HH2_DECODE_BLOCK_FRAMES * HH2_MAX_CHANNELS];
+
+    while (count != 0) {
+        size_t const frames = count < HH2_DECODE_BLOCK_FRAMES ? count : HH2_DECODE_BLOCK_FRAMES;
+
+        if (hh2_readSource(source, block, frames) != frames) {
+            return false;
+        }
+
+        hh2_downmix(out, out_channels, block, source->channels, frames);
+        out += frames * out_channels;
+        count -= frames;
+    }
+
+    return true;
+}
+
+// Gets a resampler from the pool, reusing one with the same channel count if possible
+static SpeexResamplerState* hh2_acquireResampler(unsigned const channels, spx_uint32_t const in_rate) {
+    hh2_Resampler* unused = NULL;
+
+    for (unsigned i = 0; i < hh2_resamplerCount; i++) {
+        hh2_Resampler* const resampler = hh2_resamplers + i;
+
+        if (resampler->in_use) {
+            continue;
+        }
+
+        if (resampler->state != NULL && resampler->channels == channels) {
+            speex_resampler_set_rate(resampler->state, in_rate, hh2_sampleRate);
+            speex_resampler_reset_mem(resampler->state);
+            resampler->in_use = true;
+            return resampler->state;
+        }
+
+        // Prefer empty slots over destroying a resampler that has a different channel count
+        if (unused == NULL || unused->state != NULL) {
+            unused = resampler;
+        }
+    }
+
+    if (unused == NULL) {
+        hh2_Resampler* const resamplers = (hh2_Resampler*)realloc(
+            hh2_resamplers, (hh2_resamplerCount + 1) * sizeof(*resamplers));
+
+        if (resamplers == NULL) {
+            HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+            return NULL;
+        }
+
+        hh2_resamplers = resamplers;
+        unused = hh2_resamplers + hh2_resamplerCount++;
+        unused->state = NULL;
+    }
+
+    if (unused->state != NULL) {
+        speex_resampler_destroy(unused->state);
+    }
+
+    int error;
+    unused->state = speex_resampler_init(channels, in_rate, hh2_sampleRate, SPEEX_RESAMPLER_QUALITY_DEFAULT, &error);
+
+    if (unused->state == NULL) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "error initializing resampler: %s", speex_resampler_strerror(error));
+        return NULL;
+    }
+
+    unused->channels = channels;
+    unused->in_use = true;
+    return unused->state;
+}
+
+static void hh2_releaseResampler(SpeexResamplerState* const state) {
+    for (unsigned i = 0; i < hh2_resamplerCount; i++) {
+        if (hh2_resamplers[i].state == state) {
+            hh2_resamplers[i].in_use = false;
+            return;
+        }
+    }
+}
+
 static bool hh2_resample(
-    spx_uint32_t const in_rate,
-    spx_int16_t const* const in_data, spx_uint32_t in_samples,
-    spx_int16_t* const out_data, spx_uint32_t out_samples) {
+    spx_uint32_t const in_rate, unsigned const channels,
+    spx_int16_t const* const in_data, spx_uint32_t in_frames,
+    spx_int16_t* const out_data, spx_uint32_t out_frames) {
 
     HH2_LOG(
-        HH2_LOG_INFO, TAG "resampling from %u Hz to %d (%" PRIu32 " samples in, %" PRIu32 " samples out",
-        in_rate, HH2_SAMPLE_RATE, in_samples, out_samples
+        HH2_LOG_INFO, TAG "resampling from %u Hz to %d (%" PRIu32 " frames in, %" PRIu32 " frames out",
+        in_rate, hh2_sampleRate, in_frames, out_frames
     );
 
-    int error;
-    SpeexResamplerState* const resampler = speex_resampler_init(
-        1, in_rate, HH2_SAMPLE_RATE, SPEEX_RESAMPLER_QUALITY_DEFAULT, &error);
+    SpeexResamplerState* const resampler = hh2_acquireResampler(channels, in_rate);
 
     if (resampler == NULL) {
-        HH2_LOG(HH2_LOG_ERROR, TAG "error initializing resampler: %s", speex_resampler_strerror(error));
+        // Error already logged
         return false;
     }
 
-    error = speex_resampler_process_int(resampler, 0, in_data, &in_samples, out_data, &out_samples);
+    int const error = speex_resampler_process_interleaved_int(resampler, in_data, &in_frames, out_data, &out_frames);
+    hh2_releaseResampler(resampler);
 
     if (error != RESAMPLER_ERR_SUCCESS) {
         HH2_LOG(HH2_LOG_ERROR, TAG "error resampling: %s", speex_resampler_strerror(error));
-        speex_resampler_destroy(resampler);
         return false;
     }
 
-    speex_resampler_destroy(resampler);
     return true;
 }
 
-hh2_Pcm hh2_readPcm(hh2_Filesys filesys, char const* path) {
-    hh2_File const file = hh2_openFile(filesys, path);
+static hh2_Pcm hh2_createStreamedPcm(
+    hh2_Filesys const filesys, char const* const path, unsigned const channels, size_t const frame_count) {
 
-    if (file == NULL) {
-        // Error already logged
+    HH2_LOG(HH2_LOG_INFO, TAG "streaming \"%s\" (%zu frames, %u channels)", path, frame_count, channels);
+
+    hh2_Pcm const pcm = (hh2_Pcm)malloc(sizeof(*pcm));
+    size_t const path_len = strlen(path);
+    char* const path_dup = (char*)malloc(path_len + 1);
+
+    if (pcm == NULL || path_dup == NULL) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+        free(path_dup);
+        free(pcm);
         return NULL;
     }
 
-    drwav wav;
+    memcpy(path_dup, path, path_len + 1);
 
-    if (!drwav_init(&wav, hh2_wavRead, hh2_wavSeek, file, NULL)) {
-        HH2_LOG(HH2_LOG_ERROR, TAG "error loading WAV: %s", hh2_wavError(drwav_uninit(&wav)));
-        return NULL;
+    pcm->filesys = filesys;
+    pcm->path = path_dup;
+    pcm->channels = channels;
+    pcm->frame_count = frame_count;
+    pcm->voices = 0;
+    return pcm;
+}
+
+void hh2_setStreamThreshold(float const seconds) {
+    hh2_streamThreshold = seconds < 0.0f ? 0.0f : seconds;
+}
+
+void hh2_setMixRate(unsigned const rate) {
+    if (rate < HH2_MIN_SAMPLE_RATE || rate > HH2_MAX_SAMPLE_RATE) {
+        HH2_LOG(
+            HH2_LOG_WARN, TAG "unsupported mix rate %u, using %u Hz (valid rates go from %d to %d)",
+            rate, hh2_sampleRate, HH2_MIN_SAMPLE_RATE, HH2_MAX_SAMPLE_RATE
+        );
+
+        return;
     }
 
-    if (wav.channels > HH2_MAX_CHANNELS) {
-        HH2_LOG(HH2_LOG_ERROR, TAG "too many channels in WAV: %u, we only support %d", wav.channels, HH2_MAX_CHANNELS);
-        drwav_uninit(&wav);
-        hh2_close(file);
+    HH2_LOG(HH2_LOG_INFO, TAG "mixing at %u Hz", rate);
+    hh2_sampleRate = rate;
+    hh2_frameRemainder = 0;
+}
+
+unsigned hh2_mixRate(void) {
+    return hh2_sampleRate;
+}
+
+hh2_Pcm hh2_readPcm(hh2_Filesys filesys, char const* path, bool const downmix) {
+    hh2_Source source;
+
+    if (!hh2_openSource(&source, filesys, path)) {
+        // Error already logged
         return NULL;
     }
 
-    size_t const sample_count = wav.totalPCMFrameCount * HH2_SAMPLE_RATE / wav.sampleRate;
-    hh2_Pcm pcm = (hh2_Pcm)malloc(sizeof(*pcm) + (sample_count - 1) * sizeof(hh2_Sample));
+    unsigned const channels = hh2_outputChannels(source.channels, downmix);
+    size_t const frame_count = (size_t)((drwav_uint64)source.frame_count * hh2_sampleRate / source.sample_rate);
+
+    if (frame_count > (size_t)(hh2_streamThreshold * hh2_sampleRate)) {
+        // Decoding will happen at play time, one block at a time
+        hh2_closeSource(&source);
+        return hh2_createStreamedPcm(filesys, path, channels, frame_count);
+    }
+
+    hh2_Pcm pcm = (hh2_Pcm)malloc(sizeof(*pcm) + frame_count * channels * sizeof(hh2_Sample));
 
     if (pcm == NULL) {
         HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
-        drwav_uninit(&wav);
-        hh2_close(file);
+        hh2_closeSource(&source);
         return NULL;
     }
 
-    pcm->sample_count = sample_count;
+    pcm->filesys = NULL;
+    pcm->path = NULL;
+    pcm->channels = channels;
+    pcm->frame_count = frame_count;
+    pcm->voices = 0;
     hh2_Sample* samples = pcm->samples;
 
-    if (wav.sampleRate != HH2_SAMPLE_RATE) {
-        samples = (hh2_Sample*)malloc(wav.totalPCMFrameCount * sizeof(hh2_Sample));
-    }
-
-    for (size_t i = 0; i < wav.totalPCMFrameCount; i++) {
-        drwav_int16 frame[HH2_MAX_CHANNELS];
-        drwav_uint64 const num_read = drwav_read_pcm_frames_s16(&wav, 1, frame);
-
-        if (num_read != 1) {
-            HH2_LOG(HH2_LOG_ERROR, TAG "error reading samples: %s", hh2_wavError(drwav_uninit(&wav)));
-
-            if (wav.sampleRate != HH2_SAMPLE_RATE) {
-                free(samples);
-            }
+    // Raw PCM chunks at the mix rate are read straight into the PCM
+    if (source.sample_rate != hh2_sampleRate) {
+        samples = (hh2_Sample*)malloc(source.frame_count * channels * sizeof(hh2_Sample));
 
+        if (samples == NULL) {
+            HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
             free(pcm);
-            hh2_close(file);
+            hh2_closeSource(&source);
             return NULL;
         }
+    }
+
+    if (!hh2_decode(&source, samples, channels, source.frame_count)) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "error reading samples from \"%s\"", path);
+
+        if (source.sample_rate != hh2_sampleRate) {
+            free(samples);
+        }
 
-        samples[i] = frame[0]; // We only support mono, get the first sample
+        free(pcm);
+        hh2_closeSource(&source);
+        return NULL;
     }
 
-    drwav_uninit(&wav);
-    hh2_close(file);
+    hh2_closeSource(&source);
 
-    if (wav.sampleRate != HH2_SAMPLE_RATE) {
-        if (!hh2_resample(wav.sampleRate, samples, wav.totalPCMFrameCount, pcm->samples, sample_count)) {
+    if (source.sample_rate != hh2_sampleRate) {
+        if (!hh2_resample(source.sample_rate, channels, samples, source.frame_count, pcm->samples, frame_count)) {
             // Error already logged
             free(samples);
             free(pcm);
@@ -213,79 +676,745 @@ hh2_Pcm hh2_readPcm(hh2_Filesys filesys, char const* path) {
     return pcm;
 }
 
+static hh2_Stream* hh2_openStream(hh2_Pcm const pcm) {
+    hh2_Stream* const stream = (hh2_Stream*)malloc(sizeof(*stream));
+
+    if (stream == NULL) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+        return NULL;
+    }
+
+    if (!hh2_openSource(&stream->source, pcm->filesys, pcm->path)) {
+        // Error already logged
+        free(stream);
+        return NULL;
+    }
+
+    stream->resampler = NULL;
+    stream->channels = pcm->channels;
+
+    if (stream->source.sample_rate != hh2_sampleRate) {
+        stream->resampler = hh2_acquireResampler(stream->channels, stream->source.sample_rate);
+
+        if (stream->resampler == NULL) {
+            // Error already logged
+            hh2_closeSource(&stream->source);
+            free(stream);
+            return NULL;
+        }
+    }
+
+    stream->in_pos = stream->in_count = 0;
+    stream->eof = false;
+    stream->loop = false;
+    stream->read = stream->write = 0;
+    return stream;
+}
+
+static void hh2_closeStream(hh2_Stream* const stream) {
+    if (stream->resampler != NULL) {
+        hh2_releaseResampler(stream->resampler);
+    }
+
+    hh2_closeSource(&stream->source);
+    free(stream);
+}
+
+static size_t hh2_readStreamBlock(hh2_Stream* const stream) {
+    unsigned const channels = stream->channels;
+
+    if (stream->source.channels == channels) {
+        return hh2_readSource(&stream->source, stream->in, HH2_STREAM_BLOCK_FRAMES);
+    }
+
+    size_t const num_read = hh2_readSource(&stream->source, stream->frames, HH2_STREAM_BLOCK_FRAMES);
+    hh2_downmix(stream->in, channels, stream->frames, stream->source.channels, num_read);
+    return num_read;
+}
+
+// Decodes and resamples until the ring has at least needed frames, or the end of the WAV is reached
+static void hh2_fillStream(hh2_Stream* const stream, size_t const needed) {
+    unsigned const channels = stream->channels;
+
+    while (stream->write - stream->read < needed) {
+        if (stream->in_pos == stream->in_count) {
+            if (stream->eof) {
+                return;
+            }
+
+            size_t num_read = hh2_readStreamBlock(stream);
+
+            if (num_read == 0 && stream->loop && hh2_rewindSource(&stream->source)) {
+                // The resampler keeps its state so the loop point is seamless
+                num_read = hh2_readStreamBlock(stream);
+            }
+
+            if (num_read == 0) {
+                stream->eof = true;
+                return;
+            }
+
+            stream->in_pos = 0;
+            stream->in_count = num_read;
+        }
+
+        // Write directly into the contiguous free space of the ring
+        size_t const write_index = stream->write & (HH2_STREAM_RING_FRAMES - 1);
+        size_t const free_count = HH2_STREAM_RING_FRAMES - (stream->write - stream->read);
+        size_t const contiguous = HH2_STREAM_RING_FRAMES - write_index;
+
+        spx_uint32_t in_count = stream->in_count - stream->in_pos;
+        spx_uint32_t out_count = free_count < contiguous ? free_count : contiguous;
+
+        hh2_Sample const* const in = stream->in + stream->in_pos * channels;
+        hh2_Sample* const out = stream->ring + write_index * channels;
+
+        if (stream->resampler != NULL) {
+            speex_resampler_process_interleaved_int(stream->resampler, in, &in_count, out, &out_count);
+        }
+        else {
+            if (in_count < out_count) {
+                out_count = in_count;
+            }
+            else {
+                in_count = out_count;
+            }
+
+            memcpy(out, in, out_count * channels * sizeof(hh2_Sample));
+        }
+
+        stream->in_pos += in_count;
+        stream->write += out_count;
+    }
+}
+
+static void hh2_pushEvent(unsigned const index, uint16_t const generation, hh2_Stream* const stream) {
+    hh2_Event* const event = hh2_events + (hh2_eventWrite & (HH2_EVENT_QUEUE_SIZE - 1));
+    event->index = index;
+    event->generation = generation;
+    event->stream = stream;
+
+    HH2_ATOMIC_STORE(&hh2_eventWrite, hh2_eventWrite + 1);
+}
+
+static size_t hh2_eventSpace(void) {
+    return HH2_EVENT_QUEUE_SIZE - (hh2_eventWrite - HH2_ATOMIC_LOAD(&hh2_eventRead));
+}
+
+static void hh2_endMixerVoice(unsigned const index) {
+    hh2_MixerVoice* const voice = hh2_mixerVoices + index;
+
+    // Streams are closed on the API side, it owns the resampler pool
+    hh2_pushEvent(index, voice->generation, voice->stream);
+    voice->pcm = NULL;
+    voice->stream = NULL;
+
+    // Move the last active voice to the place of the ended one
+    unsigned const last = hh2_mixerActive[--hh2_mixerActiveCount];
+    hh2_mixerActive[voice->active_index] = last;
+    hh2_mixerVoices[last].active_index = voice->active_index;
+}
+
+static void hh2_runCommand(hh2_Command const* const command) {
+    hh2_MixerVoice* const voice = hh2_mixerVoices + command->index;
+
+    switch (command->type) {
+        case HH2_COMMAND_PLAY: {
+            if (voice->pcm != NULL) {
+                hh2_endMixerVoice(command->index);
+            }
+
+            voice->pcm = command->pcm;
+            voice->stream = command->stream;
+            voice->position = 0;
+            voice->gains[0] = command->gains[0];
+            voice->gains[1] = command->gains[1];
+            voice->loop = command->loop;
+            voice->generation = command->generation;
+            voice->active_index = hh2_mixerActiveCount;
+
+            hh2_mixerActive[hh2_mixerActiveCount++] = command->index;
+            break;
+        }
+
+        case HH2_COMMAND_STOP: {
+            if (voice->pcm != NULL && voice->generation == command->generation) {
+                hh2_endMixerVoice(command->index);
+            }
+
+            break;
+        }
+
+        case HH2_COMMAND_DESTROY_PCM: {
+            // The voices playing the PCM were stopped by earlier commands
+            free(command->pcm->path);
+            free(command->pcm);
+            break;
+        }
+    }
+}
+
+// Runs the queued commands, as long as there's room for the events they and the next mix can post
+static void hh2_runCommands(void) {
+    size_t const write = HH2_ATOMIC_LOAD(&hh2_commandWrite);
+
+    while (hh2_commandRead != write && hh2_eventSpace() > hh2_mixerActiveCount + 1) {
+        hh2_runCommand(hh2_commands + (hh2_commandRead & (HH2_COMMAND_QUEUE_SIZE - 1)));
+        HH2_ATOMIC_STORE(&hh2_commandRead, hh2_commandRead + 1);
+    }
+}
+
+static void hh2_freeSlot(unsigned const index) {
+    hh2_VoiceSlot* const slot = hh2_slots + index;
+
+    slot->pcm->voices--;
+    slot->pcm = NULL;
+
+    // Zero is never a valid generation, so no handle is ever HH2_INVALID_VOICE
+    if (++slot->generation == 0) {
+        slot->generation = 1;
+    }
+
+    unsigned const last = hh2_active[--hh2_activeCount];
+    hh2_active[slot->active_index] = last;
+    hh2_slots[last].active_index = slot->active_index;
+
+    hh2_free[hh2_freeCount++] = index;
+}
+
+static void hh2_handleEvents(void) {
+    size_t const write = HH2_ATOMIC_LOAD(&hh2_eventWrite);
+
+    while (hh2_eventRead != write) {
+        hh2_Event const* const event = hh2_events + (hh2_eventRead & (HH2_EVENT_QUEUE_SIZE - 1));
+
+        if (event->stream != NULL) {
+            hh2_closeStream(event->stream);
+        }
+
+        // The slot may have been stopped and reused already
+        hh2_VoiceSlot const* const slot = hh2_slots + event->index;
+
+        if (slot->pcm != NULL && slot->generation == event->generation) {
+            hh2_freeSlot(event->index);
+        }
+
+        HH2_ATOMIC_STORE(&hh2_eventRead, hh2_eventRead + 1);
+    }
+}
+
+#ifdef HH2_AUDIO_THREAD
+static void hh2_sleep(void) {
+    struct timespec const duration = {0, HH2_THREAD_SLEEP_NS};
+    nanosleep(&duration, NULL);
+}
+#endif
+
+static void hh2_sendCommand(hh2_Command const* const command) {
+    if (!hh2_threadRunning) {
+        // No audio thread, the mixer runs here
+        hh2_runCommand(command);
+        hh2_handleEvents();
+        return;
+    }
+
+#ifdef HH2_AUDIO_THREAD
+    while (hh2_commandWrite - HH2_ATOMIC_LOAD(&hh2_commandRead) == HH2_COMMAND_QUEUE_SIZE) {
+        // The audio thread empties the queue before each block, and needs room for its events to do so
+        hh2_handleEvents();
+        hh2_sleep();
+    }
+
+    hh2_commands[hh2_commandWrite & (HH2_COMMAND_QUEUE_SIZE - 1)] = *command;
+    HH2_ATOMIC_STORE(&hh2_commandWrite, hh2_commandWrite + 1);
+#endif
+}
+
+static hh2_VoiceSlot* hh2_findVoice(hh2_Voice const voice) {
+    unsigned const index = voice & 0xffff;
+
+    if (index >= hh2_capacity) {
+        return NULL;
+    }
+
+    hh2_VoiceSlot* const slot = hh2_slots + index;
+    return slot->pcm != NULL && slot->generation == voice >> 16 ? slot : NULL;
+}
+
+static void hh2_stopSlot(unsigned const index) {
+    hh2_Command command;
+    command.type = HH2_COMMAND_STOP;
+    command.index = index;
+    command.generation = hh2_slots[index].generation;
+
+    // Free the slot first, the event for the voice will only close its stream
+    hh2_freeSlot(index);
+    hh2_sendCommand(&command);
+}
+
+bool hh2_setMaxVoices(unsigned const count) {
+    if (count == 0 || count > HH2_MAX_VOICES) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "invalid number of voices %u, must be between 1 and %d", count, HH2_MAX_VOICES);
+        return false;
+    }
+
+    hh2_stopPcms();
+
+    for (unsigned i = 0; i < count; i++) {
+        if (hh2_slots[i].generation == 0) {
+            hh2_slots[i].generation = 1;
+        }
+
+        // Free slots are popped from the end, so the first slots are used first
+        hh2_free[i] = count - 1 - i;
+    }
+
+    hh2_capacity = count;
+    hh2_freeCount = count;
+    return true;
+}
+
 void hh2_destroyPcm(hh2_Pcm pcm) {
-    for (unsigned i = 0; i < HH2_MAX_VOICES; i++) {
-        if (hh2_voices[i].pcm == pcm) {
-            hh2_voices[i].pcm = NULL;
-            hh2_voices[i].position = 0;
+    hh2_handleEvents();
+
+    for (unsigned i = hh2_activeCount; pcm->voices != 0 && i-- != 0;) {
+        if (hh2_slots[hh2_active[i]].pcm == pcm) {
+            hh2_stopSlot(hh2_active[i]);
         }
     }
 
-    free(pcm);
+    // The mixer frees the PCM once it's done with the commands above
+    hh2_Command command;
+    command.type = HH2_COMMAND_DESTROY_PCM;
+    command.pcm = pcm;
+    hh2_sendCommand(&command);
 }
 
-bool hh2_playPcm(hh2_Pcm pcm) {
-    for (unsigned i = 0; i < HH2_MAX_VOICES; i++) {
-        if (hh2_voices[i].pcm == NULL) {
-            hh2_voices[i].pcm = pcm;
-            hh2_voices[i].position = 0;
-            return true;
+static int16_t hh2_gain(float const gain) {
+    float const clamped = gain < 0.0f ? 0.0f : gain > 1.0f ? 1.0f : gain;
+    return (int16_t)(clamped * HH2_GAIN_ONE + 0.5f);
+}
+
+// Finds the voice to steal, the one with the lowest priority that started first, if it's not above priority
+static bool hh2_findVictim(int const priority, unsigned* const index) {
+    bool found = false;
+
+    for (unsigned i = 0; i < hh2_activeCount; i++) {
+        hh2_VoiceSlot const* const slot = hh2_slots + hh2_active[i];
+
+        if (slot->priority > priority) {
+            continue;
+        }
+
+        if (found) {
+            hh2_VoiceSlot const* const victim = hh2_slots + *index;
+
+            if (slot->priority > victim->priority ||
+                (slot->priority == victim->priority && slot->sequence - victim->sequence < UINT32_C(0x80000000))) {
+
+                continue;
+            }
         }
+
+        *index = hh2_active[i];
+        found = true;
     }
 
-    return false;
+    return found;
+}
+
+hh2_Voice hh2_playPcm(hh2_Pcm pcm, float const volume, float const pan, bool const loop, int const priority) {
+    if (hh2_capacity == 0 && !hh2_setMaxVoices(HH2_DEFAULT_VOICES)) {
+        // Error already logged
+        return HH2_INVALID_VOICE;
+    }
+
+    hh2_handleEvents();
+    unsigned victim = 0;
+
+    if (hh2_freeCount == 0 && !hh2_findVictim(priority, &victim)) {
+        // All voices are playing sounds with higher priorities
+        return HH2_INVALID_VOICE;
+    }
+
+    hh2_Stream* stream = NULL;
+
+    if (pcm->path != NULL) {
+        stream = hh2_openStream(pcm);
+
+        if (stream == NULL) {
+            // Error already logged
+            return HH2_INVALID_VOICE;
+        }
+
+        stream->loop = loop;
+    }
+
+    if (hh2_freeCount == 0) {
+        hh2_stopSlot(victim);
+    }
+
+    unsigned const index = hh2_free[--hh2_freeCount];
+    hh2_VoiceSlot* const slot = hh2_slots + index;
+
+    slot->pcm = pcm;
+    slot->priority = priority;
+    slot->sequence = hh2_sequence++;
+    slot->active_index = hh2_activeCount;
+
+    hh2_active[hh2_activeCount++] = index;
+    pcm->voices++;
+
+    // Balance panning, center plays both channels at the full volume
+    float const left = pan > 0.0f ? 1.0f - pan : 1.0f;
+    float const right = pan < 0.0f ? 1.0f + pan : 1.0f;
+
+    hh2_Command command;
+    command.type = HH2_COMMAND_PLAY;
+    command.index = index;
+    command.generation = slot->generation;
+    command.pcm = pcm;
+    command.stream = stream;
+    command.gains[0] = hh2_gain(volume * left);
+    command.gains[1] = hh2_gain(volume * right);
+    command.loop = loop;
+    hh2_sendCommand(&command);
+
+    return (hh2_Voice)slot->generation << 16 | index;
+}
+
+void hh2_stopVoice(hh2_Voice const voice) {
+    hh2_handleEvents();
+    hh2_VoiceSlot const* const slot = hh2_findVoice(voice);
+
+    if (slot != NULL) {
+        hh2_stopSlot((unsigned)(slot - hh2_slots));
+    }
+}
+
+bool hh2_isVoicePlaying(hh2_Voice const voice) {
+    hh2_handleEvents();
+    return hh2_findVoice(voice) != NULL;
 }
 
 void hh2_stopPcms(void) {
-    for (unsigned i = 0; i < HH2_MAX_VOICES; i++) {
-        hh2_voices[i].pcm = NULL;
-        hh2_voices[i].position = 0;
+    hh2_handleEvents();
+
+    while (hh2_activeCount != 0) {
+        hh2_stopSlot(hh2_active[hh2_activeCount - 1]);
     }
 }
 
-static void hh2_mixPcm(int32_t* const buffer, hh2_Voice* const voice) {
-    size_t const buffer_free = HH2_SAMPLES_PER_VIDEO_FRAME;
-    hh2_Pcm const pcm = voice->pcm;
+// Adds count mono samples, scaled by the left and right gains, to the interleaved stereo buffer
+static void hh2_mixMono(
+    int32_t* buffer, hh2_Sample const* const samples, size_t const count, int16_t const left, int16_t const right) {
 
-    size_t const available = pcm->sample_count - voice->position;
-    hh2_Sample const* const sample = pcm->samples + voice->position;
+    size_t i = 0;
 
-    if (available < buffer_free) {
-        for (size_t i = 0; i < available; i++) {
-            buffer[i] += sample[i];
-        }
+#if defined(HH2_MIX_SSE2)
+    __m128i const gains = _mm_set_epi16(right, left, right, left, right, left, right, left);
+
+    for (; i + 8 <= count; i += 8, buffer += 16) {
+        __m128i const mono = _mm_loadu_si128((__m128i const*)(samples + i));
+
+        // Duplicate each sample to get L0 R0 L1 R1..., multiply by the gains keeping the 32-bit products
+        __m128i const dup_lo = _mm_unpacklo_epi16(mono, mono);
+        __m128i const dup_hi = _mm_unpackhi_epi16(mono, mono);
+        __m128i const prod_lo_lo = _mm_mullo_epi16(dup_lo, gains);
+        __m128i const prod_lo_hi = _mm_mulhi_epi16(dup_lo, gains);
+        __m128i const prod_hi_lo = _mm_mullo_epi16(dup_hi, gains);
+        __m128i const prod_hi_hi = _mm_mulhi_epi16(dup_hi, gains);
+
+        __m128i const s0 = _mm_srai_epi32(_mm_unpacklo_epi16(prod_lo_lo, prod_lo_hi), HH2_GAIN_SHIFT);
+        __m128i const s1 = _mm_srai_epi32(_mm_unpackhi_epi16(prod_lo_lo, prod_lo_hi), HH2_GAIN_SHIFT);
+        __m128i const s2 = _mm_srai_epi32(_mm_unpacklo_epi16(prod_hi_lo, prod_hi_hi), HH2_GAIN_SHIFT);
+        __m128i const s3 = _mm_srai_epi32(_mm_unpackhi_epi16(prod_hi_lo, prod_hi_hi), HH2_GAIN_SHIFT);
+
+        __m128i* const acc = (__m128i*)buffer;
+        _mm_storeu_si128(acc + 0, _mm_add_epi32(_mm_loadu_si128(acc + 0), s0));
+        _mm_storeu_si128(acc + 1, _mm_add_epi32(_mm_loadu_si128(acc + 1), s1));
+        _mm_storeu_si128(acc + 2, _mm_add_epi32(_mm_loadu_si128(acc + 2), s2));
+        _mm_storeu_si128(acc + 3, _mm_add_epi32(_mm_loadu_si128(acc + 3), s3));
+    }
+#elif defined(HH2_MIX_NEON)
+    int16_t const gain_array[4] = {left, right, left, right};
+    int16x4_t const gains = vld1_s16(gain_array);
+
+    for (; i + 4 <= count; i += 4, buffer += 8) {
+        int16x4_t const mono = vld1_s16(samples + i);
 
-        voice->pcm = NULL;
-        voice->position = 0;
+        // Duplicate each sample to get L0 R0 L1 R1..., vmull_s16 gives the 32-bit products
+        int16x4x2_t const dup = vzip_s16(mono, mono);
+        int32x4_t const s0 = vshrq_n_s32(vmull_s16(dup.val[0], gains), HH2_GAIN_SHIFT);
+        int32x4_t const s1 = vshrq_n_s32(vmull_s16(dup.val[1], gains), HH2_GAIN_SHIFT);
+
+        vst1q_s32(buffer + 0, vaddq_s32(vld1q_s32(buffer + 0), s0));
+        vst1q_s32(buffer + 4, vaddq_s32(vld1q_s32(buffer + 4), s1));
+    }
+#endif
+
+    for (; i < count; i++, buffer += 2) {
+        int32_t const sample = samples[i];
+        buffer[0] += (sample * left) >> HH2_GAIN_SHIFT;
+        buffer[1] += (sample * right) >> HH2_GAIN_SHIFT;
+    }
+}
+
+// Adds count interleaved stereo frames, scaled by the left and right gains, to the interleaved stereo buffer
+static void hh2_mixStereo(
+    int32_t* buffer, hh2_Sample const* samples, size_t const count, int16_t const left, int16_t const right) {
+
+    size_t i = 0;
+
+#if defined(HH2_MIX_SSE2)
+    __m128i const gains = _mm_set_epi16(right, left, right, left, right, left, right, left);
+
+    for (; i + 4 <= count; i += 4, samples += 8, buffer += 8) {
+        __m128i const stereo = _mm_loadu_si128((__m128i const*)samples);
+        __m128i const prod_lo = _mm_mullo_epi16(stereo, gains);
+        __m128i const prod_hi = _mm_mulhi_epi16(stereo, gains);
+
+        __m128i const s0 = _mm_srai_epi32(_mm_unpacklo_epi16(prod_lo, prod_hi), HH2_GAIN_SHIFT);
+        __m128i const s1 = _mm_srai_epi32(_mm_unpackhi_epi16(prod_lo, prod_hi), HH2_GAIN_SHIFT);
+
+        __m128i* const acc = (__m128i*)buffer;
+        _mm_storeu_si128(acc + 0, _mm_add_epi32(_mm_loadu_si128(acc + 0), s0));
+        _mm_storeu_si128(acc + 1, _mm_add_epi32(_mm_loadu_si128(acc + 1), s1));
+    }
+#elif defined(HH2_MIX_NEON)
+    int16_t const gain_array[4] = {left, right, left, right};
+    int16x4_t const gains = vld1_s16(gain_array);
+
+    for (; i + 4 <= count; i += 4, samples += 8, buffer += 8) {
+        int16x8_t const stereo = vld1q_s16(samples);
+        int32x4_t const s0 = vshrq_n_s32(vmull_s16(vget_low_s16(stereo), gains), HH2_GAIN_SHIFT);
+        int32x4_t const s1 = vshrq_n_s32(vmull_s16(vget_high_s16(stereo), gains), HH2_GAIN_SHIFT);
+
+        vst1q_s32(buffer + 0, vaddq_s32(vld1q_s32(buffer + 0), s0));
+        vst1q_s32(buffer + 4, vaddq_s32(vld1q_s32(buffer + 4), s1));
+    }
+#endif
+
+    for (; i < count; i++, samples += 2, buffer += 2) {
+        buffer[0] += ((int32_t)samples[0] * left) >> HH2_GAIN_SHIFT;
+        buffer[1] += ((int32_t)samples[1] * right) >> HH2_GAIN_SHIFT;
+    }
+}
+
+static void hh2_mixSamples(
+    int32_t* const buffer, hh2_Sample const* const samples, unsigned const channels, size_t const count,
+    int16_t const left, int16_t const right) {
+
+    if (channels == 1) {
+        hh2_mixMono(buffer, samples, count, left, right);
     }
     else {
-        for (size_t i = 0; i < buffer_free; i++) {
-            buffer[i] += sample[i];
+        hh2_mixStereo(buffer, samples, count, left, right);
+    }
+}
+
+// Clamps the interleaved stereo buffer to 16 bits
+static void hh2_packSamples(int16_t* const frames, int32_t const* const buffer, size_t const count) {
+    size_t i = 0;
+
+#if defined(HH2_MIX_SSE2)
+    for (; i + 8 <= count; i += 8) {
+        __m128i const s0 = _mm_loadu_si128((__m128i const*)(buffer + i));
+        __m128i const s1 = _mm_loadu_si128((__m128i const*)(buffer + i + 4));
+        _mm_storeu_si128((__m128i*)(frames + i), _mm_packs_epi32(s0, s1));
+    }
+#elif defined(HH2_MIX_NEON)
+    for (; i + 8 <= count; i += 8) {
+        int16x4_t const s0 = vqmovn_s32(vld1q_s32(buffer + i));
+        int16x4_t const s1 = vqmovn_s32(vld1q_s32(buffer + i + 4));
+        vst1q_s16(frames + i, vcombine_s16(s0, s1));
+    }
+#endif
+
+    for (; i < count; i++) {
+        int32_t const s32 = buffer[i];
+        frames[i] = s32 < -32768 ? -32768 : s32 > 32767 ? 32767 : s32;
+    }
+}
+
+// Returns false when the voice has finished playing
+static bool hh2_mixStream(int32_t* const buffer, size_t const needed, hh2_MixerVoice* const voice) {
+    hh2_Stream* const stream = voice->stream;
+    unsigned const channels = stream->channels;
+
+    hh2_fillStream(stream, needed);
+
+    size_t const available = stream->write - stream->read;
+    size_t const count = available < needed ? available : needed;
+
+    // The frames can wrap around the end of the ring
+    size_t const read_index = stream->read & (HH2_STREAM_RING_FRAMES - 1);
+    size_t const contiguous = HH2_STREAM_RING_FRAMES - read_index;
+    size_t const first = count < contiguous ? count : contiguous;
+
+    int16_t const left = voice->gains[0], right = voice->gains[1];
+    hh2_mixSamples(buffer, stream->ring + read_index * channels, channels, first, left, right);
+    hh2_mixSamples(buffer + first * 2, stream->ring, channels, count - first, left, right);
+    stream->read += count;
+
+    // The stream only runs short at the end of the WAV
+    return count == needed;
+}
+
+// Returns false when the voice has finished playing
+static bool hh2_mixPcm(int32_t* buffer, size_t buffer_free, hh2_MixerVoice* const voice) {
+    hh2_Pcm const pcm = voice->pcm;
+
+    while (buffer_free != 0) {
+        size_t const available = pcm->frame_count - voice->position;
+        size_t const count = available < buffer_free ? available : buffer_free;
+        hh2_Sample const* const samples = pcm->samples + voice->position * pcm->channels;
+
+        hh2_mixSamples(buffer, samples, pcm->channels, count, voice->gains[0], voice->gains[1]);
+
+        buffer += count * 2;
+        buffer_free -= count;
+        voice->position += count;
+
+        if (voice->position == pcm->frame_count) {
+            if (!voice->loop || pcm->frame_count == 0) {
+                return false;
+            }
+
+            voice->position = 0;
         }
+    }
+
+    return true;
+}
+
+static void hh2_mixVoices(int32_t* const buffer, size_t const count) {
+    memset(buffer, 0, count * 2 * sizeof(buffer[0]));
+
+    // Go backwards so ending a voice, which moves the last active voice to its place, doesn't skip any
+    for (unsigned i = hh2_mixerActiveCount; i-- != 0;) {
+        unsigned const index = hh2_mixerActive[i];
+        hh2_MixerVoice* const voice = hh2_mixerVoices + index;
+
+        bool const playing = voice->stream != NULL ?
+                             hh2_mixStream(buffer, count, voice) :
+                             hh2_mixPcm(buffer, count, voice);
 
-        voice->position += buffer_free;
+        if (!playing) {
+            hh2_endMixerVoice(index);
+        }
     }
 }
 
-int16_t const* hh2_soundMix(size_t* const frames) {
-    int32_t buffer[HH2_SAMPLES_PER_VIDEO_FRAME];
+#ifdef HH2_AUDIO_THREAD
+static void* hh2_audioThread(void* const userdata) {
+    (void)userdata;
+
+    while (!HH2_ATOMIC_LOAD(&hh2_threadQuit)) {
+        hh2_runCommands();
 
-    memset(buffer, 0, sizeof(buffer));
+        size_t const queued = hh2_ringWrite - HH2_ATOMIC_LOAD(&hh2_ringRead);
 
-    for (unsigned i = 0; i < HH2_MAX_VOICES; i++) {
-        if (hh2_voices[i].pcm) {
-            hh2_mixPcm(buffer, hh2_voices + i);
+        if (queued + HH2_THREAD_BLOCK_FRAMES > HH2_THREAD_FILL_FRAMES || hh2_eventSpace() < hh2_mixerActiveCount) {
+            hh2_sleep();
+            continue;
         }
+
+        int32_t buffer[HH2_THREAD_BLOCK_FRAMES * 2];
+        hh2_mixVoices(buffer, HH2_THREAD_BLOCK_FRAMES);
+
+        size_t const write_index = hh2_ringWrite & (HH2_THREAD_RING_FRAMES - 1);
+        hh2_packSamples(hh2_ring + write_index * 2, buffer, HH2_THREAD_BLOCK_FRAMES * 2);
+        HH2_ATOMIC_STORE(&hh2_ringWrite, hh2_ringWrite + HH2_THREAD_BLOCK_FRAMES);
     }
 
-    for (size_t i = 0, j = 0; i < HH2_SAMPLES_PER_VIDEO_FRAME; i++, j += 2) {
-        int32_t const s32 = buffer[i];
-        int16_t const s16 = s32 < -32768 ? -32768 : s32 > 32767 ? 32767 : s32;
+    return NULL;
+}
+#endif
 
-        hh2_audioFrames[j] = s16;
-        hh2_audioFrames[j + 1] = s16;
+bool hh2_startAudioThread(void) {
+#ifdef HH2_AUDIO_THREAD
+    if (hh2_threadRunning) {
+        return true;
     }
 
-    *frames = HH2_SAMPLES_PER_VIDEO_FRAME;
+    hh2_ringRead = hh2_ringWrite = 0;
+    hh2_threadQuit = false;
+
+    int const error = pthread_create(&hh2_thread, NULL, hh2_audioThread, NULL);
+
+    if (error != 0) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "error creating the audio thread: %s", strerror(error));
+        return false;
+    }
+
+    HH2_LOG(HH2_LOG_INFO, TAG "mixing in the audio thread");
+    hh2_threadRunning = true;
+    return true;
+#else
+    HH2_LOG(HH2_LOG_WARN, TAG "audio thread not available, compile with HH2_AUDIO_THREAD to enable it");
+    return false;
+#endif
+}
+
+void hh2_stopAudioThread(void) {
+#ifdef HH2_AUDIO_THREAD
+    if (!hh2_threadRunning) {
+        return;
+    }
+
+    HH2_ATOMIC_STORE(&hh2_threadQuit, true);
+    pthread_join(hh2_thread, NULL);
+    hh2_threadRunning = false;
+
+    // Run the commands that the thread didn't get to, the mixer runs here from now on
+    while (hh2_commandRead != hh2_commandWrite) {
+        hh2_runCommands();
+        hh2_handleEvents();
+    }
+#endif
+}
+
+size_t hh2_soundRead(int16_t* const frames, size_t const count) {
+    size_t const available = HH2_ATOMIC_LOAD(&hh2_ringWrite) - hh2_ringRead;
+    size_t const total = available < count ? available : count;
+
+    // The frames can wrap around the end of the ring
+    size_t const read_index = hh2_ringRead & (HH2_THREAD_RING_FRAMES - 1);
+    size_t const contiguous = HH2_THREAD_RING_FRAMES - read_index;
+    size_t const first = total < contiguous ? total : contiguous;
+
+    memcpy(frames, hh2_ring + read_index * 2, first * 2 * sizeof(int16_t));
+    memcpy(frames + first * 2, hh2_ring, (total - first) * 2 * sizeof(int16_t));
+
+    HH2_ATOMIC_STORE(&hh2_ringRead, hh2_ringRead + total);
+    return total;
+}
+
+void hh2_soundUpdate(void) {
+    hh2_handleEvents();
+}
+
+int16_t const* hh2_soundMix(size_t* const frames) {
+    // Carry the remainder over so that, on average, each video frame gets exactly hh2_sampleRate / 60 frames
+    hh2_frameRemainder += hh2_sampleRate;
+    size_t const count = hh2_frameRemainder / HH2_VIDEO_FPS;
+    hh2_frameRemainder %= HH2_VIDEO_FPS;
+
+    if (hh2_threadRunning) {
+        size_t const available = hh2_soundRead(hh2_audioFrames, count);
+
+        // The audio thread fell behind, fill with silence
+        memset(hh2_audioFrames + available * 2, 0, (count - available) * 2 * sizeof(int16_t));
+    }
+    else {
+        int32_t buffer[HH2_MAX_FRAMES_PER_VIDEO_FRAME * 2];
+        hh2_mixVoices(buffer, count);
+        hh2_packSamples(hh2_audioFrames, buffer, count * 2);
+    }
+
+    hh2_handleEvents();
+
+    *frames = count;
     return hh2_audioFrames;
 }
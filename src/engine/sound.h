@@ -7,12 +7,43 @@
 
 typedef struct hh2_Pcm* hh2_Pcm;
 
-hh2_Pcm hh2_readPcm(hh2_Filesys filesys, char const* path);
+// Voices are handles to PCMs being played, they become invalid when the PCM stops playing
+typedef uint32_t hh2_Voice;
+
+#define HH2_INVALID_VOICE 0
+
+// Sets the rate of the mixed audio, PCMs are resampled to it when read so it must be set before reading any
+void hh2_setMixRate(unsigned rate);
+unsigned hh2_mixRate(void);
+
+// PCMs longer than the threshold are decoded while they play, filesys must outlive them
+void hh2_setStreamThreshold(float seconds);
+
+// Mono WAVs stay mono, others are kept as stereo or, if downmix is true, mixed down to mono
+hh2_Pcm hh2_readPcm(hh2_Filesys filesys, char const* path, bool downmix);
 void hh2_destroyPcm(hh2_Pcm pcm);
 
-bool hh2_playPcm(hh2_Pcm pcm);
+// Stops all voices and changes how many PCMs can play at the same time, the default is 16
+bool hh2_setMaxVoices(unsigned count);
+
+// volume goes from 0.0 (silence) to 1.0, and pan from -1.0 (left) to 1.0 (right). When all voices are busy, the
+// one with the lowest priority that started first is stopped, but only if its priority isn't above priority
+hh2_Voice hh2_playPcm(hh2_Pcm pcm, float volume, float pan, bool loop, int priority);
+void hh2_stopVoice(hh2_Voice voice);
+bool hh2_isVoicePlaying(hh2_Voice voice);
 void hh2_stopPcms(void);
 
+// Mixes in a separate thread, mixing and voice commands are then handed over through lock-free queues. Only
+// available when compiled with HH2_AUDIO_THREAD
+bool hh2_startAudioThread(void);
+void hh2_stopAudioThread(void);
+
+// Returns the frames for one video frame, from the audio thread if it's running
 int16_t const* hh2_soundMix(size_t* const frames);
 
+// With the audio thread running, hh2_soundRead can be used by a single other thread instead of hh2_soundMix to get
+// up to count frames, and hh2_soundUpdate must then be called once per video frame to process voices that ended
+size_t hh2_soundRead(int16_t* frames, size_t count);
+void hh2_soundUpdate(void);
+
 #endif // HH2_SOUND_H__
@@ -4,9 +4,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef HH2_SPRITE_THREADS
+    #include <pthread.h>
+#endif
+
 #define TAG "SPT "
 
 #define HH2_MIN_SPRITES 64
+#define HH2_MAX_SPRITE_THREADS 16
 
 typedef enum {
     HH2_SPRITE_INVISIBLE = 0x4000U,
@@ -16,9 +21,22 @@ typedef enum {
 }
 hh2_SpriteFlags;
 
+typedef struct {
+    hh2_Image image;
+    int x, y;  // Relative to the sprite position
+    size_t bg; // Offset of this image's saved pixels in the sprite's bg
+}
+hh2_Member;
+
 struct hh2_Sprite {
     hh2_Image image;
-    hh2_RGB565* bg;
+    hh2_RGB565* bg; // NULL when using the background layer
+    size_t bg_capacity;
+
+    // Images drawn in order as a single sprite, i.e. the glyphs of a text, only used when image is NULL
+    hh2_Member* members;
+    unsigned member_count;
+    unsigned member_capacity;
 
     int x;
     int y;
@@ -31,6 +49,31 @@ static size_t hh2_spriteCount = 0;
 static size_t hh2_reservedSprites = 0;
 static size_t hh2_visibleSpriteCount = 0;
 
+// When set, the canvas is restored from it instead of from what was saved under each sprite
+static hh2_Canvas hh2_backgroundLayer = NULL;
+
+// The canvas is split in this many horizontal bands, the first one is composed by the calling thread
+static unsigned hh2_bandCount = 1;
+
+#ifdef HH2_SPRITE_THREADS
+typedef struct {
+    pthread_t thread;
+    unsigned band;
+    unsigned generation; // the last work generation this worker saw
+}
+hh2_SpriteWorker;
+
+static hh2_SpriteWorker hh2_workers[HH2_MAX_SPRITE_THREADS - 1];
+static pthread_mutex_t hh2_workMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t hh2_workStart = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t hh2_workDone = PTHREAD_COND_INITIALIZER;
+static unsigned hh2_workGeneration = 0;
+static unsigned hh2_workPending = 0;
+static bool hh2_workQuit = false;
+static hh2_Canvas hh2_workCanvas;
+static bool hh2_workUnblit;
+#endif
+
 hh2_Sprite hh2_createSprite(void) {
     hh2_Sprite sprite = (hh2_Sprite)malloc(sizeof(*sprite));
 
@@ -55,6 +98,9 @@ hh2_Sprite hh2_createSprite(void) {
 
     sprite->image = NULL;
     sprite->bg = NULL;
+    sprite->bg_capacity = 0;
+    sprite->members = NULL;
+    sprite->member_count = sprite->member_capacity = 0;
     sprite->x = sprite->y = 0;
     sprite->flags = HH2_SPRITE_INVISIBLE;
 
@@ -75,15 +121,33 @@ void hh2_setLayer(hh2_Sprite const sprite, unsigned const layer) {
     sprite->flags = (sprite->flags & HH2_SPRITE_FLAGS) | (layer & HH2_SPRITE_LAYER);
 }
 
+static bool hh2_hasPixels(hh2_Sprite const sprite) {
+    return sprite->image != NULL || sprite->members != NULL;
+}
+
+static size_t hh2_spriteChangedPixels(hh2_Sprite const sprite) {
+    if (sprite->image != NULL) {
+        return hh2_changedPixels(sprite->image);
+    }
+
+    size_t count = 0;
+
+    for (unsigned i = 0; i < sprite->member_count; i++) {
+        count += hh2_changedPixels(sprite->members[i].image);
+    }
+
+    return count;
+}
+
 bool hh2_setImage(hh2_Sprite const sprite, hh2_Image const image) {
-    if (image == sprite->image) {
+    if (image == sprite->image && sprite->members == NULL) {
         return true;
     }
 
     hh2_RGB565* bg = NULL;
+    size_t const count = image != NULL && hh2_backgroundLayer == NULL ? hh2_changedPixels(image) : 0;
 
-    if (image != NULL) {
-        size_t const count = hh2_changedPixels(image);
+    if (image != NULL && hh2_backgroundLayer == NULL) {
         bg = (hh2_RGB565*)malloc(count * sizeof(*sprite->bg));
 
         if (bg == NULL) {
@@ -93,9 +157,127 @@ bool hh2_setImage(hh2_Sprite const sprite, hh2_Image const image) {
     }
 
     free(sprite->bg);
+    free(sprite->members);
 
     sprite->image = image;
     sprite->bg = bg;
+    sprite->bg_capacity = count;
+    sprite->members = NULL;
+    sprite->member_count = sprite->member_capacity = 0;
+    return true;
+}
+
+static bool hh2_reserveMembers(hh2_Sprite const sprite, unsigned const count, size_t const bg_size) {
+    // Reuse the buffers when they're large enough, so changing a text doesn't allocate memory
+    hh2_Member* members = sprite->members;
+    hh2_RGB565* bg = sprite->bg;
+
+    if (count > sprite->member_capacity) {
+        members = (hh2_Member*)malloc(count * sizeof(*members));
+
+        if (members == NULL) {
+            HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+            return false;
+        }
+    }
+
+    if (hh2_backgroundLayer == NULL && bg_size > sprite->bg_capacity) {
+        bg = (hh2_RGB565*)malloc(bg_size * sizeof(*bg));
+
+        if (bg == NULL) {
+            HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+
+            if (members != sprite->members) {
+                free(members);
+            }
+
+            return false;
+        }
+    }
+
+    if (members != sprite->members) {
+        free(sprite->members);
+        sprite->members = members;
+        sprite->member_capacity = count;
+    }
+
+    if (bg != sprite->bg) {
+        free(sprite->bg);
+        sprite->bg = bg;
+        sprite->bg_capacity = bg_size;
+    }
+
+    sprite->image = NULL;
+    sprite->member_count = count;
+    return true;
+}
+
+static void hh2_setMember(
+    hh2_Sprite const sprite, unsigned const index, hh2_Image const image, int const x, int const y) {
+
+    hh2_Member* const member = sprite->members + index;
+
+    member->image = image;
+    member->x = x;
+    member->y = y;
+    member->bg = index == 0 ? 0 : member[-1].bg + hh2_changedPixels(member[-1].image);
+}
+
+bool hh2_setRun(
+    hh2_Sprite const sprite, hh2_Atlas const atlas, unsigned const* const indices, int const* const xs,
+    unsigned const count) {
+
+    if (count == 0) {
+        return hh2_setImage(sprite, NULL);
+    }
+
+    unsigned const atlas_count = hh2_atlasCount(atlas);
+    size_t bg_size = 0;
+
+    for (unsigned i = 0; i < count; i++) {
+        if (indices[i] >= atlas_count) {
+            HH2_LOG(HH2_LOG_ERROR, TAG "invalid atlas index %u, atlas has %u images", indices[i], atlas_count);
+            return false;
+        }
+
+        bg_size += hh2_changedPixels(hh2_atlasImage(atlas, indices[i]));
+    }
+
+    if (!hh2_reserveMembers(sprite, count, bg_size)) {
+        // Error already logged
+        return false;
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+        hh2_setMember(sprite, i, hh2_atlasImage(atlas, indices[i]), xs[i], 0);
+    }
+
+    return true;
+}
+
+bool hh2_setGroup(
+    hh2_Sprite const sprite, hh2_Image const* const images, int const* const xs, int const* const ys,
+    unsigned const count) {
+
+    if (count == 0) {
+        return hh2_setImage(sprite, NULL);
+    }
+
+    size_t bg_size = 0;
+
+    for (unsigned i = 0; i < count; i++) {
+        bg_size += hh2_changedPixels(images[i]);
+    }
+
+    if (!hh2_reserveMembers(sprite, count, bg_size)) {
+        // Error already logged
+        return false;
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+        hh2_setMember(sprite, i, images[i], xs[i], ys[i]);
+    }
+
     return true;
 }
 
@@ -107,8 +289,8 @@ static int hh2_compareSprites(void const* e1, void const* e2) {
     hh2_Sprite const s1 = *(hh2_Sprite*)e1;
     hh2_Sprite const s2 = *(hh2_Sprite*)e2;
 
-    uint16_t const f1 = s1->flags | (HH2_SPRITE_INVISIBLE * (s1->image == NULL));
-    uint16_t const f2 = s2->flags | (HH2_SPRITE_INVISIBLE * (s2->image == NULL));
+    uint16_t const f1 = s1->flags | (HH2_SPRITE_INVISIBLE * !hh2_hasPixels(s1));
+    uint16_t const f2 = s2->flags | (HH2_SPRITE_INVISIBLE * !hh2_hasPixels(s2));
 
     if (f1 == f2) {
         return 0;
@@ -121,6 +303,259 @@ static int hh2_compareSprites(void const* e1, void const* e2) {
     }
 }
 
+static void hh2_blitSpriteBand(
+    hh2_Sprite const sprite, hh2_Canvas const canvas, unsigned const top, unsigned const bottom) {
+
+    if (sprite->image != NULL) {
+        hh2_blitBand(sprite->image, canvas, sprite->x, sprite->y, sprite->bg, top, bottom);
+        return;
+    }
+
+    for (unsigned i = 0; i < sprite->member_count; i++) {
+        hh2_Member const* const m = sprite->members + i;
+        hh2_blitBand(m->image, canvas, sprite->x + m->x, sprite->y + m->y, sprite->bg + m->bg, top, bottom);
+    }
+}
+
+static void hh2_unblitSpriteBand(
+    hh2_Sprite const sprite, hh2_Canvas const canvas, unsigned const top, unsigned const bottom) {
+
+    if (sprite->image != NULL) {
+        hh2_unblitBand(sprite->image, canvas, sprite->x, sprite->y, sprite->bg, top, bottom);
+        return;
+    }
+
+    // Members can overlap, restore them in reverse order too
+    for (unsigned i = sprite->member_count; i-- != 0;) {
+        hh2_Member const* const m = sprite->members + i;
+        hh2_unblitBand(m->image, canvas, sprite->x + m->x, sprite->y + m->y, sprite->bg + m->bg, top, bottom);
+    }
+}
+
+static void hh2_stampSpriteBand(
+    hh2_Sprite const sprite, hh2_Canvas const canvas, unsigned const top, unsigned const bottom) {
+
+    if (sprite->image != NULL) {
+        hh2_stampBand(sprite->image, canvas, sprite->x, sprite->y, top, bottom);
+        return;
+    }
+
+    for (unsigned i = 0; i < sprite->member_count; i++) {
+        hh2_Member const* const m = sprite->members + i;
+        hh2_stampBand(m->image, canvas, sprite->x + m->x, sprite->y + m->y, top, bottom);
+    }
+}
+
+static void hh2_restoreImageBand(
+    hh2_Image const image, hh2_Canvas const canvas, int const x, int const y, unsigned const top,
+    unsigned const bottom) {
+
+    int const y0 = y > (int)top ? y : (int)top;
+    int const y1 = y + (int)hh2_imageHeight(image);
+    int const clipped_y1 = y1 < (int)bottom ? y1 : (int)bottom;
+
+    if (clipped_y1 > y0) {
+        hh2_copyCanvasRect(canvas, hh2_backgroundLayer, x, y0, hh2_imageWidth(image), clipped_y1 - y0);
+    }
+}
+
+static void hh2_restoreSpriteBand(
+    hh2_Sprite const sprite, hh2_Canvas const canvas, unsigned const top, unsigned const bottom) {
+
+    if (sprite->image != NULL) {
+        hh2_restoreImageBand(sprite->image, canvas, sprite->x, sprite->y, top, bottom);
+        return;
+    }
+
+    for (unsigned i = 0; i < sprite->member_count; i++) {
+        hh2_Member const* const m = sprite->members + i;
+        hh2_restoreImageBand(m->image, canvas, sprite->x + m->x, sprite->y + m->y, top, bottom);
+    }
+}
+
+static void hh2_composeBand(hh2_Canvas const canvas, unsigned const band, bool const unblit) {
+    unsigned const height = hh2_canvasHeight(canvas);
+    unsigned const top = height * band / hh2_bandCount;
+    unsigned const bottom = height * (band + 1) / hh2_bandCount;
+
+    if (hh2_backgroundLayer != NULL) {
+        if (!unblit) {
+            for (size_t i = 0; i < hh2_visibleSpriteCount; i++) {
+                hh2_stampSpriteBand(hh2_sprites[i], canvas, top, bottom);
+            }
+        }
+        else {
+            // Sprites are all blitted again, so any order will do
+            for (size_t i = 0; i < hh2_visibleSpriteCount; i++) {
+                hh2_restoreSpriteBand(hh2_sprites[i], canvas, top, bottom);
+            }
+        }
+    }
+    else if (!unblit) {
+        for (size_t i = 0; i < hh2_visibleSpriteCount; i++) {
+            hh2_blitSpriteBand(hh2_sprites[i], canvas, top, bottom);
+        }
+    }
+    else {
+        // Restore the backgrounds in the reverse order they were saved
+        for (size_t i = hh2_visibleSpriteCount; i-- != 0;) {
+            hh2_unblitSpriteBand(hh2_sprites[i], canvas, top, bottom);
+        }
+    }
+}
+
+#ifdef HH2_SPRITE_THREADS
+static void* hh2_spriteWorker(void* const userdata) {
+    hh2_SpriteWorker* const worker = (hh2_SpriteWorker*)userdata;
+
+    pthread_mutex_lock(&hh2_workMutex);
+
+    for (;;) {
+        while (worker->generation == hh2_workGeneration && !hh2_workQuit) {
+            pthread_cond_wait(&hh2_workStart, &hh2_workMutex);
+        }
+
+        if (hh2_workQuit) {
+            break;
+        }
+
+        worker->generation = hh2_workGeneration;
+        pthread_mutex_unlock(&hh2_workMutex);
+
+        // Bands don't overlap, so each worker has its rows of the canvas to itself
+        hh2_composeBand(hh2_workCanvas, worker->band, hh2_workUnblit);
+
+        pthread_mutex_lock(&hh2_workMutex);
+
+        if (--hh2_workPending == 0) {
+            pthread_cond_signal(&hh2_workDone);
+        }
+    }
+
+    pthread_mutex_unlock(&hh2_workMutex);
+    return NULL;
+}
+
+static void hh2_stopSpriteWorkers(void) {
+    pthread_mutex_lock(&hh2_workMutex);
+    hh2_workQuit = true;
+    pthread_cond_broadcast(&hh2_workStart);
+    pthread_mutex_unlock(&hh2_workMutex);
+
+    for (unsigned i = 0; i < hh2_bandCount - 1; i++) {
+        pthread_join(hh2_workers[i].thread, NULL);
+    }
+
+    hh2_workQuit = false;
+    hh2_bandCount = 1;
+}
+#endif
+
+bool hh2_setSpriteThreads(unsigned const count) {
+    if (count == 0 || count > HH2_MAX_SPRITE_THREADS) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "invalid number of threads %u, must be between 1 and %d", count, HH2_MAX_SPRITE_THREADS);
+        return false;
+    }
+
+#ifdef HH2_SPRITE_THREADS
+    if (count == hh2_bandCount) {
+        return true;
+    }
+
+    hh2_stopSpriteWorkers();
+
+    for (unsigned i = 0; i < count - 1; i++) {
+        hh2_SpriteWorker* const worker = hh2_workers + i;
+        worker->band = i + 1;
+        worker->generation = hh2_workGeneration;
+
+        if (pthread_create(&worker->thread, NULL, hh2_spriteWorker, worker) != 0) {
+            HH2_LOG(HH2_LOG_ERROR, TAG "error creating sprite thread, using %u threads", hh2_bandCount);
+            return false;
+        }
+
+        hh2_bandCount++;
+    }
+
+    HH2_LOG(HH2_LOG_INFO, TAG "composing sprites with %u threads", hh2_bandCount);
+    return true;
+#else
+    if (count != 1) {
+        HH2_LOG(HH2_LOG_WARN, TAG "sprite threads not available, compile with HH2_SPRITE_THREADS to enable them");
+        return false;
+    }
+
+    return true;
+#endif
+}
+
+bool hh2_setBackgroundLayer(hh2_Canvas const background) {
+    if (hh2_visibleSpriteCount != 0) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "can't change the background layer while sprites are blitted");
+        return false;
+    }
+
+    if (background != NULL) {
+        // The saved backgrounds aren't needed anymore
+        for (size_t i = 0; i < hh2_spriteCount; i++) {
+            free(hh2_sprites[i]->bg);
+            hh2_sprites[i]->bg = NULL;
+            hh2_sprites[i]->bg_capacity = 0;
+        }
+
+        hh2_backgroundLayer = background;
+        return true;
+    }
+
+    // Back to saving under each sprite, allocate the buffers for the sprites that will still be blitted
+    for (size_t i = 0; i < hh2_spriteCount; i++) {
+        hh2_Sprite const sprite = hh2_sprites[i];
+
+        if (!hh2_hasPixels(sprite) || (sprite->flags & HH2_SPRITE_DESTROY) != 0 || sprite->bg != NULL) {
+            continue;
+        }
+
+        sprite->bg_capacity = hh2_spriteChangedPixels(sprite);
+        sprite->bg = (hh2_RGB565*)malloc(sprite->bg_capacity * sizeof(*sprite->bg));
+
+        if (sprite->bg == NULL) {
+            HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+            sprite->bg_capacity = 0;
+            return false;
+        }
+    }
+
+    hh2_backgroundLayer = NULL;
+    return true;
+}
+
+static void hh2_composeSprites(hh2_Canvas const canvas, bool const unblit) {
+#ifdef HH2_SPRITE_THREADS
+    if (hh2_bandCount > 1) {
+        pthread_mutex_lock(&hh2_workMutex);
+        hh2_workCanvas = canvas;
+        hh2_workUnblit = unblit;
+        hh2_workPending = hh2_bandCount - 1;
+        hh2_workGeneration++;
+        pthread_cond_broadcast(&hh2_workStart);
+        pthread_mutex_unlock(&hh2_workMutex);
+
+        hh2_composeBand(canvas, 0, unblit);
+
+        pthread_mutex_lock(&hh2_workMutex);
+
+        while (hh2_workPending != 0) {
+            pthread_cond_wait(&hh2_workDone, &hh2_workMutex);
+        }
+
+        pthread_mutex_unlock(&hh2_workMutex);
+        return;
+    }
+#endif
+
+    hh2_composeBand(canvas, 0, unblit);
+}
+
 void hh2_blitSprites(hh2_Canvas const canvas) {
     if (hh2_spriteCount == 0) {
         return;
@@ -131,23 +566,23 @@ void hh2_blitSprites(hh2_Canvas const canvas) {
     size_t i = 0;
     hh2_Sprite sprite = hh2_sprites[0];
 
-    // Blit all sprites not invisible and not marked for destruction
-    if (i < hh2_spriteCount && (sprite->flags & HH2_SPRITE_FLAGS) == 0 && sprite->image != NULL) {
+    // Count all sprites not invisible and not marked for destruction
+    if (i < hh2_spriteCount && (sprite->flags & HH2_SPRITE_FLAGS) == 0 && hh2_hasPixels(sprite)) {
         do {
-            hh2_blit(sprite->image, canvas, sprite->x, sprite->y, sprite->bg);
             sprite = hh2_sprites[++i];
         }
-        while (i < hh2_spriteCount && (sprite->flags & HH2_SPRITE_FLAGS) == 0 && sprite->image != NULL);
+        while (i < hh2_spriteCount && (sprite->flags & HH2_SPRITE_FLAGS) == 0 && hh2_hasPixels(sprite));
     }
 
     hh2_visibleSpriteCount = i;
+    hh2_composeSprites(canvas, false);
 
     // Skip invisible sprites
-    if (i < hh2_spriteCount && ((sprite->flags & HH2_SPRITE_FLAGS) == HH2_SPRITE_INVISIBLE || sprite->image == NULL)) {
+    if (i < hh2_spriteCount && ((sprite->flags & HH2_SPRITE_FLAGS) == HH2_SPRITE_INVISIBLE || !hh2_hasPixels(sprite))) {
         do {
             sprite = hh2_sprites[++i];
         }
-        while (i < hh2_spriteCount && ((sprite->flags & HH2_SPRITE_FLAGS) == HH2_SPRITE_INVISIBLE || sprite->image == NULL));
+        while (i < hh2_spriteCount && ((sprite->flags & HH2_SPRITE_FLAGS) == HH2_SPRITE_INVISIBLE || !hh2_hasPixels(sprite)));
     }
 
     // Destroy all remaining sprites
@@ -156,6 +591,7 @@ void hh2_blitSprites(hh2_Canvas const canvas) {
     if (i < hh2_spriteCount) {
         do {
             free(sprite->bg);
+            free(sprite->members);
             free(sprite);
             sprite = hh2_sprites[++i];
         }
@@ -166,16 +602,8 @@ void hh2_blitSprites(hh2_Canvas const canvas) {
 }
 
 void hh2_unblitSprites(hh2_Canvas const canvas) {
-    if (hh2_visibleSpriteCount == 0) {
-        return;
-    }
-
-    size_t i = hh2_visibleSpriteCount;
-    hh2_Sprite sprite = hh2_sprites[i - 1];
-
-    do {
-        hh2_unblit(sprite->image, canvas, sprite->x, sprite->y, sprite->bg);
-        sprite = hh2_sprites[--i - 1];
+    if (hh2_visibleSpriteCount != 0) {
+        hh2_composeSprites(canvas, true);
+        hh2_visibleSpriteCount = 0;
     }
-    while (i > 0);
 }
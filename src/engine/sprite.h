@@ -13,6 +13,22 @@ void hh2_setLayer(hh2_Sprite sprite, unsigned layer);
 bool hh2_setImage(hh2_Sprite sprite, hh2_Image image);
 void hh2_setVisibility(hh2_Sprite sprite, bool visible);
 
+// Draws count images from atlas side by side with one sprite, i.e. a line of text. xs are the horizontal offsets of
+// each image relative to the sprite position. Replaces the sprite's image, and the atlas must outlive the sprite
+bool hh2_setRun(hh2_Sprite sprite, hh2_Atlas atlas, unsigned const* indices, int const* xs, unsigned count);
+
+// Draws count images as a unit, in order, each one offset by (xs[i], ys[i]) from the sprite position. Moving, hiding
+// and changing the layer of the group costs the same as for a single image, and the images must outlive the sprite
+bool hh2_setGroup(hh2_Sprite sprite, hh2_Image const* images, int const* xs, int const* ys, unsigned count);
+
+// Splits the canvas in count horizontal bands that are composed in parallel, only available when compiled with
+// HH2_SPRITE_THREADS
+bool hh2_setSpriteThreads(unsigned count);
+
+// Restores the canvas from background, a clean copy with the same dimensions, instead of saving the pixels under each
+// sprite. Pass NULL to go back to saving them, only possible while no sprites are blitted
+bool hh2_setBackgroundLayer(hh2_Canvas background);
+
 void hh2_blitSprites(hh2_Canvas const canvas);
 void hh2_unblitSprites(hh2_Canvas const canvas);
 
@@ -0,0 +1,231 @@
+#include "text.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#define TAG "TXT "
+
+struct hh2_Font {
+    hh2_Atlas atlas;
+    unsigned space_width;
+    unsigned height;
+    int16_t glyphs[256]; // Atlas index for each char, -1 if the font doesn't have it
+};
+
+struct hh2_Text {
+    hh2_Font font;
+    hh2_Sprite sprite; // Only created when the text is shown by itself, texts in sprite groups don't need one
+    unsigned anchor;
+
+    int x, y;
+    unsigned width;
+    unsigned count; // Glyphs in the layout, spaces aren't drawn
+
+    // Layout buffers, kept between calls to hh2_setText
+    unsigned* indices;
+    int* xs;
+    size_t capacity;
+};
+
+hh2_Font hh2_createFont(hh2_Atlas const atlas, char const* const chars, unsigned const space_width) {
+    hh2_Font const font = (hh2_Font)malloc(sizeof(*font));
+
+    if (font == NULL) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+        return NULL;
+    }
+
+    font->atlas = atlas;
+    font->space_width = space_width;
+    font->height = 0;
+
+    for (unsigned i = 0; i < sizeof(font->glyphs) / sizeof(font->glyphs[0]); i++) {
+        font->glyphs[i] = -1;
+    }
+
+    unsigned const count = hh2_atlasCount(atlas);
+
+    for (unsigned i = 0; i < count && chars[i] != 0; i++) {
+        unsigned const height = hh2_imageHeight(hh2_atlasImage(atlas, i));
+
+        font->glyphs[(uint8_t)chars[i]] = i;
+        font->height = height > font->height ? height : font->height;
+    }
+
+    return font;
+}
+
+void hh2_destroyFont(hh2_Font const font) {
+    free(font);
+}
+
+unsigned hh2_fontHeight(hh2_Font const font) {
+    return font->height;
+}
+
+hh2_Text hh2_createText(hh2_Font const font, unsigned const anchor) {
+    hh2_Text const text = (hh2_Text)malloc(sizeof(*text));
+
+    if (text == NULL) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+        return NULL;
+    }
+
+    text->sprite = NULL;
+    text->font = font;
+    text->anchor = anchor;
+    text->x = text->y = 0;
+    text->width = 0;
+    text->count = 0;
+    text->indices = NULL;
+    text->xs = NULL;
+    text->capacity = 0;
+    return text;
+}
+
+void hh2_destroyText(hh2_Text const text) {
+    if (text->sprite != NULL) {
+        hh2_destroySprite(text->sprite);
+    }
+
+    free(text->indices);
+    free(text->xs);
+    free(text);
+}
+
+// Returns the top-left corner of the text when its anchor is at (x, y)
+static void hh2_anchorText(hh2_Text const text, int* const x, int* const y) {
+    if ((text->anchor & HH2_ANCHOR_RIGHT) != 0) {
+        *x -= text->width;
+    }
+    else if ((text->anchor & HH2_ANCHOR_HCENTER) != 0) {
+        *x -= text->width / 2;
+    }
+
+    if ((text->anchor & HH2_ANCHOR_BOTTOM) != 0) {
+        *y -= text->font->height;
+    }
+    else if ((text->anchor & HH2_ANCHOR_VCENTER) != 0) {
+        *y -= text->font->height / 2;
+    }
+}
+
+static void hh2_placeText(hh2_Text const text) {
+    int x = text->x;
+    int y = text->y;
+
+    hh2_anchorText(text, &x, &y);
+    hh2_setPosition(text->sprite, x, y);
+}
+
+bool hh2_setText(hh2_Text const text, char const* const string, size_t const length) {
+    if (length > text->capacity) {
+        unsigned* const indices = (unsigned*)malloc(length * sizeof(*indices));
+        int* const xs = (int*)malloc(length * sizeof(*xs));
+
+        if (indices == NULL || xs == NULL) {
+            HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+            free(indices);
+            free(xs);
+            return false;
+        }
+
+        free(text->indices);
+        free(text->xs);
+
+        text->indices = indices;
+        text->xs = xs;
+        text->capacity = length;
+    }
+
+    hh2_Font const font = text->font;
+    int16_t const fallback = font->glyphs['?'];
+    unsigned count = 0;
+    unsigned x = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        uint8_t const ch = string[i];
+
+        if (ch == ' ') {
+            x += font->space_width;
+            continue;
+        }
+
+        int16_t const index = font->glyphs[ch] >= 0 ? font->glyphs[ch] : fallback;
+
+        if (index < 0) {
+            continue;
+        }
+
+        text->indices[count] = index;
+        text->xs[count] = x;
+        count++;
+
+        x += hh2_imageWidth(hh2_atlasImage(font->atlas, index));
+    }
+
+    if (text->sprite != NULL && !hh2_setRun(text->sprite, font->atlas, text->indices, text->xs, count)) {
+        // Error already logged
+        return false;
+    }
+
+    text->width = x;
+    text->count = count;
+
+    if (text->sprite != NULL) {
+        hh2_placeText(text);
+    }
+
+    return true;
+}
+
+void hh2_setTextPosition(hh2_Text const text, int const x, int const y) {
+    text->x = x;
+    text->y = y;
+
+    if (text->sprite != NULL) {
+        hh2_placeText(text);
+    }
+}
+
+unsigned hh2_textWidth(hh2_Text const text) {
+    return text->width;
+}
+
+hh2_Sprite hh2_textSprite(hh2_Text const text) {
+    if (text->sprite != NULL) {
+        return text->sprite;
+    }
+
+    hh2_Sprite const sprite = hh2_createSprite();
+
+    if (sprite == NULL) {
+        // Error already logged
+        return NULL;
+    }
+
+    if (!hh2_setRun(sprite, text->font->atlas, text->indices, text->xs, text->count)) {
+        // Error already logged
+        hh2_destroySprite(sprite);
+        return NULL;
+    }
+
+    text->sprite = sprite;
+    hh2_placeText(text);
+    return sprite;
+}
+
+unsigned hh2_textGlyphCount(hh2_Text const text) {
+    return text->count;
+}
+
+void hh2_textGlyphs(hh2_Text const text, int x, int y, hh2_Image* const images, int* const xs, int* const ys) {
+    hh2_anchorText(text, &x, &y);
+
+    for (unsigned i = 0; i < text->count; i++) {
+        images[i] = hh2_atlasImage(text->font->atlas, text->indices[i]);
+        xs[i] = x + text->xs[i];
+        ys[i] = y;
+    }
+}
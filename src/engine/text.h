@@ -0,0 +1,46 @@
+#ifndef HH2_TEXT_H__
+#define HH2_TEXT_H__
+
+#include "image.h"
+#include "sprite.h"
+
+#include <stddef.h>
+
+typedef struct hh2_Font* hh2_Font;
+typedef struct hh2_Text* hh2_Text;
+
+typedef enum {
+    HH2_ANCHOR_LEFT = 0,
+    HH2_ANCHOR_HCENTER = 1,
+    HH2_ANCHOR_RIGHT = 2,
+    HH2_ANCHOR_TOP = 0,
+    HH2_ANCHOR_VCENTER = 4,
+    HH2_ANCHOR_BOTTOM = 8
+}
+hh2_Anchor;
+
+// chars has one char for each image in atlas, in the same order. Chars not in the font are drawn with its '?' glyph,
+// and the atlas must outlive the font
+hh2_Font hh2_createFont(hh2_Atlas atlas, char const* chars, unsigned space_width);
+void hh2_destroyFont(hh2_Font font);
+
+unsigned hh2_fontHeight(hh2_Font font);
+
+// A text is drawn by a single sprite, which is destroyed with it. The font must outlive the text
+hh2_Text hh2_createText(hh2_Font font, unsigned anchor);
+void hh2_destroyText(hh2_Text text);
+
+// Lays out the glyphs again, only allocating memory when the text is longer than all the previous ones
+bool hh2_setText(hh2_Text text, char const* string, size_t length);
+void hh2_setTextPosition(hh2_Text text, int x, int y);
+
+unsigned hh2_textWidth(hh2_Text text);
+// Creates the text's sprite on the first call, texts only used in sprite groups never get one. Returns NULL on errors
+hh2_Sprite hh2_textSprite(hh2_Text text);
+
+// Gets the images of the glyphs and their positions when the text's anchor is at (x, y), i.e. to add the text to a
+// sprite group with hh2_setGroup
+unsigned hh2_textGlyphCount(hh2_Text text);
+void hh2_textGlyphs(hh2_Text text, int x, int y, hh2_Image* images, int* xs, int* ys);
+
+#endif // HH2_TEXT_H__
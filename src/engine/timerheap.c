@@ -0,0 +1,193 @@
+#include "timerheap.h"
+#include "log.h"
+
+#include <stdlib.h>
+
+#define TAG "TMR "
+
+typedef struct {
+    int64_t expiration;
+    int64_t interval;
+    int tag;
+    int position; // Index in the heap, -1 when the timer is stopped
+}
+hh2_Timer;
+
+struct hh2_TimerHeap {
+    hh2_Timer* timers;
+    unsigned timer_count;
+    unsigned reserved_timers;
+
+    // Ids of the running timers, heap[0] is the next one to expire. Has room for all timers
+    int* heap;
+    unsigned heap_count;
+};
+
+hh2_TimerHeap hh2_createTimerHeap(void) {
+    hh2_TimerHeap const heap = (hh2_TimerHeap)malloc(sizeof(*heap));
+
+    if (heap == NULL) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+        return NULL;
+    }
+
+    heap->timers = NULL;
+    heap->timer_count = heap->reserved_timers = 0;
+    heap->heap = NULL;
+    heap->heap_count = 0;
+    return heap;
+}
+
+void hh2_destroyTimerHeap(hh2_TimerHeap const heap) {
+    free(heap->timers);
+    free(heap->heap);
+    free(heap);
+}
+
+static bool hh2_expiresBefore(hh2_TimerHeap const heap, int const id1, int const id2) {
+    int64_t const expiration1 = heap->timers[id1].expiration;
+    int64_t const expiration2 = heap->timers[id2].expiration;
+    return expiration1 < expiration2 || (expiration1 == expiration2 && id1 < id2);
+}
+
+static void hh2_placeTimer(hh2_TimerHeap const heap, unsigned const position, int const id) {
+    heap->heap[position] = id;
+    heap->timers[id].position = position;
+}
+
+static void hh2_siftUp(hh2_TimerHeap const heap, unsigned position) {
+    int const id = heap->heap[position];
+
+    while (position > 0) {
+        unsigned const parent = (position - 1) / 2;
+
+        if (!hh2_expiresBefore(heap, id, heap->heap[parent])) {
+            break;
+        }
+
+        hh2_placeTimer(heap, position, heap->heap[parent]);
+        position = parent;
+    }
+
+    hh2_placeTimer(heap, position, id);
+}
+
+static void hh2_siftDown(hh2_TimerHeap const heap, unsigned position) {
+    int const id = heap->heap[position];
+
+    for (;;) {
+        unsigned child = position * 2 + 1;
+
+        if (child >= heap->heap_count) {
+            break;
+        }
+
+        if (child + 1 < heap->heap_count && hh2_expiresBefore(heap, heap->heap[child + 1], heap->heap[child])) {
+            child++;
+        }
+
+        if (!hh2_expiresBefore(heap, heap->heap[child], id)) {
+            break;
+        }
+
+        hh2_placeTimer(heap, position, heap->heap[child]);
+        position = child;
+    }
+
+    hh2_placeTimer(heap, position, id);
+}
+
+static void hh2_stopTimer(hh2_TimerHeap const heap, int const id) {
+    int const position = heap->timers[id].position;
+
+    if (position < 0) {
+        return;
+    }
+
+    heap->timers[id].position = -1;
+    int const last = heap->heap[--heap->heap_count];
+
+    if (last != id) {
+        // Move the last timer to the vacant position, it can go either way from there
+        hh2_placeTimer(heap, position, last);
+        hh2_siftUp(heap, position);
+        hh2_siftDown(heap, heap->timers[last].position);
+    }
+}
+
+static void hh2_startTimer(hh2_TimerHeap const heap, int const id, int64_t const now_us) {
+    heap->timers[id].expiration = now_us + heap->timers[id].interval;
+    heap->heap[heap->heap_count] = id;
+    hh2_siftUp(heap, heap->heap_count++);
+}
+
+int hh2_addTimer(hh2_TimerHeap const heap, int const tag) {
+    if (heap->timer_count == heap->reserved_timers) {
+        unsigned const reserved = heap->reserved_timers == 0 ? 16 : heap->reserved_timers * 2;
+        hh2_Timer* const timers = (hh2_Timer*)realloc(heap->timers, reserved * sizeof(*timers));
+
+        if (timers == NULL) {
+            HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+            return -1;
+        }
+
+        heap->timers = timers;
+
+        int* const ids = (int*)realloc(heap->heap, reserved * sizeof(*ids));
+
+        if (ids == NULL) {
+            HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+            return -1;
+        }
+
+        heap->heap = ids;
+        heap->reserved_timers = reserved;
+    }
+
+    int const id = heap->timer_count++;
+    hh2_Timer* const timer = heap->timers + id;
+
+    timer->expiration = 0;
+    timer->interval = 0;
+    timer->tag = tag;
+    timer->position = -1;
+    return id;
+}
+
+bool hh2_setTimer(
+    hh2_TimerHeap const heap, int const id, bool const enabled, int64_t const interval_us, int64_t const now_us) {
+
+    if (id < 0 || (unsigned)id >= heap->timer_count) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "invalid timer %d", id);
+        return false;
+    }
+
+    hh2_stopTimer(heap, id);
+    heap->timers[id].interval = interval_us;
+
+    if (enabled && interval_us > 0) {
+        hh2_startTimer(heap, id, now_us);
+    }
+
+    return true;
+}
+
+bool hh2_nextExpiredTimer(hh2_TimerHeap const heap, int64_t const now_us, int* const tag) {
+    if (heap->heap_count == 0) {
+        return false;
+    }
+
+    int const id = heap->heap[0];
+    hh2_Timer* const timer = heap->timers + id;
+
+    if (timer->expiration > now_us) {
+        return false;
+    }
+
+    // The interval is positive, so the timer won't be due again at now_us
+    timer->expiration = now_us + timer->interval;
+    hh2_siftDown(heap, 0);
+
+    *tag = timer->tag;
+    return true;
+}
@@ -0,0 +1,24 @@
+#ifndef HH2_TIMERHEAP_H__
+#define HH2_TIMERHEAP_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct hh2_TimerHeap* hh2_TimerHeap;
+
+// Keeps the running timers sorted by expiration, so finding the ones that are due doesn't depend on how many timers
+// exist. Timers that expire at the same time are returned in the order they were added
+hh2_TimerHeap hh2_createTimerHeap(void);
+void hh2_destroyTimerHeap(hh2_TimerHeap heap);
+
+// Timers start stopped. Returns the timer id, or -1 on error
+int hh2_addTimer(hh2_TimerHeap heap, int tag);
+
+// Restarts the timer to expire interval_us after now_us, the timer stops if it's not enabled or if interval_us is not
+// positive
+bool hh2_setTimer(hh2_TimerHeap heap, int id, bool enabled, int64_t interval_us, int64_t now_us);
+
+// Returns the tag of the first timer due at now_us, and restarts it to expire interval_us after now_us
+bool hh2_nextExpiredTimer(hh2_TimerHeap heap, int64_t now_us, int* tag);
+
+#endif // HH2_TIMERHEAP_H__
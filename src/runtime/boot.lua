@@ -11,7 +11,7 @@ return function()
 
     local background = hh2rt.createImage(hh2rt.readPixelSource(config.backgroundImage))
     hh2rt.createCanvas(background:width(), background:height())
-    background:stamp(0, 0)
+    hh2rt.setBackground(background)
 
     -- Configure the buttons depending on the profile
     if config.mappingProfile == 'dpadaction' then
@@ -48,33 +48,60 @@ return function()
         hh2rt.warn('unknown mapping profile: %s', config.mappingProfile)
     end
 
+    -- Resolve the mapped buttons to their ports and masks once, names that aren't buttons, like the ones replaced by
+    -- the profile above, are never pressed
+    local mappings = {}
+
+    for name, button in pairs(config.mappedButtons) do
+        local id, port = name:match('^(.*)/2$'), 1
+
+        if not id then
+            id, port = name, 0
+        end
+
+        local mask = hh2rt.buttons[id]
+
+        if mask then
+            mappings[#mappings + 1] = {name = name, port = port, mask = mask, button = button}
+        end
+    end
+
+    -- Buttons that change in the same tick are handled in a stable order
+    table.sort(mappings, function(a, b) return a.name < b.name end)
+
     -- Return the tick function
     local unit1 = require 'unit1'
-    local input, previous = {}, {}
+    local start = hh2rt.buttons.start
 
     return function()
-        local now, _ = hh2rt.now()
+        hh2rt.dispatchTimers()
+        hh2rt.dispatchHitEvents()
 
-        for timer in pairs(hh2rt.timers) do
-            timer['#tick'](now)
+        local _, pressed1, released1 = hh2rt.getButtons(0)
+        local _, pressed2, released2 = hh2rt.getButtons(1)
+
+        if (pressed1 | released1 | pressed2 | released2) == 0 then
+            return
         end
 
-        hh2rt.getInput(input)
+        local mouseX, mouseY = hh2rt.getMouse()
+
+        for i = 1, #mappings do
+            local mapping = mappings[i]
+            local pressed = mapping.port == 0 and pressed1 or pressed2
+            local released = mapping.port == 0 and released1 or released2
 
-        for name, button in pairs(config.mappedButtons) do
-            if input[name] and not previous[name] then
-                button.onmousedown(nil, controls.mbleft, nil, input.mouseX, input.mouseY)
-            elseif not input[name] and previous[name] then
-                button.onmouseup(nil, controls.mbleft, nil, input.mouseX, input.mouseY)
+            if (pressed & mapping.mask) ~= 0 then
+                mapping.button.onmousedown(nil, controls.mbleft, nil, mouseX, mouseY)
+            elseif (released & mapping.mask) ~= 0 then
+                mapping.button.onmouseup(nil, controls.mbleft, nil, mouseX, mouseY)
             end
         end
 
-        if input.start and not previous.start then
-            unit1.form1.btn_game_a_top.onmousedown(nil, controls.mbleft, nil, input.mouseX, input.mouseY)
-        elseif not input.start and previous.start then
-            unit1.form1.btn_game_a_top.onmouseup(nil, controls.mbleft, nil, input.mouseX, input.mouseY)
+        if (pressed1 & start) ~= 0 then
+            unit1.form1.btn_game_a_top.onmousedown(nil, controls.mbleft, nil, mouseX, mouseY)
+        elseif (released1 & start) ~= 0 then
+            unit1.form1.btn_game_a_top.onmouseup(nil, controls.mbleft, nil, mouseX, mouseY)
         end
-
-        input, previous = previous, input
     end
 end
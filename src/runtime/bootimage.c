@@ -0,0 +1,329 @@
+#include "bootimage.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#define TAG "BIM "
+
+// Bump when the file layout changes. Files are a local cache, so the header and pixels are in native byte order
+#define HH2_BOOT_IMAGE_FORMAT 1
+
+typedef struct {
+    char const* path;
+    uint32_t path_len;
+    uint32_t width, height;
+    void const* pixels;
+}
+hh2_BootImageEntry;
+
+struct hh2_BootImage {
+    uint32_t hash;
+    uint64_t size;
+    char const* version;
+
+    hh2_BootImageEntry* entries;
+    unsigned entry_count;
+    unsigned reserved_entries;
+
+    // Loaded entries point into buffer, recorded entries own a block with their pixels and path
+    void* buffer;
+};
+
+typedef struct {
+    uint8_t const* data;
+    size_t size;
+    size_t pos;
+}
+hh2_BootImageReader;
+
+static uint32_t hh2_fnv1a(uint32_t hash, void const* const data, size_t const size) {
+    uint8_t const* const bytes = (uint8_t const*)data;
+
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * UINT32_C(16777619);
+    }
+
+    return hash;
+}
+
+static void const* hh2_readBootImage(hh2_BootImageReader* const reader, size_t const size) {
+    if (size > reader->size - reader->pos) {
+        return NULL;
+    }
+
+    void const* const data = reader->data + reader->pos;
+    reader->pos += size;
+    return data;
+}
+
+static bool hh2_readBootImageU32(hh2_BootImageReader* const reader, uint32_t* const value) {
+    void const* const data = hh2_readBootImage(reader, sizeof(*value));
+
+    if (data == NULL) {
+        return false;
+    }
+
+    memcpy(value, data, sizeof(*value));
+    return true;
+}
+
+static bool hh2_writeBootImage(FILE* const file, void const* const data, size_t const size) {
+    return fwrite(data, 1, size, file) == size;
+}
+
+static bool hh2_writeBootImageU32(FILE* const file, uint32_t const value) {
+    return hh2_writeBootImage(file, &value, sizeof(value));
+}
+
+static bool hh2_reserveBootImageEntry(hh2_BootImage const image) {
+    if (image->entry_count < image->reserved_entries) {
+        return true;
+    }
+
+    unsigned const reserved = image->reserved_entries == 0 ? 64 : image->reserved_entries * 2;
+    hh2_BootImageEntry* const entries = realloc(image->entries, reserved * sizeof(*entries));
+
+    if (entries == NULL) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+        return false;
+    }
+
+    image->entries = entries;
+    image->reserved_entries = reserved;
+    return true;
+}
+
+static void hh2_clearBootImage(hh2_BootImage const image) {
+    if (image->buffer == NULL) {
+        for (unsigned i = 0; i < image->entry_count; i++) {
+            free((void*)image->entries[i].pixels);
+        }
+    }
+
+    free(image->buffer);
+    image->buffer = NULL;
+    image->entry_count = 0;
+}
+
+hh2_BootImage hh2_createBootImage(void const* const content, size_t const size, char const* const version) {
+    size_t const version_len = strlen(version);
+    hh2_BootImage const image = (hh2_BootImage)malloc(sizeof(*image) + version_len + 1);
+
+    if (image == NULL) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+        return NULL;
+    }
+
+    char* const version_dup = (char*)(image + 1);
+    memcpy(version_dup, version, version_len + 1);
+
+    uint32_t const hash = hh2_fnv1a(UINT32_C(2166136261), content, size);
+    image->hash = hh2_fnv1a(hash, version, version_len);
+    image->size = size;
+    image->version = version_dup;
+    image->entries = NULL;
+    image->entry_count = image->reserved_entries = 0;
+    image->buffer = NULL;
+    return image;
+}
+
+void hh2_destroyBootImage(hh2_BootImage const image) {
+    hh2_clearBootImage(image);
+    free(image->entries);
+    free(image);
+}
+
+bool hh2_loadBootImage(hh2_BootImage const image, char const* const path) {
+    FILE* const file = fopen(path, "rb");
+
+    if (file == NULL) {
+        HH2_LOG(HH2_LOG_INFO, TAG "no boot image at \"%s\"", path);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long const size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    void* const buffer = size > 0 ? malloc(size) : NULL;
+
+    if (buffer == NULL) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "error loading boot image \"%s\"", path);
+        fclose(file);
+        return false;
+    }
+
+    if (fread(buffer, 1, size, file) != (size_t)size) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "error reading boot image \"%s\": %s", path, strerror(errno));
+        free(buffer);
+        fclose(file);
+        return false;
+    }
+
+    fclose(file);
+    hh2_clearBootImage(image);
+    image->buffer = buffer;
+
+    hh2_BootImageReader reader;
+    reader.data = (uint8_t const*)buffer;
+    reader.size = size;
+    reader.pos = 0;
+
+    void const* const magic = hh2_readBootImage(&reader, 4);
+    uint32_t format = 0, hash = 0, content_size = 0, version_len = 0, count = 0;
+
+    bool ok = magic != NULL && memcmp(magic, "HH2B", 4) == 0 &&
+              hh2_readBootImageU32(&reader, &format) && format == HH2_BOOT_IMAGE_FORMAT &&
+              hh2_readBootImageU32(&reader, &hash) && hash == image->hash &&
+              hh2_readBootImageU32(&reader, &content_size) && content_size == (uint32_t)image->size &&
+              hh2_readBootImageU32(&reader, &version_len);
+
+    if (ok) {
+        char const* const version = (char const*)hh2_readBootImage(&reader, version_len);
+
+        ok = version != NULL && version_len == strlen(image->version) &&
+             memcmp(version, image->version, version_len) == 0 &&
+             hh2_readBootImageU32(&reader, &count);
+    }
+
+    if (!ok) {
+        HH2_LOG(HH2_LOG_INFO, TAG "boot image \"%s\" is for another content or core version", path);
+        hh2_clearBootImage(image);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        hh2_BootImageEntry entry;
+
+        if (!hh2_readBootImageU32(&reader, &entry.path_len) ||
+            (entry.path = (char const*)hh2_readBootImage(&reader, entry.path_len)) == NULL ||
+            !hh2_readBootImageU32(&reader, &entry.width) ||
+            !hh2_readBootImageU32(&reader, &entry.height) ||
+            entry.width == 0 || entry.height == 0 ||
+            entry.height > SIZE_MAX / sizeof(hh2_ARGB8888) / entry.width ||
+            (entry.pixels = hh2_readBootImage(&reader, sizeof(hh2_ARGB8888) * entry.width * entry.height)) == NULL) {
+
+            HH2_LOG(HH2_LOG_ERROR, TAG "boot image \"%s\" is corrupted", path);
+            hh2_clearBootImage(image);
+            return false;
+        }
+
+        if (!hh2_reserveBootImageEntry(image)) {
+            // Error already logged
+            hh2_clearBootImage(image);
+            return false;
+        }
+
+        image->entries[image->entry_count++] = entry;
+    }
+
+    HH2_LOG(HH2_LOG_INFO, TAG "loaded %u pixel sources from boot image \"%s\"", image->entry_count, path);
+    return true;
+}
+
+bool hh2_saveBootImage(hh2_BootImage const image, char const* const path) {
+    FILE* const file = fopen(path, "wb");
+
+    if (file == NULL) {
+        HH2_LOG(HH2_LOG_WARN, TAG "error creating boot image \"%s\": %s", path, strerror(errno));
+        return false;
+    }
+
+    uint32_t const version_len = strlen(image->version);
+
+    bool ok = hh2_writeBootImage(file, "HH2B", 4) &&
+              hh2_writeBootImageU32(file, HH2_BOOT_IMAGE_FORMAT) &&
+              hh2_writeBootImageU32(file, image->hash) &&
+              hh2_writeBootImageU32(file, (uint32_t)image->size) &&
+              hh2_writeBootImageU32(file, version_len) &&
+              hh2_writeBootImage(file, image->version, version_len) &&
+              hh2_writeBootImageU32(file, image->entry_count);
+
+    for (unsigned i = 0; ok && i < image->entry_count; i++) {
+        hh2_BootImageEntry const* const entry = image->entries + i;
+
+        ok = hh2_writeBootImageU32(file, entry->path_len) &&
+             hh2_writeBootImage(file, entry->path, entry->path_len) &&
+             hh2_writeBootImageU32(file, entry->width) &&
+             hh2_writeBootImageU32(file, entry->height) &&
+             hh2_writeBootImage(file, entry->pixels, sizeof(hh2_ARGB8888) * entry->width * entry->height);
+    }
+
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+
+    if (!ok) {
+        // Don't leave a truncated image behind
+        HH2_LOG(HH2_LOG_WARN, TAG "error writing boot image \"%s\"", path);
+        remove(path);
+        return false;
+    }
+
+    HH2_LOG(HH2_LOG_INFO, TAG "saved %u pixel sources to boot image \"%s\"", image->entry_count, path);
+    return true;
+}
+
+bool hh2_bootImageLoaded(hh2_BootImage const image) {
+    return image->buffer != NULL;
+}
+
+hh2_PixelSource hh2_bootImagePixelSource(hh2_BootImage const image, char const* const path) {
+    size_t const path_len = strlen(path);
+
+    for (unsigned i = 0; i < image->entry_count; i++) {
+        hh2_BootImageEntry const* const entry = image->entries + i;
+
+        if (entry->path_len == path_len && memcmp(entry->path, path, path_len) == 0) {
+            return hh2_createPixelSource(entry->width, entry->height, entry->pixels);
+        }
+    }
+
+    return NULL;
+}
+
+bool hh2_addBootImagePixelSource(hh2_BootImage const image, char const* const path, hh2_PixelSource const source) {
+    if (hh2_bootImageLoaded(image)) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "can't add pixel sources to a loaded boot image");
+        return false;
+    }
+
+    if (!hh2_reserveBootImageEntry(image)) {
+        // Error already logged
+        return false;
+    }
+
+    unsigned const width = hh2_pixelSourceWidth(source);
+    unsigned const height = hh2_pixelSourceHeight(source);
+    size_t const path_len = strlen(path);
+
+    // The path and the pixels share one allocation, with the pixels first to keep them aligned
+    size_t const pixels_size = sizeof(hh2_ARGB8888) * width * height;
+    hh2_ARGB8888* const pixels = (hh2_ARGB8888*)malloc(pixels_size + path_len);
+
+    if (pixels == NULL) {
+        HH2_LOG(HH2_LOG_ERROR, TAG "out of memory");
+        return false;
+    }
+
+    for (unsigned y = 0; y < height; y++) {
+        for (unsigned x = 0; x < width; x++) {
+            pixels[y * width + x] = hh2_getPixel(source, x, y);
+        }
+    }
+
+    char* const path_copy = (char*)pixels + pixels_size;
+    memcpy(path_copy, path, path_len);
+
+    hh2_BootImageEntry* const entry = image->entries + image->entry_count++;
+    entry->path = path_copy;
+    entry->path_len = path_len;
+    entry->width = width;
+    entry->height = height;
+    entry->pixels = pixels;
+    return true;
+}
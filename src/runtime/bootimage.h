@@ -0,0 +1,27 @@
+#ifndef HH2_BOOTIMAGE_H__
+#define HH2_BOOTIMAGE_H__
+
+#include "pixelsrc.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct hh2_BootImage* hh2_BootImage;
+
+// Keeps the pixel sources decoded while the game boots, so the next launches can skip decoding them. The image is
+// only valid for the same content and core version, version can be any string identifying the build
+hh2_BootImage hh2_createBootImage(void const* content, size_t size, char const* version);
+void hh2_destroyBootImage(hh2_BootImage image);
+
+// Returns false if the file doesn't exist or was created for another content or version, the image stays empty then
+bool hh2_loadBootImage(hh2_BootImage image, char const* path);
+bool hh2_saveBootImage(hh2_BootImage image, char const* path);
+
+// True if the image was loaded from a file, false if it's recording the pixel sources read during the boot
+bool hh2_bootImageLoaded(hh2_BootImage image);
+
+// Returns a new pixel source with the pixels stored for path, or NULL if there isn't one
+hh2_PixelSource hh2_bootImagePixelSource(hh2_BootImage image, char const* path);
+bool hh2_addBootImagePixelSource(hh2_BootImage image, char const* path, hh2_PixelSource source);
+
+#endif // HH2_BOOTIMAGE_H__
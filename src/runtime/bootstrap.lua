@@ -1,5 +1,5 @@
 return function(hh2rt)
-    -- Make the addition operator concatenate string
+    -- Make the addition operator concatenate string, pas2lua only emits + for strings when it can't infer their types
     -- Note: if both strings are convertible to numbers, the metamethod won't be called and a number addition will be performed
     getmetatable('').__add = function(str1, str2)
         return str1 .. str2
@@ -90,6 +90,19 @@ return function(hh2rt)
     searchers[3] = nil
     searchers[4] = nil
 
+    -- Load the game bundle if packgame.lua generated one, it registers all the game modules and the runtime units they
+    -- use in package.preload, so it must be loaded before any of the units
+    do
+        local ok, encrypted = pcall(hh2rt.contentLoader, 'hh2bundle.bs')
+
+        if ok then
+            hh2rt.info('loading the game bundle')
+            local chunk = assert(load(hh2rt.uncompress(hh2rt.decrypt(encrypted)), 'hh2bundle', 't'))
+            local names = chunk()
+            hh2rt.info('found %d modules in the game bundle', #names)
+        end
+    end
+
     do
         -- Augment the module for the Pascal runtime, as well as some units
         hh2rt.info('augmenting the hh2rt module')
@@ -99,8 +112,6 @@ return function(hh2rt)
         hh2rt.info('augmenting units')
         local runtime = require 'runtime'
         runtime(hh2rt)
-
-        hh2rt.timers = {}
     end
 
     -- Run boot.lua
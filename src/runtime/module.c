@@ -1,4 +1,5 @@
 #include "module.h"
+#include "bootimage.h"
 #include "filesys.h"
 #include "log.h"
 #include "searcher.h"
@@ -9,6 +10,8 @@
 #include "canvas.h"
 #include "image.h"
 #include "sprite.h"
+#include "text.h"
+#include "timerheap.h"
 #include "sound.h"
 
 #include "boxybold.png.h"
@@ -25,6 +28,8 @@
 #include <aes.h>
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
 #include <sys/time.h>
 #include <time.h>
 #include <string.h>
@@ -32,8 +37,15 @@
 
 #define HH2_PIXELSOURCE_MT "hh2_PixelSource"
 #define HH2_IMAGE_MT "hh2_Image"
+#define HH2_ATLAS_MT "hh2_Atlas"
+#define HH2_FONT_MT "hh2_Font"
+#define HH2_TEXT_MT "hh2_Text"
 #define HH2_SPRITE_MT "hh2_Sprite"
 #define HH2_PCM_MT "hh2_Pcm"
+#define HH2_ARRAY_MT "hh2_Array"
+#define HH2_SET_MT "hh2_Set"
+
+#define HH2_ARRAY_MAX_DIMENSIONS 8
 
 static int hh2_logLua(lua_State* const L) {
     char const* const level = luaL_checkstring(L, 1);
@@ -203,42 +215,160 @@ static int hh2_pokeLua(lua_State* const L) {
     return 0;
 }
 
-static int hh2_getInputLua(lua_State* const L) {
-    static char const* const button_names[] = {
-        "up", "down", "left", "right", "a",  "b",  "x",     "y",
-        "l1", "r1",   "l2",   "r2",    "l3", "r3", "start", "select"
-    };
+static int hh2_getButtonsLua(lua_State* const L) {
+    hh2_State* const state = (hh2_State*)lua_touserdata(L, lua_upvalueindex(1));
+    lua_Integer const port = luaL_checkinteger(L, 1);
+
+    luaL_argcheck(L, port >= 0 && port < 2, 1, "invalid port");
+
+    // Buttons that are down, and the ones that were pressed and released since the last tick
+    uint32_t const current = state->buttons[port];
+    uint32_t const previous = state->previous_buttons[port];
+
+    lua_pushinteger(L, current);
+    lua_pushinteger(L, current & ~previous);
+    lua_pushinteger(L, ~current & previous);
+    return 3;
+}
+
+static int hh2_getMouseLua(lua_State* const L) {
+    hh2_State* const state = (hh2_State*)lua_touserdata(L, lua_upvalueindex(1));
+
+    int mouse_x, mouse_y;
+    hh2_getCanvasMouse(state, &mouse_x, &mouse_y);
 
+    lua_pushinteger(L, mouse_x);
+    lua_pushinteger(L, mouse_y);
+    lua_pushboolean(L, state->mouse_pressed);
+    return 3;
+}
+
+static int hh2_addHitRegionLua(lua_State* const L) {
     hh2_State* const state = (hh2_State*)lua_touserdata(L, lua_upvalueindex(1));
-    luaL_argexpected(L, lua_type(L, 1) == LUA_TTABLE, 1, "table");
+    lua_Integer const x0 = luaL_checkinteger(L, 1);
+    lua_Integer const y0 = luaL_checkinteger(L, 2);
+    lua_Integer const width = luaL_checkinteger(L, 3);
+    lua_Integer const height = luaL_checkinteger(L, 4);
+    luaL_checktype(L, 5, LUA_TFUNCTION);
+
+    luaL_argcheck(L, width >= 0, 3, "invalid width");
+    luaL_argcheck(L, height >= 0, 4, "invalid height");
 
-    for (unsigned port = 0; port < 2; port++) {
-        for (size_t i = 0; i < sizeof(state->button_state[0]) / sizeof(state->button_state[0][0] ); i++) {
-            char name[32];
-            snprintf(name, sizeof(name), "%s%s", button_names[i], port == 0 ? "" : "/2");
+    if (state->hit_grid == NULL) {
+        state->hit_grid = hh2_createHitGrid();
 
-            lua_pushboolean(L, state->button_state[port][i]);
-            lua_setfield(L, 1, name);
+        if (state->hit_grid == NULL) {
+            return luaL_error(L, "error creating the hit grid");
         }
     }
 
-    if (state->is_zoomed) {
-        lua_pushinteger(L, state->zoom_x0 + (state->mouse_x + 32767) * state->zoom_width / 65534);
-        lua_setfield(L, 1, "mouseX");
+    // The callback reference is the region's tag
+    lua_pushvalue(L, 5);
+    int const tag = luaL_ref(L, LUA_REGISTRYINDEX);
+    int const id = hh2_addHitRegion(state->hit_grid, x0, y0, width, height, tag);
 
-        lua_pushinteger(L, state->zoom_y0 + (state->mouse_y + 32767) * state->zoom_height / 65534);
-        lua_setfield(L, 1, "mouseY");
+    if (id < 0) {
+        luaL_unref(L, LUA_REGISTRYINDEX, tag);
+        return luaL_error(L, "error adding hit region");
     }
-    else {
-        lua_pushinteger(L, (state->mouse_x + 32767) * hh2_canvasWidth(state->canvas) / 65534);
-        lua_setfield(L, 1, "mouseX");
-        
-        lua_pushinteger(L, (state->mouse_y + 32767) * hh2_canvasHeight(state->canvas) / 65534);
-        lua_setfield(L, 1, "mouseY");
+
+    lua_pushinteger(L, id);
+    return 1;
+}
+
+static int hh2_removeHitRegionLua(lua_State* const L) {
+    hh2_State* const state = (hh2_State*)lua_touserdata(L, lua_upvalueindex(1));
+    lua_Integer const id = luaL_checkinteger(L, 1);
+
+    int tag;
+
+    if (state->hit_grid == NULL || !hh2_removeHitRegion(state->hit_grid, id, &tag)) {
+        return luaL_error(L, "invalid hit region %I", id);
     }
 
-    lua_pushboolean(L, state->mouse_pressed);
-    lua_setfield(L, 1, "mousePressed");
+    // Pending events for the region were dropped, so the callback can go
+    luaL_unref(L, LUA_REGISTRYINDEX, tag);
+    return 0;
+}
+
+static int hh2_dispatchHitEventsLua(lua_State* const L) {
+    hh2_State* const state = (hh2_State*)lua_touserdata(L, lua_upvalueindex(1));
+
+    if (state->hit_grid == NULL) {
+        return 0;
+    }
+
+    hh2_HitEvent event;
+
+    while (hh2_nextHitEvent(state->hit_grid, &event)) {
+        // Events carry the position they happened at, the pointer may have moved since
+        lua_rawgeti(L, LUA_REGISTRYINDEX, event.tag);
+        lua_pushboolean(L, event.pressed);
+        lua_pushinteger(L, event.x);
+        lua_pushinteger(L, event.y);
+        lua_call(L, 3, 0);
+    }
+
+    return 0;
+}
+
+static int hh2_addTimerLua(lua_State* const L) {
+    hh2_State* const state = (hh2_State*)lua_touserdata(L, lua_upvalueindex(1));
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+
+    if (state->timer_heap == NULL) {
+        state->timer_heap = hh2_createTimerHeap();
+
+        if (state->timer_heap == NULL) {
+            return luaL_error(L, "error creating the timer heap");
+        }
+    }
+
+    // The callback reference is the timer's tag
+    lua_pushvalue(L, 1);
+    int const tag = luaL_ref(L, LUA_REGISTRYINDEX);
+    int const id = hh2_addTimer(state->timer_heap, tag);
+
+    if (id < 0) {
+        luaL_unref(L, LUA_REGISTRYINDEX, tag);
+        return luaL_error(L, "error adding timer");
+    }
+
+    lua_pushinteger(L, id);
+    return 1;
+}
+
+static int hh2_setTimerLua(lua_State* const L) {
+    hh2_State* const state = (hh2_State*)lua_touserdata(L, lua_upvalueindex(1));
+    lua_Integer const id = luaL_checkinteger(L, 1);
+    bool const enabled = lua_toboolean(L, 2);
+    lua_Number const interval_ms = luaL_checknumber(L, 3);
+
+    if (state->timer_heap == NULL || id < 0 || id > INT_MAX) {
+        return luaL_error(L, "invalid timer %I", id);
+    }
+
+    if (!hh2_setTimer(state->timer_heap, id, enabled, (int64_t)(interval_ms * 1000), state->now_us)) {
+        return luaL_error(L, "invalid timer %I", id);
+    }
+
+    return 0;
+}
+
+static int hh2_dispatchTimersLua(lua_State* const L) {
+    hh2_State* const state = (hh2_State*)lua_touserdata(L, lua_upvalueindex(1));
+
+    if (state->timer_heap == NULL) {
+        return 0;
+    }
+
+    // Timers are restarted before their callbacks run, so callbacks can change them
+    int tag;
+
+    while (hh2_nextExpiredTimer(state->timer_heap, state->now_us, &tag)) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, tag);
+        lua_call(L, 0, 0);
+    }
 
     return 0;
 }
@@ -309,10 +439,24 @@ static int hh2_readPixelSourceLua(lua_State* const L) {
     hh2_State* const state = (hh2_State*)lua_touserdata(L, lua_upvalueindex(1));
     char const* const path = luaL_checkstring(L, 1);
 
-    hh2_PixelSource const pixelsrc = hh2_readPixelSource(state->filesys, path);
+    hh2_BootImage const boot_image = state->boot_image;
+    hh2_PixelSource pixelsrc = NULL;
+
+    if (boot_image != NULL && hh2_bootImageLoaded(boot_image)) {
+        pixelsrc = hh2_bootImagePixelSource(boot_image, path);
+    }
 
     if (pixelsrc == NULL) {
-        return luaL_error(L, "error reading pixel source from \"%s\"", path);
+        pixelsrc = hh2_readPixelSource(state->filesys, path);
+
+        if (pixelsrc == NULL) {
+            return luaL_error(L, "error reading pixel source from \"%s\"", path);
+        }
+
+        if (boot_image != NULL && !hh2_bootImageLoaded(boot_image)) {
+            // On errors the next launches just decode it again
+            hh2_addBootImagePixelSource(boot_image, path, pixelsrc);
+        }
     }
 
     return hh2_pushPixelSourceLua(L, pixelsrc);
@@ -362,6 +506,42 @@ static int hh2_stampLua(lua_State* const L) {
     return 0;
 }
 
+static int hh2_setBackgroundLua(lua_State* const L) {
+    hh2_State* const state = (hh2_State*)lua_touserdata(L, lua_upvalueindex(1));
+    hh2_Image const image = *(hh2_Image*)luaL_checkudata(L, 1, HH2_IMAGE_MT);
+
+    if (state->canvas == NULL) {
+        return luaL_error(L, "canvas has not been created");
+    }
+
+    hh2_stamp(image, state->canvas, 0, 0);
+
+    if (!state->background_layer) {
+        return 0;
+    }
+
+    if (state->background == NULL) {
+        unsigned const width = hh2_canvasWidth(state->canvas);
+        unsigned const height = hh2_canvasHeight(state->canvas);
+        state->background = hh2_createCanvas(width, height);
+
+        if (state->background == NULL) {
+            return luaL_error(L, "error creating background layer with dimensions (%d, %d)", width, height);
+        }
+
+        hh2_clearCanvas(state->background, HH2_COLOR_RGB565(0, 0, 0));
+
+        if (!hh2_setBackgroundLayer(state->background)) {
+            hh2_destroyCanvas(state->background);
+            state->background = NULL;
+            return luaL_error(L, "error setting the background layer");
+        }
+    }
+
+    hh2_stamp(image, state->background, 0, 0);
+    return 0;
+}
+
 static int hh2_gcImageLua(lua_State* const L) {
     hh2_Image const image = *(hh2_Image*)lua_touserdata(L, 1);
     hh2_destroyImage(image);
@@ -402,12 +582,122 @@ static int hh2_createImageLua(lua_State* const L) {
     return 1;
 }
 
+static hh2_Image hh2_checkAtlasImage(lua_State* const L, hh2_Atlas const atlas, int const arg) {
+    lua_Integer const index = luaL_checkinteger(L, arg);
+    luaL_argcheck(L, index >= 1 && index <= hh2_atlasCount(atlas), arg, "invalid atlas index");
+    return hh2_atlasImage(atlas, index - 1);
+}
+
+static int hh2_atlasCountLua(lua_State* const L) {
+    hh2_Atlas const atlas = *(hh2_Atlas*)luaL_checkudata(L, 1, HH2_ATLAS_MT);
+    lua_pushinteger(L, hh2_atlasCount(atlas));
+    return 1;
+}
+
+static int hh2_atlasWidthLua(lua_State* const L) {
+    hh2_Atlas const atlas = *(hh2_Atlas*)luaL_checkudata(L, 1, HH2_ATLAS_MT);
+    lua_pushinteger(L, hh2_imageWidth(hh2_checkAtlasImage(L, atlas, 2)));
+    return 1;
+}
+
+static int hh2_atlasHeightLua(lua_State* const L) {
+    hh2_Atlas const atlas = *(hh2_Atlas*)luaL_checkudata(L, 1, HH2_ATLAS_MT);
+    lua_pushinteger(L, hh2_imageHeight(hh2_checkAtlasImage(L, atlas, 2)));
+    return 1;
+}
+
+static int hh2_gcAtlasLua(lua_State* const L) {
+    hh2_Atlas const atlas = *(hh2_Atlas*)lua_touserdata(L, 1);
+    hh2_destroyAtlas(atlas);
+    return 0;
+}
+
+static int hh2_createAtlasLua(lua_State* const L) {
+    hh2_State* const state = (hh2_State*)lua_touserdata(L, lua_upvalueindex(1));
+    hh2_PixelSource const pixelsrc = *(hh2_PixelSource*)luaL_checkudata(L, 1, HH2_PIXELSOURCE_MT);
+    luaL_checktype(L, 2, LUA_TTABLE);
+
+    lua_Integer const count = luaL_len(L, 2);
+    luaL_argcheck(L, count > 0, 2, "empty atlas");
+
+    // Scratch memory owned by Lua, so it's collected if an error is raised
+    hh2_AtlasRect* const rects = (hh2_AtlasRect*)lua_newuserdata(L, count * sizeof(hh2_AtlasRect));
+    unsigned const source_width = hh2_pixelSourceWidth(pixelsrc);
+    unsigned const source_height = hh2_pixelSourceHeight(pixelsrc);
+
+    for (lua_Integer i = 0; i < count; i++) {
+        lua_Integer coords[4];
+
+        if (lua_geti(L, 2, i + 1) != LUA_TTABLE) {
+            return luaL_error(L, "atlas rectangle %d is not a table", (int)(i + 1));
+        }
+
+        for (int j = 0; j < 4; j++) {
+            int isnum;
+            lua_geti(L, -1, j + 1);
+            coords[j] = lua_tointegerx(L, -1, &isnum);
+            lua_pop(L, 1);
+
+            if (!isnum || coords[j] < 0) {
+                return luaL_error(L, "atlas rectangle %d has invalid coordinates", (int)(i + 1));
+            }
+        }
+
+        lua_pop(L, 1);
+
+        if (coords[0] + coords[2] > source_width || coords[1] + coords[3] > source_height) {
+            return luaL_error(L, "atlas rectangle %d is outside of the pixel source", (int)(i + 1));
+        }
+
+        rects[i].x = coords[0];
+        rects[i].y = coords[1];
+        rects[i].width = coords[2];
+        rects[i].height = coords[3];
+    }
+
+    hh2_Atlas const atlas = hh2_createAtlas(pixelsrc, rects, count);
+    lua_pop(L, 1);
+
+    if (atlas == NULL) {
+        return luaL_error(L, "error creating atlas from pixel source");
+    }
+
+    hh2_Atlas* const self = lua_newuserdata(L, sizeof(hh2_Atlas));
+    *self = atlas;
+
+    if (luaL_newmetatable(L, HH2_ATLAS_MT) != 0) {
+        static luaL_Reg const methods[] = {
+            {"count", hh2_atlasCountLua},
+            {"width", hh2_atlasWidthLua},
+            {"height", hh2_atlasHeightLua},
+            {NULL, NULL}
+        };
+
+        lua_createtable(L, 0, sizeof(methods) / sizeof(methods[0]) - 1);
+        lua_pushlightuserdata(L, state);
+        luaL_setfuncs(L, methods, 1);
+        lua_setfield(L, -2, "__index");
+
+        lua_pushcfunction(L, hh2_gcAtlasLua);
+        lua_setfield(L, -2, "__gc");
+    }
+
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
 typedef struct {
     hh2_Sprite sprite;
-    int image_ref;
+    int image_ref; // The image, atlas or group objects in use, so they're not collected while the sprite needs them
 }
 hh2_SpriteUd;
 
+typedef struct {
+    hh2_Text text;
+    int font_ref;
+}
+hh2_TextUd;
+
 static int hh2_setPositionLua(lua_State* const L) {
     hh2_SpriteUd* const ud = (hh2_SpriteUd*)luaL_checkudata(L, 1, HH2_SPRITE_MT);
     lua_Integer const x = luaL_checkinteger(L, 2);
@@ -446,6 +736,135 @@ static int hh2_setImageLua(lua_State* const L) {
     return 0;
 }
 
+static int hh2_setRunLua(lua_State* const L) {
+    hh2_SpriteUd* const ud = (hh2_SpriteUd*)luaL_checkudata(L, 1, HH2_SPRITE_MT);
+    hh2_Atlas const atlas = *(hh2_Atlas*)luaL_checkudata(L, 2, HH2_ATLAS_MT);
+    luaL_checktype(L, 3, LUA_TTABLE);
+    luaL_checktype(L, 4, LUA_TTABLE);
+
+    lua_Integer const count = luaL_len(L, 3);
+    luaL_argcheck(L, luaL_len(L, 4) == count, 4, "offsets and indices must have the same length");
+
+    // Scratch memory owned by Lua, so it's collected if an error is raised
+    unsigned* const indices = (unsigned*)lua_newuserdata(L, count * (sizeof(unsigned) + sizeof(int)));
+    int* const xs = (int*)(indices + count);
+    lua_Integer const atlas_count = hh2_atlasCount(atlas);
+
+    for (lua_Integer i = 0; i < count; i++) {
+        int isnum1, isnum2;
+
+        lua_geti(L, 3, i + 1);
+        lua_geti(L, 4, i + 1);
+        lua_Integer const index = lua_tointegerx(L, -2, &isnum1);
+        lua_Integer const x = lua_tointegerx(L, -1, &isnum2);
+        lua_pop(L, 2);
+
+        if (!isnum1 || index < 1 || index > atlas_count) {
+            return luaL_error(L, "invalid atlas index at position %d", (int)(i + 1));
+        }
+        else if (!isnum2) {
+            return luaL_error(L, "invalid offset at position %d", (int)(i + 1));
+        }
+
+        indices[i] = index - 1;
+        xs[i] = x;
+    }
+
+    if (!hh2_setRun(ud->sprite, atlas, indices, xs, count)) {
+        return luaL_error(L, "could not set run for sprite");
+    }
+
+    if (ud->image_ref != LUA_NOREF) {
+        luaL_unref(L, LUA_REGISTRYINDEX, ud->image_ref);
+    }
+
+    lua_pushvalue(L, 2);
+    ud->image_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    return 0;
+}
+
+static int hh2_setGroupLua(lua_State* const L) {
+    hh2_SpriteUd* const ud = (hh2_SpriteUd*)luaL_checkudata(L, 1, HH2_SPRITE_MT);
+    luaL_checktype(L, 2, LUA_TTABLE);
+
+    lua_Integer const count = luaL_len(L, 2);
+    size_t total = 0;
+
+    // Each entry is {image, dx, dy} or {text, x, y}, texts add one image per glyph
+    for (lua_Integer i = 0; i < count; i++) {
+        if (lua_geti(L, 2, i + 1) != LUA_TTABLE) {
+            return luaL_error(L, "group entry %d is not a table", (int)(i + 1));
+        }
+
+        lua_geti(L, -1, 1);
+        hh2_TextUd const* const text = (hh2_TextUd*)luaL_testudata(L, -1, HH2_TEXT_MT);
+
+        if (text != NULL) {
+            total += hh2_textGlyphCount(text->text);
+        }
+        else if (luaL_testudata(L, -1, HH2_IMAGE_MT) != NULL) {
+            total++;
+        }
+        else {
+            return luaL_error(L, "group entry %d doesn't have an image or a text", (int)(i + 1));
+        }
+
+        lua_pop(L, 2);
+    }
+
+    // Scratch memory owned by Lua, so it's collected if an error is raised
+    hh2_Image* const images = (hh2_Image*)lua_newuserdata(L, total * (sizeof(hh2_Image) + 2 * sizeof(int)));
+    int* const xs = (int*)(images + total);
+    int* const ys = xs + total;
+
+    // The group keeps its images and texts alive
+    lua_createtable(L, count, 0);
+    size_t n = 0;
+
+    for (lua_Integer i = 0; i < count; i++) {
+        int isnum1, isnum2;
+
+        lua_geti(L, 2, i + 1);
+        lua_geti(L, -1, 1);
+        lua_geti(L, -2, 2);
+        lua_geti(L, -3, 3);
+        lua_Integer const x = lua_tointegerx(L, -2, &isnum1);
+        lua_Integer const y = lua_tointegerx(L, -1, &isnum2);
+        lua_pop(L, 2);
+
+        if (!isnum1 || !isnum2) {
+            return luaL_error(L, "group entry %d has an invalid position", (int)(i + 1));
+        }
+
+        hh2_TextUd const* const text = (hh2_TextUd*)luaL_testudata(L, -1, HH2_TEXT_MT);
+
+        if (text != NULL) {
+            hh2_textGlyphs(text->text, x, y, images + n, xs + n, ys + n);
+            n += hh2_textGlyphCount(text->text);
+        }
+        else {
+            images[n] = *(hh2_Image*)lua_touserdata(L, -1);
+            xs[n] = x;
+            ys[n] = y;
+            n++;
+        }
+
+        lua_seti(L, -3, i + 1);
+        lua_pop(L, 1);
+    }
+
+    if (!hh2_setGroup(ud->sprite, images, xs, ys, total)) {
+        return luaL_error(L, "could not set group for sprite");
+    }
+
+    if (ud->image_ref != LUA_NOREF) {
+        luaL_unref(L, LUA_REGISTRYINDEX, ud->image_ref);
+    }
+
+    ud->image_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    return 0;
+}
+
 static int hh2_setVisibilityLua(lua_State* const L) {
     hh2_SpriteUd* const ud = (hh2_SpriteUd*)luaL_checkudata(L, 1, HH2_SPRITE_MT);
     bool const visible = lua_toboolean(L, 2) != 0;
@@ -483,6 +902,8 @@ static int hh2_createSpriteLua(lua_State* const L) {
             {"setPosition", hh2_setPositionLua},
             {"setLayer", hh2_setLayerLua},
             {"setImage", hh2_setImageLua},
+            {"setRun", hh2_setRunLua},
+            {"setGroup", hh2_setGroupLua},
             {"setVisibility", hh2_setVisibilityLua},
             {NULL, NULL}
         };
@@ -500,38 +921,49 @@ static int hh2_createSpriteLua(lua_State* const L) {
     return 1;
 }
 
-static int hh2_playLua(lua_State* const L) {
-    hh2_Pcm const pcm = *(hh2_Pcm*)luaL_checkudata(L, 1, HH2_PCM_MT);
-    
-    if (!hh2_playPcm(pcm)) {
-        return luaL_error(L, "not enough voices to play PCM");
-    }
+typedef struct {
+    hh2_Font font;
+    int atlas_ref;
+}
+hh2_FontUd;
 
-    return 0;
+static int hh2_fontHeightLua(lua_State* const L) {
+    hh2_FontUd const* const ud = (hh2_FontUd*)luaL_checkudata(L, 1, HH2_FONT_MT);
+    lua_pushinteger(L, hh2_fontHeight(ud->font));
+    return 1;
 }
 
-static int hh2_gcPcmLua(lua_State* const L) {
-    hh2_Pcm const pcm = *(hh2_Pcm*)lua_touserdata(L, 1);
-    hh2_destroyPcm(pcm);
+static int hh2_gcFontLua(lua_State* const L) {
+    hh2_FontUd* const ud = (hh2_FontUd*)lua_touserdata(L, 1);
+    hh2_destroyFont(ud->font);
+    luaL_unref(L, LUA_REGISTRYINDEX, ud->atlas_ref);
     return 0;
 }
 
-static int hh2_readPcmLua(lua_State* const L) {
+static int hh2_createFontLua(lua_State* const L) {
     hh2_State* const state = (hh2_State*)lua_touserdata(L, lua_upvalueindex(1));
-    char const* const path = luaL_checkstring(L, 1);
+    hh2_Atlas const atlas = *(hh2_Atlas*)luaL_checkudata(L, 1, HH2_ATLAS_MT);
+    size_t length;
+    char const* const chars = luaL_checklstring(L, 2, &length);
+    lua_Integer const space_width = luaL_checkinteger(L, 3);
 
-    hh2_Pcm const pcm = hh2_readPcm(state->filesys, path);
+    luaL_argcheck(L, length == hh2_atlasCount(atlas), 2, "must have one char per atlas image");
 
-    if (pcm == NULL) {
-        return luaL_error(L, "error reading PCM from \"%s\"", path);
+    hh2_Font const font = hh2_createFont(atlas, chars, space_width);
+
+    if (font == NULL) {
+        return luaL_error(L, "error creating font");
     }
 
-    hh2_Pcm* const self = lua_newuserdata(L, sizeof(hh2_Pcm));
-    *self = pcm;
+    hh2_FontUd* const self = lua_newuserdata(L, sizeof(hh2_FontUd));
+    self->font = font;
 
-    if (luaL_newmetatable(L, HH2_PCM_MT) != 0) {
+    lua_pushvalue(L, 1);
+    self->atlas_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    if (luaL_newmetatable(L, HH2_FONT_MT) != 0) {
         static luaL_Reg const methods[] = {
-            {"play", hh2_playLua},
+            {"height", hh2_fontHeightLua},
             {NULL, NULL}
         };
 
@@ -540,7 +972,7 @@ static int hh2_readPcmLua(lua_State* const L) {
         luaL_setfuncs(L, methods, 1);
         lua_setfield(L, -2, "__index");
 
-        lua_pushcfunction(L, hh2_gcPcmLua);
+        lua_pushcfunction(L, hh2_gcFontLua);
         lua_setfield(L, -2, "__gc");
     }
 
@@ -548,29 +980,824 @@ static int hh2_readPcmLua(lua_State* const L) {
     return 1;
 }
 
-static int hh2_stopPcmsLua(lua_State* const L) {
-    hh2_stopPcms();
+static int hh2_setTextLua(lua_State* const L) {
+    hh2_TextUd* const ud = (hh2_TextUd*)luaL_checkudata(L, 1, HH2_TEXT_MT);
+    size_t length;
+    char const* const string = luaL_checklstring(L, 2, &length);
+
+    if (!hh2_setText(ud->text, string, length)) {
+        return luaL_error(L, "could not set text");
+    }
+
     return 0;
 }
 
-static int hh2_getPixelSourceLua(lua_State* const L) {
-    char const* const name = luaL_checkstring(L, 1);
-    hh2_PixelSource pixelsrc = NULL;
+static int hh2_setTextPositionLua(lua_State* const L) {
+    hh2_TextUd* const ud = (hh2_TextUd*)luaL_checkudata(L, 1, HH2_TEXT_MT);
+    lua_Integer const x = luaL_checkinteger(L, 2);
+    lua_Integer const y = luaL_checkinteger(L, 3);
 
-    if (strcmp(name, "boxybold") == 0) {
-        pixelsrc = hh2_initPixelSource(boxybold_png, sizeof(boxybold_png));
-    }
-    else if (strcmp(name, "joypad") == 0) {
-        pixelsrc = hh2_initPixelSource(joypad_png, sizeof(joypad_png));
-    }
-    else if (strcmp(name, "mobile") == 0) {
-        pixelsrc = hh2_initPixelSource(mobile_png, sizeof(mobile_png));
+    hh2_setTextPosition(ud->text, x, y);
+    return 0;
+}
+
+static int hh2_setTextLayerLua(lua_State* const L) {
+    hh2_TextUd* const ud = (hh2_TextUd*)luaL_checkudata(L, 1, HH2_TEXT_MT);
+    lua_Integer const layer = luaL_checkinteger(L, 2);
+
+    hh2_Sprite const sprite = hh2_textSprite(ud->text);
+
+    if (sprite == NULL) {
+        return luaL_error(L, "error creating the text sprite");
     }
-    else if (strcmp(name, "white75") == 0) {
-        pixelsrc = hh2_initPixelSource(white75_png, sizeof(white75_png));
+
+    hh2_setLayer(sprite, layer);
+    return 0;
+}
+
+static int hh2_setTextVisibilityLua(lua_State* const L) {
+    hh2_TextUd* const ud = (hh2_TextUd*)luaL_checkudata(L, 1, HH2_TEXT_MT);
+    bool const visible = lua_toboolean(L, 2) != 0;
+
+    hh2_Sprite const sprite = hh2_textSprite(ud->text);
+
+    if (sprite == NULL) {
+        return luaL_error(L, "error creating the text sprite");
     }
-    else if (strcmp(name, "hbar50") == 0) {
-        pixelsrc = hh2_initPixelSource(hbar50_png, sizeof(hbar50_png));
+
+    hh2_setVisibility(sprite, visible);
+    return 0;
+}
+
+static int hh2_textWidthLua(lua_State* const L) {
+    hh2_TextUd* const ud = (hh2_TextUd*)luaL_checkudata(L, 1, HH2_TEXT_MT);
+    lua_pushinteger(L, hh2_textWidth(ud->text));
+    return 1;
+}
+
+static int hh2_gcTextLua(lua_State* const L) {
+    hh2_TextUd* const ud = (hh2_TextUd*)lua_touserdata(L, 1);
+    hh2_destroyText(ud->text);
+    luaL_unref(L, LUA_REGISTRYINDEX, ud->font_ref);
+    return 0;
+}
+
+static unsigned hh2_parseAnchor(char const* const anchor) {
+    unsigned flags = 0;
+
+    if (strstr(anchor, "left") != NULL) {
+        flags |= HH2_ANCHOR_LEFT;
+    }
+    else if (strstr(anchor, "right") != NULL) {
+        flags |= HH2_ANCHOR_RIGHT;
+    }
+    else {
+        flags |= HH2_ANCHOR_HCENTER;
+    }
+
+    if (strstr(anchor, "top") != NULL) {
+        flags |= HH2_ANCHOR_TOP;
+    }
+    else if (strstr(anchor, "bottom") != NULL) {
+        flags |= HH2_ANCHOR_BOTTOM;
+    }
+    else {
+        flags |= HH2_ANCHOR_VCENTER;
+    }
+
+    return flags;
+}
+
+static int hh2_createTextLua(lua_State* const L) {
+    hh2_State* const state = (hh2_State*)lua_touserdata(L, lua_upvalueindex(1));
+    hh2_FontUd const* const font = (hh2_FontUd*)luaL_checkudata(L, 1, HH2_FONT_MT);
+    size_t length;
+    char const* const string = luaL_checklstring(L, 2, &length);
+    char const* const anchor = luaL_optstring(L, 3, "top-left");
+
+    hh2_Text const text = hh2_createText(font->font, hh2_parseAnchor(anchor));
+
+    if (text == NULL) {
+        return luaL_error(L, "error creating text");
+    }
+
+    hh2_TextUd* const self = lua_newuserdata(L, sizeof(hh2_TextUd));
+    self->text = text;
+
+    lua_pushvalue(L, 1);
+    self->font_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    if (luaL_newmetatable(L, HH2_TEXT_MT) != 0) {
+        static luaL_Reg const methods[] = {
+            {"setText", hh2_setTextLua},
+            {"setPosition", hh2_setTextPositionLua},
+            {"setLayer", hh2_setTextLayerLua},
+            {"setVisibility", hh2_setTextVisibilityLua},
+            {"width", hh2_textWidthLua},
+            {NULL, NULL}
+        };
+
+        lua_createtable(L, 0, sizeof(methods) / sizeof(methods[0]) - 1);
+        lua_pushlightuserdata(L, state);
+        luaL_setfuncs(L, methods, 1);
+        lua_setfield(L, -2, "__index");
+
+        lua_pushcfunction(L, hh2_gcTextLua);
+        lua_setfield(L, -2, "__gc");
+    }
+
+    lua_setmetatable(L, -2);
+
+    if (!hh2_setText(text, string, length)) {
+        return luaL_error(L, "could not set text");
+    }
+
+    return 1;
+}
+
+static int hh2_playLua(lua_State* const L) {
+    hh2_Pcm const pcm = *(hh2_Pcm*)luaL_checkudata(L, 1, HH2_PCM_MT);
+    lua_Number volume = 1.0, pan = 0.0;
+    lua_Integer priority = 0;
+    bool loop = false;
+
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+
+        if (lua_getfield(L, 2, "volume") != LUA_TNIL) {
+            int isnum;
+            volume = lua_tonumberx(L, -1, &isnum);
+
+            if (!isnum) {
+                return luaL_error(L, "PCM volume must be a number");
+            }
+        }
+
+        if (lua_getfield(L, 2, "pan") != LUA_TNIL) {
+            int isnum;
+            pan = lua_tonumberx(L, -1, &isnum);
+
+            if (!isnum) {
+                return luaL_error(L, "PCM pan must be a number");
+            }
+        }
+
+        lua_getfield(L, 2, "loop");
+        loop = lua_toboolean(L, -1);
+
+        if (lua_getfield(L, 2, "priority") != LUA_TNIL) {
+            int isint;
+            priority = lua_tointegerx(L, -1, &isint);
+
+            if (!isint) {
+                return luaL_error(L, "PCM priority must be an integer");
+            }
+        }
+
+        lua_pop(L, 4);
+    }
+
+    hh2_Voice const voice = hh2_playPcm(pcm, (float)volume, (float)pan, loop, (int)priority);
+
+    if (voice == HH2_INVALID_VOICE) {
+        // All voices are busy with sounds that have higher priorities
+        lua_pushnil(L);
+    }
+    else {
+        lua_pushinteger(L, voice);
+    }
+
+    return 1;
+}
+
+static int hh2_gcPcmLua(lua_State* const L) {
+    hh2_Pcm const pcm = *(hh2_Pcm*)lua_touserdata(L, 1);
+    hh2_destroyPcm(pcm);
+    return 0;
+}
+
+static int hh2_readPcmLua(lua_State* const L) {
+    hh2_State* const state = (hh2_State*)lua_touserdata(L, lua_upvalueindex(1));
+    char const* const path = luaL_checkstring(L, 1);
+    bool const downmix = lua_toboolean(L, 2);
+
+    hh2_Pcm const pcm = hh2_readPcm(state->filesys, path, downmix);
+
+    if (pcm == NULL) {
+        return luaL_error(L, "error reading PCM from \"%s\"", path);
+    }
+
+    hh2_Pcm* const self = lua_newuserdata(L, sizeof(hh2_Pcm));
+    *self = pcm;
+
+    if (luaL_newmetatable(L, HH2_PCM_MT) != 0) {
+        static luaL_Reg const methods[] = {
+            {"play", hh2_playLua},
+            {NULL, NULL}
+        };
+
+        lua_createtable(L, 0, sizeof(methods) / sizeof(methods[0]) - 1);
+        lua_pushlightuserdata(L, state);
+        luaL_setfuncs(L, methods, 1);
+        lua_setfield(L, -2, "__index");
+
+        lua_pushcfunction(L, hh2_gcPcmLua);
+        lua_setfield(L, -2, "__gc");
+    }
+
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+static int hh2_setStreamThresholdLua(lua_State* const L) {
+    lua_Number const seconds = luaL_checknumber(L, 1);
+    hh2_setStreamThreshold((float)seconds);
+    return 0;
+}
+
+static int hh2_stopVoiceLua(lua_State* const L) {
+    lua_Integer const voice = luaL_checkinteger(L, 1);
+    hh2_stopVoice((hh2_Voice)voice);
+    return 0;
+}
+
+static int hh2_isVoicePlayingLua(lua_State* const L) {
+    lua_Integer const voice = luaL_checkinteger(L, 1);
+    lua_pushboolean(L, hh2_isVoicePlaying((hh2_Voice)voice));
+    return 1;
+}
+
+static int hh2_setMaxVoicesLua(lua_State* const L) {
+    lua_Integer const count = luaL_checkinteger(L, 1);
+
+    if (count < 1 || !hh2_setMaxVoices((unsigned)count)) {
+        return luaL_error(L, "could not set the maximum number of voices to %d", (int)count);
+    }
+
+    return 0;
+}
+
+static int hh2_stopPcmsLua(lua_State* const L) {
+    hh2_stopPcms();
+    return 0;
+}
+
+typedef enum {
+    HH2_ARRAY_INT8,
+    HH2_ARRAY_UINT8,
+    HH2_ARRAY_INT16,
+    HH2_ARRAY_UINT16,
+    HH2_ARRAY_INT32,
+    HH2_ARRAY_UINT32,
+    HH2_ARRAY_BOOLEAN,
+    HH2_ARRAY_DOUBLE
+}
+hh2_ArrayType;
+
+static char const* const hh2_arrayTypes[] = {"int8", "uint8", "int16", "uint16", "int32", "uint32", "boolean", "double", NULL};
+static size_t const hh2_arrayElementSizes[] = {1, 1, 2, 2, 4, 4, 1, 8};
+
+// Bounds of all dimensions, the elements are stored in row-major order
+typedef struct {
+    hh2_ArrayType type;
+    unsigned dimensions;
+    lua_Integer min[HH2_ARRAY_MAX_DIMENSIONS];
+    lua_Integer max[HH2_ARRAY_MAX_DIMENSIONS];
+    size_t stride[HH2_ARRAY_MAX_DIMENSIONS];
+}
+hh2_ArrayShape;
+
+// Indexing a multi-dimensional array with less indices than dimensions returns a slice that shares the elements, and
+// keeps the array alive in its user value
+typedef struct {
+    hh2_ArrayShape const* shape;
+    unsigned dimension; // First dimension indexed by this array or slice
+    void* elements;
+}
+hh2_ArrayUd;
+
+static size_t hh2_arrayCount(hh2_ArrayUd const* const self) {
+    hh2_ArrayShape const* const shape = self->shape;
+    unsigned const dim = self->dimension;
+    return (size_t)(shape->max[dim] - shape->min[dim] + 1) * shape->stride[dim];
+}
+
+static size_t hh2_arrayOffset(lua_State* const L, hh2_ArrayUd const* const self, int const index, unsigned const count) {
+    hh2_ArrayShape const* const shape = self->shape;
+    size_t offset = 0;
+
+    for (unsigned i = 0; i < count; i++) {
+        unsigned const dim = self->dimension + i;
+        lua_Integer const j = luaL_checkinteger(L, index + i);
+
+        if (j < shape->min[dim] || j > shape->max[dim]) {
+            return luaL_error(L, "index %I out of bounds [%I..%I]", j, shape->min[dim], shape->max[dim]);
+        }
+
+        offset += (size_t)(j - shape->min[dim]) * shape->stride[dim];
+    }
+
+    return offset;
+}
+
+static void hh2_pushArrayElement(lua_State* const L, hh2_ArrayUd const* const self, size_t const offset) {
+    void const* const elements = self->elements;
+
+    switch (self->shape->type) {
+        case HH2_ARRAY_INT8: lua_pushinteger(L, ((int8_t const*)elements)[offset]); break;
+        case HH2_ARRAY_UINT8: lua_pushinteger(L, ((uint8_t const*)elements)[offset]); break;
+        case HH2_ARRAY_INT16: lua_pushinteger(L, ((int16_t const*)elements)[offset]); break;
+        case HH2_ARRAY_UINT16: lua_pushinteger(L, ((uint16_t const*)elements)[offset]); break;
+        case HH2_ARRAY_INT32: lua_pushinteger(L, ((int32_t const*)elements)[offset]); break;
+        case HH2_ARRAY_UINT32: lua_pushinteger(L, ((uint32_t const*)elements)[offset]); break;
+        case HH2_ARRAY_BOOLEAN: lua_pushboolean(L, ((uint8_t const*)elements)[offset]); break;
+        case HH2_ARRAY_DOUBLE: lua_pushnumber(L, ((double const*)elements)[offset]); break;
+    }
+}
+
+static void hh2_setArrayElement(lua_State* const L, hh2_ArrayUd const* const self, size_t const offset, int const index) {
+    void* const elements = self->elements;
+    hh2_ArrayType const type = self->shape->type;
+
+    if (type == HH2_ARRAY_BOOLEAN) {
+        ((uint8_t*)elements)[offset] = lua_toboolean(L, index);
+        return;
+    }
+    else if (type == HH2_ARRAY_DOUBLE) {
+        int isnum;
+        lua_Number const value = lua_tonumberx(L, index, &isnum);
+
+        if (!isnum) {
+            luaL_error(L, "array element must be a number");
+        }
+
+        ((double*)elements)[offset] = value;
+        return;
+    }
+
+    int isint;
+    lua_Integer const value = lua_tointegerx(L, index, &isint);
+
+    if (!isint) {
+        luaL_error(L, "array element must be an integer");
+    }
+
+    // Values out of the range of the element type wrap around like in Pascal without range checks
+    switch (type) {
+        case HH2_ARRAY_INT8: ((int8_t*)elements)[offset] = (int8_t)value; break;
+        case HH2_ARRAY_UINT8: ((uint8_t*)elements)[offset] = (uint8_t)value; break;
+        case HH2_ARRAY_INT16: ((int16_t*)elements)[offset] = (int16_t)value; break;
+        case HH2_ARRAY_UINT16: ((uint16_t*)elements)[offset] = (uint16_t)value; break;
+        case HH2_ARRAY_INT32: ((int32_t*)elements)[offset] = (int32_t)value; break;
+        case HH2_ARRAY_UINT32: ((uint32_t*)elements)[offset] = (uint32_t)value; break;
+        default: break;
+    }
+}
+
+static int hh2_indexArrayLua(lua_State* const L) {
+    hh2_ArrayUd const* const self = (hh2_ArrayUd*)lua_touserdata(L, 1);
+
+    if (lua_type(L, 2) != LUA_TNUMBER) {
+        lua_pushvalue(L, 2);
+        lua_rawget(L, lua_upvalueindex(1));
+        return 1;
+    }
+
+    hh2_ArrayShape const* const shape = self->shape;
+    size_t const offset = hh2_arrayOffset(L, self, 2, 1);
+
+    if (self->dimension + 1 == shape->dimensions) {
+        hh2_pushArrayElement(L, self, offset);
+        return 1;
+    }
+
+    hh2_ArrayUd* const slice = lua_newuserdata(L, sizeof(hh2_ArrayUd));
+    slice->shape = shape;
+    slice->dimension = self->dimension + 1;
+    slice->elements = (uint8_t*)self->elements + offset * hh2_arrayElementSizes[shape->type];
+
+    if (self->dimension == 0) {
+        lua_pushvalue(L, 1);
+    }
+    else {
+        lua_getiuservalue(L, 1, 1);
+    }
+
+    lua_setiuservalue(L, -2, 1);
+    luaL_setmetatable(L, HH2_ARRAY_MT);
+    return 1;
+}
+
+static int hh2_newIndexArrayLua(lua_State* const L) {
+    hh2_ArrayUd const* const self = (hh2_ArrayUd*)lua_touserdata(L, 1);
+
+    if (self->dimension + 1 != self->shape->dimensions) {
+        return luaL_error(L, "cannot assign to a row of a multi-dimensional array, use set instead");
+    }
+
+    size_t const offset = hh2_arrayOffset(L, self, 2, 1);
+    hh2_setArrayElement(L, self, offset, 3);
+    return 0;
+}
+
+static int hh2_lenArrayLua(lua_State* const L) {
+    hh2_ArrayUd const* const self = (hh2_ArrayUd*)lua_touserdata(L, 1);
+    unsigned const dim = self->dimension;
+    lua_pushinteger(L, self->shape->max[dim] - self->shape->min[dim] + 1);
+    return 1;
+}
+
+static int hh2_getArrayLua(lua_State* const L) {
+    hh2_ArrayUd const* const self = (hh2_ArrayUd*)luaL_checkudata(L, 1, HH2_ARRAY_MT);
+    unsigned const count = self->shape->dimensions - self->dimension;
+
+    if (lua_gettop(L) != (int)count + 1) {
+        return luaL_error(L, "get needs %d indices", count);
+    }
+
+    hh2_pushArrayElement(L, self, hh2_arrayOffset(L, self, 2, count));
+    return 1;
+}
+
+static int hh2_setArrayLua(lua_State* const L) {
+    hh2_ArrayUd const* const self = (hh2_ArrayUd*)luaL_checkudata(L, 1, HH2_ARRAY_MT);
+    unsigned const count = self->shape->dimensions - self->dimension;
+
+    if (lua_gettop(L) != (int)count + 2) {
+        return luaL_error(L, "set needs %d indices and a value", count);
+    }
+
+    hh2_setArrayElement(L, self, hh2_arrayOffset(L, self, 2, count), count + 2);
+    return 0;
+}
+
+static int hh2_fillArrayLua(lua_State* const L) {
+    hh2_ArrayUd const* const self = (hh2_ArrayUd*)luaL_checkudata(L, 1, HH2_ARRAY_MT);
+    luaL_checkany(L, 2);
+
+    size_t const count = hh2_arrayCount(self);
+    size_t const size = hh2_arrayElementSizes[self->shape->type];
+
+    // Convert the value once and replicate its bytes
+    hh2_setArrayElement(L, self, 0, 2);
+
+    for (size_t i = 1; i < count; i++) {
+        memcpy((uint8_t*)self->elements + i * size, self->elements, size);
+    }
+
+    return 0;
+}
+
+static int hh2_copyArrayLua(lua_State* const L) {
+    hh2_ArrayUd const* const self = (hh2_ArrayUd*)luaL_checkudata(L, 1, HH2_ARRAY_MT);
+    hh2_ArrayUd const* const other = (hh2_ArrayUd*)luaL_checkudata(L, 2, HH2_ARRAY_MT);
+
+    hh2_ArrayShape const* const shape1 = self->shape;
+    hh2_ArrayShape const* const shape2 = other->shape;
+    unsigned const dimensions = shape1->dimensions - self->dimension;
+
+    bool same = shape1->type == shape2->type && dimensions == shape2->dimensions - other->dimension;
+
+    for (unsigned i = 0; same && i < dimensions; i++) {
+        unsigned const dim1 = self->dimension + i;
+        unsigned const dim2 = other->dimension + i;
+        same = shape1->max[dim1] - shape1->min[dim1] == shape2->max[dim2] - shape2->min[dim2];
+    }
+
+    if (!same) {
+        return luaL_error(L, "cannot copy between arrays of different types");
+    }
+
+    // Slices of the same array can overlap
+    memmove(self->elements, other->elements, hh2_arrayCount(self) * hh2_arrayElementSizes[shape1->type]);
+    return 0;
+}
+
+static unsigned hh2_checkArrayDimension(lua_State* const L, hh2_ArrayUd const* const self, int const index) {
+    lua_Integer const dim = luaL_optinteger(L, index, 1);
+
+    if (dim < 1 || dim > (lua_Integer)(self->shape->dimensions - self->dimension)) {
+        return luaL_error(L, "invalid array dimension %I", dim);
+    }
+
+    return self->dimension + (unsigned)dim - 1;
+}
+
+static int hh2_lowArrayLua(lua_State* const L) {
+    hh2_ArrayUd const* const self = (hh2_ArrayUd*)luaL_checkudata(L, 1, HH2_ARRAY_MT);
+    lua_pushinteger(L, self->shape->min[hh2_checkArrayDimension(L, self, 2)]);
+    return 1;
+}
+
+static int hh2_highArrayLua(lua_State* const L) {
+    hh2_ArrayUd const* const self = (hh2_ArrayUd*)luaL_checkudata(L, 1, HH2_ARRAY_MT);
+    lua_pushinteger(L, self->shape->max[hh2_checkArrayDimension(L, self, 2)]);
+    return 1;
+}
+
+static void hh2_initArray(lua_State* const L, hh2_ArrayUd const* const self, unsigned const dim, size_t const offset) {
+    hh2_ArrayShape const* const shape = self->shape;
+    lua_Integer const count = shape->max[dim] - shape->min[dim] + 1;
+    int const table = lua_gettop(L);
+
+    luaL_checktype(L, table, LUA_TTABLE);
+    luaL_checkstack(L, 2, "initializing array");
+
+    for (lua_Integer i = 0; i < count; i++) {
+        lua_geti(L, table, i + 1);
+
+        if (dim + 1 < shape->dimensions) {
+            hh2_initArray(L, self, dim + 1, offset + (size_t)i * shape->stride[dim]);
+        }
+        else {
+            hh2_setArrayElement(L, self, offset + (size_t)i, -1);
+        }
+
+        lua_pop(L, 1);
+    }
+}
+
+static int hh2_createArrayLua(lua_State* const L) {
+    hh2_ArrayType const type = (hh2_ArrayType)luaL_checkoption(L, 1, NULL, hh2_arrayTypes);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_settop(L, 3);
+
+    hh2_ArrayShape shape;
+    shape.type = type;
+    shape.dimensions = lua_rawlen(L, 2);
+
+    if (shape.dimensions < 1 || shape.dimensions > HH2_ARRAY_MAX_DIMENSIONS) {
+        return luaL_error(L, "arrays must have between 1 and %d dimensions", HH2_ARRAY_MAX_DIMENSIONS);
+    }
+
+    for (unsigned i = 0; i < shape.dimensions; i++) {
+        lua_rawgeti(L, 2, i + 1);
+        luaL_checktype(L, -1, LUA_TTABLE);
+        lua_rawgeti(L, -1, 1);
+        lua_rawgeti(L, -2, 2);
+
+        int isint1, isint2;
+        shape.min[i] = lua_tointegerx(L, -2, &isint1);
+        shape.max[i] = lua_tointegerx(L, -1, &isint2);
+
+        if (!isint1 || !isint2 || shape.max[i] < shape.min[i]) {
+            return luaL_error(L, "invalid bounds for array dimension %d", i + 1);
+        }
+
+        lua_pop(L, 3);
+    }
+
+    size_t const size = hh2_arrayElementSizes[type];
+    size_t count = 1;
+
+    for (unsigned i = shape.dimensions; i-- > 0;) {
+        lua_Unsigned const length = (lua_Unsigned)shape.max[i] - (lua_Unsigned)shape.min[i] + 1;
+
+        // A length of zero means that the bounds cover all the integers
+        if (length == 0 || length > (SIZE_MAX - sizeof(hh2_ArrayUd) - sizeof(hh2_ArrayShape)) / size / count) {
+            return luaL_error(L, "array too big");
+        }
+
+        shape.stride[i] = count;
+        count *= (size_t)length;
+    }
+
+    // The shape and the elements live in the same block as the array
+    hh2_ArrayUd* const self = lua_newuserdata(L, sizeof(hh2_ArrayUd) + sizeof(hh2_ArrayShape) + count * size);
+    hh2_ArrayShape* const shape_copy = (hh2_ArrayShape*)(self + 1);
+    *shape_copy = shape;
+
+    self->shape = shape_copy;
+    self->dimension = 0;
+    self->elements = shape_copy + 1;
+    memset(self->elements, 0, count * size);
+
+    if (!lua_isnoneornil(L, 3)) {
+        lua_pushvalue(L, 3);
+        hh2_initArray(L, self, 0, 0);
+        lua_pop(L, 1);
+    }
+
+    if (luaL_newmetatable(L, HH2_ARRAY_MT) != 0) {
+        static luaL_Reg const methods[] = {
+            {"get", hh2_getArrayLua},
+            {"set", hh2_setArrayLua},
+            {"fill", hh2_fillArrayLua},
+            {"copy", hh2_copyArrayLua},
+            {"low", hh2_lowArrayLua},
+            {"high", hh2_highArrayLua},
+            {NULL, NULL}
+        };
+
+        lua_createtable(L, 0, sizeof(methods) / sizeof(methods[0]) - 1);
+        luaL_setfuncs(L, methods, 0);
+        lua_pushcclosure(L, hh2_indexArrayLua, 1);
+        lua_setfield(L, -2, "__index");
+
+        lua_pushcfunction(L, hh2_newIndexArrayLua);
+        lua_setfield(L, -2, "__newindex");
+
+        lua_pushcfunction(L, hh2_lenArrayLua);
+        lua_setfield(L, -2, "__len");
+    }
+
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+// Pascal sets have at most 256 elements, with ordinal values between 0 and 255
+typedef struct {
+    uint32_t bits[8];
+}
+hh2_SetUd;
+
+static bool hh2_toSetElement(lua_State* const L, int const index, lua_Integer* const element) {
+    switch (lua_type(L, index)) {
+        case LUA_TNUMBER: {
+            int isint;
+            *element = lua_tointegerx(L, index, &isint);
+            return isint;
+        }
+
+        case LUA_TBOOLEAN:
+            *element = lua_toboolean(L, index);
+            return true;
+
+        case LUA_TSTRING: {
+            // Chars are strings with one character
+            size_t length;
+            char const* const string = lua_tolstring(L, index, &length);
+            *element = (uint8_t)string[0];
+            return length == 1;
+        }
+    }
+
+    return false;
+}
+
+static unsigned hh2_checkSetElement(lua_State* const L, int const index) {
+    lua_Integer element;
+
+    if (!hh2_toSetElement(L, index, &element)) {
+        return luaL_error(L, "invalid set element");
+    }
+
+    if (element < 0 || element > 255) {
+        return luaL_error(L, "set element %I out of range [0..255]", element);
+    }
+
+    return (unsigned)element;
+}
+
+static hh2_SetUd* hh2_pushSet(lua_State* const L) {
+    hh2_SetUd* const self = lua_newuserdata(L, sizeof(hh2_SetUd));
+    memset(self->bits, 0, sizeof(self->bits));
+    luaL_setmetatable(L, HH2_SET_MT);
+    return self;
+}
+
+static int hh2_containsSetLua(lua_State* const L) {
+    hh2_SetUd const* const self = (hh2_SetUd*)luaL_checkudata(L, 1, HH2_SET_MT);
+    lua_Integer element;
+
+    // Elements that can't be in the set aren't an error, they're just not there
+    if (!hh2_toSetElement(L, 2, &element) || element < 0 || element > 255) {
+        lua_pushboolean(L, 0);
+        return 1;
+    }
+
+    lua_pushboolean(L, (self->bits[element >> 5] >> (element & 31)) & 1);
+    return 1;
+}
+
+static int hh2_unionSetLua(lua_State* const L) {
+    hh2_SetUd const* const self = (hh2_SetUd*)luaL_checkudata(L, 1, HH2_SET_MT);
+    hh2_SetUd const* const other = (hh2_SetUd*)luaL_checkudata(L, 2, HH2_SET_MT);
+    hh2_SetUd* const result = hh2_pushSet(L);
+
+    for (unsigned i = 0; i < 8; i++) {
+        result->bits[i] = self->bits[i] | other->bits[i];
+    }
+
+    return 1;
+}
+
+static int hh2_differenceSetLua(lua_State* const L) {
+    hh2_SetUd const* const self = (hh2_SetUd*)luaL_checkudata(L, 1, HH2_SET_MT);
+    hh2_SetUd const* const other = (hh2_SetUd*)luaL_checkudata(L, 2, HH2_SET_MT);
+    hh2_SetUd* const result = hh2_pushSet(L);
+
+    for (unsigned i = 0; i < 8; i++) {
+        result->bits[i] = self->bits[i] & ~other->bits[i];
+    }
+
+    return 1;
+}
+
+static int hh2_intersectionSetLua(lua_State* const L) {
+    hh2_SetUd const* const self = (hh2_SetUd*)luaL_checkudata(L, 1, HH2_SET_MT);
+    hh2_SetUd const* const other = (hh2_SetUd*)luaL_checkudata(L, 2, HH2_SET_MT);
+    hh2_SetUd* const result = hh2_pushSet(L);
+
+    for (unsigned i = 0; i < 8; i++) {
+        result->bits[i] = self->bits[i] & other->bits[i];
+    }
+
+    return 1;
+}
+
+static int hh2_equalSetLua(lua_State* const L) {
+    hh2_SetUd const* const self = (hh2_SetUd*)luaL_checkudata(L, 1, HH2_SET_MT);
+    hh2_SetUd const* const other = (hh2_SetUd*)luaL_checkudata(L, 2, HH2_SET_MT);
+
+    lua_pushboolean(L, memcmp(self->bits, other->bits, sizeof(self->bits)) == 0);
+    return 1;
+}
+
+static int hh2_subsetSetLua(lua_State* const L) {
+    hh2_SetUd const* const self = (hh2_SetUd*)luaL_checkudata(L, 1, HH2_SET_MT);
+    hh2_SetUd const* const other = (hh2_SetUd*)luaL_checkudata(L, 2, HH2_SET_MT);
+    uint32_t extra = 0;
+
+    for (unsigned i = 0; i < 8; i++) {
+        extra |= self->bits[i] & ~other->bits[i];
+    }
+
+    lua_pushboolean(L, extra == 0);
+    return 1;
+}
+
+static void hh2_createSetMetatable(lua_State* const L) {
+    if (luaL_newmetatable(L, HH2_SET_MT) != 0) {
+        static luaL_Reg const methods[] = {
+            {"contains", hh2_containsSetLua},
+            {NULL, NULL}
+        };
+
+        lua_createtable(L, 0, sizeof(methods) / sizeof(methods[0]) - 1);
+        luaL_setfuncs(L, methods, 0);
+        lua_setfield(L, -2, "__index");
+
+        static luaL_Reg const metamethods[] = {
+            {"__add", hh2_unionSetLua},
+            {"__sub", hh2_differenceSetLua},
+            {"__mul", hh2_intersectionSetLua},
+            {"__eq", hh2_equalSetLua},
+            {"__le", hh2_subsetSetLua},
+            {NULL, NULL}
+        };
+
+        luaL_setfuncs(L, metamethods, 0);
+    }
+
+    lua_pop(L, 1);
+}
+
+static int hh2_createSetLua(lua_State* const L) {
+    int const top = lua_gettop(L);
+    hh2_createSetMetatable(L);
+    hh2_SetUd* const self = hh2_pushSet(L);
+
+    for (int i = 1; i <= top; i++) {
+        unsigned const element = hh2_checkSetElement(L, i);
+        self->bits[element >> 5] |= UINT32_C(1) << (element & 31);
+    }
+
+    return 1;
+}
+
+static int hh2_createSetRangeLua(lua_State* const L) {
+    unsigned const first = hh2_checkSetElement(L, 1);
+    unsigned const last = hh2_checkSetElement(L, 2);
+
+    hh2_createSetMetatable(L);
+    hh2_SetUd* const self = hh2_pushSet(L);
+
+    for (unsigned element = first; element <= last; element++) {
+        self->bits[element >> 5] |= UINT32_C(1) << (element & 31);
+    }
+
+    return 1;
+}
+
+static int hh2_getPixelSourceLua(lua_State* const L) {
+    char const* const name = luaL_checkstring(L, 1);
+    hh2_PixelSource pixelsrc = NULL;
+
+    if (strcmp(name, "boxybold") == 0) {
+        pixelsrc = hh2_initPixelSource(boxybold_png, sizeof(boxybold_png));
+    }
+    else if (strcmp(name, "joypad") == 0) {
+        pixelsrc = hh2_initPixelSource(joypad_png, sizeof(joypad_png));
+    }
+    else if (strcmp(name, "mobile") == 0) {
+        pixelsrc = hh2_initPixelSource(mobile_png, sizeof(mobile_png));
+    }
+    else if (strcmp(name, "white75") == 0) {
+        pixelsrc = hh2_initPixelSource(white75_png, sizeof(white75_png));
+    }
+    else if (strcmp(name, "hbar50") == 0) {
+        pixelsrc = hh2_initPixelSource(hbar50_png, sizeof(hbar50_png));
     }
     else if (strcmp(name, "hbar100") == 0) {
         pixelsrc = hh2_initPixelSource(hbar100_png, sizeof(hbar100_png));
@@ -602,18 +1829,41 @@ void hh2_pushModule(lua_State* const L, hh2_State* const state) {
         {"decrypt", hh2_decryptLua},
         {"uncompress", hh2_uncompressLua},
         {"poke", hh2_pokeLua},
-        {"getInput", hh2_getInputLua},
+        {"getButtons", hh2_getButtonsLua},
+        {"getMouse", hh2_getMouseLua},
+        {"addHitRegion", hh2_addHitRegionLua},
+        {"removeHitRegion", hh2_removeHitRegionLua},
+        {"dispatchHitEvents", hh2_dispatchHitEventsLua},
+        {"addTimer", hh2_addTimerLua},
+        {"setTimer", hh2_setTimerLua},
+        {"dispatchTimers", hh2_dispatchTimersLua},
         {"readPixelSource", hh2_readPixelSourceLua},
         {"createCanvas", hh2_createCanvasLua},
         {"createImage", hh2_createImageLua},
+        {"createAtlas", hh2_createAtlasLua},
+        {"createFont", hh2_createFontLua},
+        {"createText", hh2_createTextLua},
+        {"setBackground", hh2_setBackgroundLua},
         {"createSprite", hh2_createSpriteLua},
         {"readPcm", hh2_readPcmLua},
         {"stopPcms", hh2_stopPcmsLua},
+        {"stopVoice", hh2_stopVoiceLua},
+        {"isVoicePlaying", hh2_isVoicePlayingLua},
+        {"setMaxVoices", hh2_setMaxVoicesLua},
+        {"setStreamThreshold", hh2_setStreamThresholdLua},
         {"getPixelSource", hh2_getPixelSourceLua},
+        {"createArray", hh2_createArrayLua},
+        {"createSet", hh2_createSetLua},
+        {"createSetRange", hh2_createSetRangeLua},
         {NULL, NULL}
     };
 
-    lua_createtable(L, 0, sizeof(functions) / sizeof(functions[0]) - 1 + 2);
+    static char const* const button_names[HH2_NUM_BUTTONS] = {
+        "up", "down", "left", "right", "a",  "b",  "x",     "y",
+        "l1", "r1",   "l2",   "r2",    "l3", "r3", "start", "select"
+    };
+
+    lua_createtable(L, 0, sizeof(functions) / sizeof(functions[0]) - 1 + 3);
 
     lua_pushliteral(L, HH2_VERSION);
     lua_setfield(L, -2, "VERSION");
@@ -626,6 +1876,16 @@ void hh2_pushModule(lua_State* const L, hh2_State* const state) {
 
     lua_setfield(L, -2, "DEBUG");
 
+    // Masks of the buttons in the values returned by getButtons
+    lua_createtable(L, 0, HH2_NUM_BUTTONS);
+
+    for (unsigned i = 0; i < HH2_NUM_BUTTONS; i++) {
+        lua_pushinteger(L, (lua_Integer)1 << i);
+        lua_setfield(L, -2, button_names[i]);
+    }
+
+    lua_setfield(L, -2, "buttons");
+
     lua_pushlightuserdata(L, state);
     luaL_setfuncs(L, functions, 1);
 }
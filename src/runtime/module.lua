@@ -4,172 +4,141 @@ return function(hh2rt)
     do
         local font = hh2rt.getPixelSource('boxybold')
 
-        boxybold['!'] = font:sub(2, 0, 8, 16)
-        boxybold['"'] = font:sub(12, 0, 14, 10)
-        boxybold['#'] = font:sub(28, 0, 18, 16)
-        boxybold['$'] = font:sub(48, 0, 14, 16)
-        boxybold['%'] = font:sub(64, 0, 20, 16)
-        boxybold['&'] = font:sub(86, 0, 18, 16)
-        boxybold['\''] = font:sub(106, 0, 8, 10)
-        boxybold['('] = font:sub(116, 0, 10, 16)
-        boxybold[')'] = font:sub(128, 0, 10, 16)
-        boxybold['*'] = font:sub(140, 0, 12, 14)
-        boxybold['+'] = font:sub(154, 0, 16, 16)
-        boxybold[','] = font:sub(172, 0, 10, 16)
-        boxybold['-'] = font:sub(184, 0, 12, 12)
-        boxybold['.'] = font:sub(198, 0, 8, 16)
-        boxybold['/'] = font:sub(208, 0, 12, 16)
-
-        boxybold['0'] = font:sub(2, 18, 14, 16)
-        boxybold['1'] = font:sub(18, 18, 8, 16)
-        boxybold['2'] = font:sub(28, 18, 14, 16)
-        boxybold['3'] = font:sub(44, 18, 14, 16)
-        boxybold['4'] = font:sub(60, 18, 14, 16)
-        boxybold['5'] = font:sub(76, 18, 14, 16)
-        boxybold['6'] = font:sub(92, 18, 14, 16)
-        boxybold['7'] = font:sub(108, 18, 14, 16)
-        boxybold['8'] = font:sub(124, 18, 14, 16)
-        boxybold['9'] = font:sub(140, 18, 14, 16)
-
-        boxybold[':'] = font:sub(2, 36, 8, 16)
-        boxybold[';'] = font:sub(12, 36, 8, 16)
-        boxybold['<'] = font:sub(22, 36, 12, 16)
-        boxybold['='] = font:sub(36, 36, 12, 14)
-        boxybold['>'] = font:sub(50, 36, 12, 16)
-        boxybold['?'] = font:sub(64, 36, 16, 16)
-        boxybold['@'] = font:sub(82, 36, 16, 16)
-
-        boxybold['A'] = font:sub(2, 54, 14, 16)
-        boxybold['B'] = font:sub(18, 54, 14, 16)
-        boxybold['C'] = font:sub(34, 54, 14, 16)
-        boxybold['D'] = font:sub(50, 54, 14, 16)
-        boxybold['E'] = font:sub(66, 54, 14, 16)
-        boxybold['F'] = font:sub(82, 54, 14, 16)
-        boxybold['G'] = font:sub(98, 54, 14, 16)
-        boxybold['H'] = font:sub(114, 54, 14, 16)
-        boxybold['I'] = font:sub(130, 54, 8, 16)
-        boxybold['J'] = font:sub(140, 54, 14, 16)
-        boxybold['K'] = font:sub(156, 54, 14, 16)
-        boxybold['L'] = font:sub(172, 54, 14, 16)
-        boxybold['M'] = font:sub(188, 54, 18, 16)
-
-        boxybold['N'] = font:sub(2, 72, 16, 16)
-        boxybold['O'] = font:sub(20, 72, 14, 16)
-        boxybold['P'] = font:sub(36, 72, 14, 16)
-        boxybold['Q'] = font:sub(52, 72, 16, 16)
-        boxybold['R'] = font:sub(70, 72, 14, 16)
-        boxybold['S'] = font:sub(86, 72, 14, 16)
-        boxybold['T'] = font:sub(102, 72, 16, 16)
-        boxybold['U'] = font:sub(120, 72, 14, 16)
-        boxybold['V'] = font:sub(136, 72, 14, 16)
-        boxybold['W'] = font:sub(152, 72, 18, 16)
-        boxybold['X'] = font:sub(172, 72, 14, 16)
-        boxybold['Y'] = font:sub(188, 72, 16, 16)
-        boxybold['Z'] = font:sub(206, 72, 14, 16)
-
-        boxybold['['] = font:sub(2, 90, 10, 16)
-        boxybold['\\'] = font:sub(14, 90, 12, 16)
-        boxybold[']'] = font:sub(28, 90, 10, 16)
-        boxybold['^'] = font:sub(40, 90, 16, 12)
-        boxybold['_'] = font:sub(58, 90, 12, 16)
-        boxybold['`'] = font:sub(72, 90, 10, 12)
-        boxybold['{'] = font:sub(84, 90, 10, 16)
-        boxybold['|'] = font:sub(96, 90, 8, 16)
-        boxybold['}'] = font:sub(106, 90, 10, 16)
-        boxybold['~'] = font:sub(118, 90, 18, 10)
-
-        boxybold['a'] = font:sub(2, 112, 14, 16)
-        boxybold['b'] = font:sub(18, 112, 14, 16)
-        boxybold['c'] = font:sub(34, 112, 12, 16)
-        boxybold['d'] = font:sub(48, 112, 14, 16)
-        boxybold['e'] = font:sub(64, 112, 14, 16)
-        boxybold['f'] = font:sub(80, 112, 12, 16)
-        boxybold['g'] = font:sub(94, 112, 14, 18)
-        boxybold['h'] = font:sub(110, 112, 14, 16)
-        boxybold['i'] = font:sub(126, 112, 10, 16)
-        boxybold['j'] = font:sub(138, 112, 12, 18)
-        boxybold['k'] = font:sub(152, 112, 14, 16)
-        boxybold['l'] = font:sub(168, 112, 10, 16)
-        boxybold['m'] = font:sub(180, 112, 18, 16)
-        boxybold['n'] = font:sub(200, 112, 14, 16)
-
-        boxybold['o'] = font:sub(2, 130, 14, 16)
-        boxybold['p'] = font:sub(18, 130, 14, 18)
-        boxybold['q'] = font:sub(34, 130, 14, 18)
-        boxybold['r'] = font:sub(50, 130, 14, 16)
-        boxybold['s'] = font:sub(66, 130, 14, 16)
-        boxybold['t'] = font:sub(82, 130, 12, 16)
-        boxybold['u'] = font:sub(96, 130, 14, 16)
-        boxybold['v'] = font:sub(112, 130, 14, 16)
-        boxybold['w'] = font:sub(128, 130, 18, 16)
-        boxybold['x'] = font:sub(148, 130, 14, 16)
-        boxybold['y'] = font:sub(164, 130, 14, 18)
-        boxybold['z'] = font:sub(180, 130, 14, 16)
-
-        for char, pixelsrc in pairs(boxybold) do
-            boxybold[char] = hh2rt.createImage(pixelsrc)
+        boxybold['!'] = {2, 0, 8, 16}
+        boxybold['"'] = {12, 0, 14, 10}
+        boxybold['#'] = {28, 0, 18, 16}
+        boxybold['$'] = {48, 0, 14, 16}
+        boxybold['%'] = {64, 0, 20, 16}
+        boxybold['&'] = {86, 0, 18, 16}
+        boxybold['\''] = {106, 0, 8, 10}
+        boxybold['('] = {116, 0, 10, 16}
+        boxybold[')'] = {128, 0, 10, 16}
+        boxybold['*'] = {140, 0, 12, 14}
+        boxybold['+'] = {154, 0, 16, 16}
+        boxybold[','] = {172, 0, 10, 16}
+        boxybold['-'] = {184, 0, 12, 12}
+        boxybold['.'] = {198, 0, 8, 16}
+        boxybold['/'] = {208, 0, 12, 16}
+
+        boxybold['0'] = {2, 18, 14, 16}
+        boxybold['1'] = {18, 18, 8, 16}
+        boxybold['2'] = {28, 18, 14, 16}
+        boxybold['3'] = {44, 18, 14, 16}
+        boxybold['4'] = {60, 18, 14, 16}
+        boxybold['5'] = {76, 18, 14, 16}
+        boxybold['6'] = {92, 18, 14, 16}
+        boxybold['7'] = {108, 18, 14, 16}
+        boxybold['8'] = {124, 18, 14, 16}
+        boxybold['9'] = {140, 18, 14, 16}
+
+        boxybold[':'] = {2, 36, 8, 16}
+        boxybold[';'] = {12, 36, 8, 16}
+        boxybold['<'] = {22, 36, 12, 16}
+        boxybold['='] = {36, 36, 12, 14}
+        boxybold['>'] = {50, 36, 12, 16}
+        boxybold['?'] = {64, 36, 16, 16}
+        boxybold['@'] = {82, 36, 16, 16}
+
+        boxybold['A'] = {2, 54, 14, 16}
+        boxybold['B'] = {18, 54, 14, 16}
+        boxybold['C'] = {34, 54, 14, 16}
+        boxybold['D'] = {50, 54, 14, 16}
+        boxybold['E'] = {66, 54, 14, 16}
+        boxybold['F'] = {82, 54, 14, 16}
+        boxybold['G'] = {98, 54, 14, 16}
+        boxybold['H'] = {114, 54, 14, 16}
+        boxybold['I'] = {130, 54, 8, 16}
+        boxybold['J'] = {140, 54, 14, 16}
+        boxybold['K'] = {156, 54, 14, 16}
+        boxybold['L'] = {172, 54, 14, 16}
+        boxybold['M'] = {188, 54, 18, 16}
+
+        boxybold['N'] = {2, 72, 16, 16}
+        boxybold['O'] = {20, 72, 14, 16}
+        boxybold['P'] = {36, 72, 14, 16}
+        boxybold['Q'] = {52, 72, 16, 16}
+        boxybold['R'] = {70, 72, 14, 16}
+        boxybold['S'] = {86, 72, 14, 16}
+        boxybold['T'] = {102, 72, 16, 16}
+        boxybold['U'] = {120, 72, 14, 16}
+        boxybold['V'] = {136, 72, 14, 16}
+        boxybold['W'] = {152, 72, 18, 16}
+        boxybold['X'] = {172, 72, 14, 16}
+        boxybold['Y'] = {188, 72, 16, 16}
+        boxybold['Z'] = {206, 72, 14, 16}
+
+        boxybold['['] = {2, 90, 10, 16}
+        boxybold['\\'] = {14, 90, 12, 16}
+        boxybold[']'] = {28, 90, 10, 16}
+        boxybold['^'] = {40, 90, 16, 12}
+        boxybold['_'] = {58, 90, 12, 16}
+        boxybold['`'] = {72, 90, 10, 12}
+        boxybold['{'] = {84, 90, 10, 16}
+        boxybold['|'] = {96, 90, 8, 16}
+        boxybold['}'] = {106, 90, 10, 16}
+        boxybold['~'] = {118, 90, 18, 10}
+
+        boxybold['a'] = {2, 112, 14, 16}
+        boxybold['b'] = {18, 112, 14, 16}
+        boxybold['c'] = {34, 112, 12, 16}
+        boxybold['d'] = {48, 112, 14, 16}
+        boxybold['e'] = {64, 112, 14, 16}
+        boxybold['f'] = {80, 112, 12, 16}
+        boxybold['g'] = {94, 112, 14, 18}
+        boxybold['h'] = {110, 112, 14, 16}
+        boxybold['i'] = {126, 112, 10, 16}
+        boxybold['j'] = {138, 112, 12, 18}
+        boxybold['k'] = {152, 112, 14, 16}
+        boxybold['l'] = {168, 112, 10, 16}
+        boxybold['m'] = {180, 112, 18, 16}
+        boxybold['n'] = {200, 112, 14, 16}
+
+        boxybold['o'] = {2, 130, 14, 16}
+        boxybold['p'] = {18, 130, 14, 18}
+        boxybold['q'] = {34, 130, 14, 18}
+        boxybold['r'] = {50, 130, 14, 16}
+        boxybold['s'] = {66, 130, 14, 16}
+        boxybold['t'] = {82, 130, 12, 16}
+        boxybold['u'] = {96, 130, 14, 16}
+        boxybold['v'] = {112, 130, 14, 16}
+        boxybold['w'] = {128, 130, 18, 16}
+        boxybold['x'] = {148, 130, 14, 16}
+        boxybold['y'] = {164, 130, 14, 18}
+        boxybold['z'] = {180, 130, 14, 16}
+
+        -- Pack all glyphs in one atlas, the font maps each char to its image
+        local chars, rects = {}, {}
+
+        for char, rect in pairs(boxybold) do
+            chars[#chars + 1] = char
+            rects[#rects + 1] = rect
         end
+
+        boxybold = hh2rt.createFont(hh2rt.createAtlas(font, rects), table.concat(chars), 5)
     end
 
     hh2rt.text = function(x, y, anchor, format, ...)
-        local text = string.format(format, ...)
-        local width = 0
-
-        for i = 1, #text do
-            local char = text:sub(i, i)
-
-            if char ~= ' ' then
-                local image = (boxybold[char] or boxybold['?'])
-                width = width + image:width()
-            else
-                width = width + 5
-            end
-        end
-
-        if anchor:find('left', 1, true) then
-            -- nothing
-        elseif anchor:find('right', 1, true) then
-            x = x - width
-        else -- center
-            x = x - width // 2
-        end
+        -- The glyphs are laid out and drawn by a single native object
+        local text = hh2rt.createText(boxybold, string.format(format, ...), anchor)
 
-        if anchor:find('top', 1, true) then
-            -- nothing
-        elseif anchor:find('bottom', 1, true) then
-            y = y - 18
-        else -- center
-            y = y - 9
-        end
-
-        local sprites = {
-            setVisibility = function(self, visibility)
-                for i = 1, #self do
-                    self[i]:setVisibility(visibility)
-                end
-            end
-        }
+        text:setVisibility(true)
+        text:setLayer(2050)
+        text:setPosition(x, y)
 
-        for i = 1, #text do
-            local char = text:sub(i, i)
+        return text
+    end
 
-            if char ~= ' ' then
-                local image = (boxybold[char] or boxybold['?'])
-                local sprite = hh2rt.createSprite()
+    hh2rt.mapTouch = function(image, left, top, right, bottom, caption)
+        local controls = require 'controls'
 
-                sprite:setVisibility(true)
-                sprite:setLayer(2050)
-                sprite:setImage(image)
-                sprite:setPosition(x, y)
-                x = x + image:width()
+        -- The core hit-tests the pointer, this only runs when the region is pressed or released
+        return hh2rt.addHitRegion(left, top, right - left, bottom - top, function(pressed, x, y)
+            local handler = pressed and image.onmousedown or image.onmouseup
 
-                sprites[#sprites + 1] = sprite
-            else
-                x = x + 5
+            if handler then
+                handler(nil, controls.mbleft, nil, x, y)
             end
-        end
-
-        return sprites
+        end)
     end
 
     local white75 = hh2rt.createImage(hh2rt.getPixelSource('white75'))
@@ -203,46 +172,37 @@ return function(hh2rt)
         leftrighttwoactions = {left = 'Left', right = 'Right', y = 'Action Left', a = 'Action Right'}
     }
 
+    -- Overlays are drawn by a single sprite, with its images and texts composed in order
+    local createOverlay = function(entries)
+        local sprite = hh2rt.createSprite()
+        sprite:setLayer(2048)
+        sprite:setGroup(entries)
+        sprite:setVisibility(true)
+        return sprite
+    end
+
     hh2rt.joypadHelp = function(width, height)
         local config = require 'hh2config'
-
-        local sprites = {
-            setVisibility = function(self, visibility)
-                for i = 1, #self do
-                    self[i]:setVisibility(visibility)
-                end
-            end
-        }
+        local entries = {}
 
         for y = 0, height, white75:height() do
             for x = 0, width, white75:width() do
-                local sprite = hh2rt.createSprite()
-                sprite:setPosition(x, y)
-                sprite:setLayer(2048)
-                sprite:setImage(white75)
-                sprite:setVisibility(true)
-
-                sprites[#sprites + 1] = sprite
+                entries[#entries + 1] = {white75, x, y}
             end
         end
 
         local x0, y0 = (width - joypad:width()) // 2, (height - joypad:height()) // 2
-        local sprite = hh2rt.createSprite()
-        sprite:setPosition(x0, y0)
-        sprite:setLayer(2049)
-        sprite:setImage(joypad)
-        sprite:setVisibility(true)
-        sprites[#sprites + 1] = sprite
+        entries[#entries + 1] = {joypad, x0, y0}
 
         local functions = joypadFunctions[config.mappingProfile]
 
         for id, _ in pairs(config.mappedButtons) do
             local point = joypadPoints[id]
-            local sprite = hh2rt.text(x0 + point.ox, y0 + point.oy, point.anchor, functions[id])
-            sprites[#sprites + 1] = sprite
+            local text = hh2rt.createText(boxybold, functions[id], point.anchor)
+            entries[#entries + 1] = {text, x0 + point.ox, y0 + point.oy}
         end
 
-        return sprites
+        return createOverlay(entries)
     end
 
     local mobile = hh2rt.createImage(hh2rt.getPixelSource('mobile'))
@@ -270,34 +230,16 @@ return function(hh2rt)
 
     hh2rt.mobileHelp = function(width, height)
         local config = require 'hh2config'
-
-        local sprites = {
-            setVisibility = function(self, visibility)
-                for i = 1, #self do
-                    self[i]:setVisibility(visibility)
-                end
-            end
-        }
+        local entries = {}
 
         for y = 0, height, white75:height() do
             for x = 0, width, white75:width() do
-                local sprite = hh2rt.createSprite()
-                sprite:setPosition(x, y)
-                sprite:setLayer(2048)
-                sprite:setImage(white75)
-                sprite:setVisibility(true)
-
-                sprites[#sprites + 1] = sprite
+                entries[#entries + 1] = {white75, x, y}
             end
         end
 
         local x0, y0 = (width - mobile:width()) // 2, (height - mobile:height()) // 2
-        local sprite = hh2rt.createSprite()
-        sprite:setPosition(x0, y0)
-        sprite:setLayer(2049)
-        sprite:setImage(mobile)
-        sprite:setVisibility(true)
-        sprites[#sprites + 1] = sprite
+        entries[#entries + 1] = {mobile, x0, y0}
 
         local findX = function(percent)
             return mobileScreen.x0 + (mobileScreen.x1 - mobileScreen.x0) * percent / 100
@@ -307,6 +249,14 @@ return function(hh2rt)
             return mobileScreen.y0 + (mobileScreen.y1 - mobileScreen.y0) * percent / 100
         end
 
+        local bars = mobileBars[config.mappingProfile]
+
+        for _, bar in ipairs(bars) do
+            local x = findX(bar[1]) // 1
+            local y = findY(bar[2]) // 1
+            entries[#entries + 1] = {bar[3], x0 + x, y0 + y}
+        end
+
         local area = mobileAreas[config.mappingProfile]
         local functions = joypadFunctions[config.mappingProfile]
 
@@ -316,35 +266,16 @@ return function(hh2rt)
             if rect then
                 local x = findX(rect[1] + (rect[3] - rect[1]) / 2) // 1
                 local y = findY(rect[2] + (rect[4] - rect[2]) / 2) // 1
-                local sprite = hh2rt.text(x0 + x, y0 + y, 'center-center', functions[id])
-                sprites[#sprites + 1] = sprite
+                local text = hh2rt.createText(boxybold, functions[id], 'center-center')
+                entries[#entries + 1] = {text, x0 + x, y0 + y}
             end
         end
 
-        local bars = mobileBars[config.mappingProfile]
-
-        for _, bar in ipairs(bars) do
-            local x = findX(bar[1]) // 1
-            local y = findY(bar[2]) // 1
-            local sprite = hh2rt.createSprite()
-            sprite:setPosition(x0 + x, y0 + y)
-            sprite:setLayer(2049)
-            sprite:setImage(bar[3])
-            sprite:setVisibility(true)
-            sprites[#sprites + 1] = sprite
-        end
-
-        return sprites
+        return createOverlay(entries)
     end
 
     hh2rt.infoPage = function(width, height)
-        local sprites = {
-            setVisibility = function(self, visibility)
-                for i = 1, #self do
-                    self[i]:setVisibility(visibility)
-                end
-            end
-        }
+        local entries = {}
 
         local console = hh2rt.createImage(hh2rt.getPixelSource('console'))
         local x0, y0 = (width - console:width()), (height - console:height())
@@ -354,13 +285,7 @@ return function(hh2rt)
 
             repeat
                 x = x - white75:width()
-                local sprite = hh2rt.createSprite()
-                sprite:setPosition(x, y)
-                sprite:setLayer(2048)
-                sprite:setImage(white75)
-                sprite:setVisibility(true)
-
-                sprites[#sprites + 1] = sprite
+                entries[#entries + 1] = {white75, x, y}
             until x <= 0
         end
 
@@ -369,32 +294,28 @@ return function(hh2rt)
 
             repeat
                 y = y - white75:height()
-                local sprite = hh2rt.createSprite()
-                sprite:setPosition(x, y)
-                sprite:setLayer(2048)
-                sprite:setImage(white75)
-                sprite:setVisibility(true)
-
-                sprites[#sprites + 1] = sprite
+                entries[#entries + 1] = {white75, x, y}
             until y <= 0
         end
 
-        local sprite = hh2rt.createSprite()
-        sprite:setPosition(x0, y0)
-        sprite:setLayer(2049)
-        sprite:setImage(console)
-        sprite:setVisibility(true)
-        sprites[#sprites + 1] = sprite
+        entries[#entries + 1] = {console, x0, y0}
+
+        local lines = {
+            {0, 'Donkey Kong II (Nintendo, Game & Watch Multi Screen)'},
+            {40, '2017-12-04'},
+            {60, '5.00'},
+            {100, 'Luca "MADrigal" Antignano'},
+            {120, 'lucantignano@gmail.com'},
+            {140, 'www.madrigaldesign.it/sim'}
+        }
 
         local x0, y0 = 8, 24
 
-        sprites[#sprites + 1] = hh2rt.text(x0, y0 + 0, 'bottom-left', 'Donkey Kong II (Nintendo, Game & Watch Multi Screen)')
-        sprites[#sprites + 1] = hh2rt.text(x0, y0 + 40, 'bottom-left', '2017-12-04')
-        sprites[#sprites + 1] = hh2rt.text(x0, y0 + 60, 'bottom-left', '5.00')
-        sprites[#sprites + 1] = hh2rt.text(x0, y0 + 100, 'bottom-left', 'Luca "MADrigal" Antignano')
-        sprites[#sprites + 1] = hh2rt.text(x0, y0 + 120, 'bottom-left', 'lucantignano@gmail.com')
-        sprites[#sprites + 1] = hh2rt.text(x0, y0 + 140, 'bottom-left', 'www.madrigaldesign.it/sim')
+        for _, line in ipairs(lines) do
+            local text = hh2rt.createText(boxybold, line[2], 'bottom-left')
+            entries[#entries + 1] = {text, x0, y0 + line[1]}
+        end
 
-        return sprites
+        return createOverlay(entries)
     end
 end
@@ -33,22 +33,15 @@ return function(hh2rt)
     }
 
     local function newConstructor(class, constructor)
+        local inits = meta[class].inits
+
         return function(...)
             local instance = {}
             meta[instance] = class
             setmetatable(instance, instanceMt)
-            
-            local chain = {}
-            local super = class
-
-            while super do
-                chain[#chain + 1] = super
-                super = meta[super].super
-            end
 
-            for i = #chain, 1, -1 do
-                local super = chain[i]
-                meta[super].init(instance)
+            for i = 1, #inits do
+                inits[i](instance)
             end
 
             constructor(instance, ...)
@@ -83,15 +76,25 @@ return function(hh2rt)
         end
     }
 
-    hh2rt.newClass = function(id, super, init)
+    hh2rt.newClass = function(id, super, init, flat)
         if super then
             hh2rt.debug('creating class %s with super %s', id, meta[super].id)
         else
             hh2rt.debug('creating class %s', id)
         end
 
+        -- Flat init functions also initialize the fields of the super classes, otherwise run the super inits first
+        local inits = {}
+
+        if super and not flat then
+            local superInits = meta[super].inits
+            table.move(superInits, 1, #superInits, 1, inits)
+        end
+
+        inits[#inits + 1] = init
+
         local class = {}
-        meta[class] = {id = id, super = super, init = init}
+        meta[class] = {id = id, super = super, inits = inits}
         return setmetatable(class, classMt)
     end
 
@@ -128,12 +131,6 @@ return function(hh2rt)
         return set
     end
 
-    hh2rt.instantiateSet = function(elements)
-        local instance = {}
-        meta[instance] = elements
-        return instance
-    end
-
     hh2rt.newArray = function(dimensions, default, value)
         local function init(array, dimensions, default, value, i)
             local min = dimensions[i][1]
@@ -294,10 +291,9 @@ return function(hh2rt)
             local props = meta[self]
             props[key] = value
 
-            if key == 'interval' then
-                props['#expiration'] = hh2rt.now() + value * 1000
-            elseif key == 'enabled' then
-                props['#expiration'] = hh2rt.now() + props.interval * 1000
+            if key == 'interval' or key == 'enabled' then
+                -- Both restart the timer
+                hh2rt.setTimer(props['#id'], props.enabled, props.interval)
             end
         end
     }
@@ -309,21 +305,18 @@ return function(hh2rt)
             local props = {
                 interval = 0,
                 enabled = false,
-                ontimer = function() end,
-
-                ['#expiration'] = 0
+                ontimer = function() end
             }
 
             meta[instance] = props
 
-            props['#tick'] = function(now)
-                if props.enabled and props.ontimer and props.interval ~= 0 and now >= props['#expiration'] then
-                    props['#expiration'] = now + props.interval * 1000
+            -- The core only calls back the timers that are due
+            props['#id'] = hh2rt.addTimer(function()
+                if props.ontimer then
                     props.ontimer()
                 end
-            end
+            end)
 
-            hh2rt.timers[instance] = true
             return setmetatable(instance, ttimerMt)
         end
     }
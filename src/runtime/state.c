@@ -1,6 +1,7 @@
 #include "state.h"
 #include "log.h"
 #include "module.h"
+#include "sprite.h"
 
 #include "bootstrap.lua.h"
 
@@ -74,16 +75,20 @@ bool hh2_initState(hh2_State* const state, hh2_Filesys const filesys) {
     state->filesys = filesys;
     state->now_us = 0;
     state->canvas = NULL;
+    state->background = NULL;
     state->zoom_x0 = 0;
     state->zoom_y0 = 0;
     state->zoom_width = 0;
     state->zoom_height = 0;
     state->is_zoomed = false;
 
-    memset(state->button_state, 0, sizeof(state->button_state));
+    memset(state->buttons, 0, sizeof(state->buttons));
+    memset(state->previous_buttons, 0, sizeof(state->previous_buttons));
     state->mouse_x = 0;
     state->mouse_y = 0;
     state->mouse_pressed = false;
+    state->hit_grid = NULL;
+    state->timer_heap = NULL;
 
     static luaL_Reg const lualibs[] = {
         {"_G", luaopen_base},
@@ -116,13 +121,38 @@ bool hh2_initState(hh2_State* const state, hh2_Filesys const filesys) {
 }
 
 void hh2_setButton(hh2_State* state, unsigned port, hh2_Button button, bool pressed) {
-    state->button_state[port][button] = pressed;
+    uint32_t const bit = UINT32_C(1) << button;
+
+    if (pressed) {
+        state->buttons[port] |= bit;
+    }
+    else {
+        state->buttons[port] &= ~bit;
+    }
 }
 
 void hh2_setMouse(hh2_State* state, int x, int y, bool pressed) {
     state->mouse_x = x;
     state->mouse_y = y;
     state->mouse_pressed = pressed;
+
+    if (state->hit_grid != NULL && state->canvas != NULL) {
+        // Only the regions that were pressed or released make it to Lua
+        int canvas_x, canvas_y;
+        hh2_getCanvasMouse(state, &canvas_x, &canvas_y);
+        hh2_updateHitGrid(state->hit_grid, canvas_x, canvas_y, pressed);
+    }
+}
+
+void hh2_getCanvasMouse(hh2_State const* const state, int* const x, int* const y) {
+    if (state->is_zoomed) {
+        *x = state->zoom_x0 + (state->mouse_x + 32767) * state->zoom_width / 65534;
+        *y = state->zoom_y0 + (state->mouse_y + 32767) * state->zoom_height / 65534;
+    }
+    else {
+        *x = (state->mouse_x + 32767) * hh2_canvasWidth(state->canvas) / 65534;
+        *y = (state->mouse_y + 32767) * hh2_canvasHeight(state->canvas) / 65534;
+    }
 }
 
 bool hh2_tick(hh2_State* const state, int64_t const now_us) {
@@ -130,6 +160,7 @@ bool hh2_tick(hh2_State* const state, int64_t const now_us) {
 
     lua_rawgeti(state->L, LUA_REGISTRYINDEX, state->reference);
     bool const ok = hh2_pcall(state->L, 0, 0);
+    memcpy(state->previous_buttons, state->buttons, sizeof(state->buttons));
     lua_gc(state->L, LUA_GCSTEP, 0);
     return ok;
 }
@@ -137,9 +168,24 @@ bool hh2_tick(hh2_State* const state, int64_t const now_us) {
 void hh2_destroyState(hh2_State* const state) {
     lua_close(state->L);
 
+    if (state->background != NULL) {
+        // Sprites that survive the state go back to saving what's under them
+        hh2_unblitSprites(state->canvas);
+        hh2_setBackgroundLayer(NULL);
+        hh2_destroyCanvas(state->background);
+    }
+
     if (state->canvas != NULL) {
         hh2_destroyCanvas(state->canvas);
     }
 
+    if (state->hit_grid != NULL) {
+        hh2_destroyHitGrid(state->hit_grid);
+    }
+
+    if (state->timer_heap != NULL) {
+        hh2_destroyTimerHeap(state->timer_heap);
+    }
+
     memset(state, 0, sizeof(*state));
 }
@@ -1,8 +1,11 @@
 #ifndef HH2_STATE_H__
 #define HH2_STATE_H__
 
+#include "bootimage.h"
 #include "canvas.h"
 #include "filesys.h"
+#include "hitgrid.h"
+#include "timerheap.h"
 
 #include <lua.h>
 
@@ -56,16 +59,24 @@ typedef struct {
     int reference;
 
     hh2_Filesys filesys;
+    hh2_BootImage boot_image; // set before calling hh2_initState to reuse the pixel sources decoded in a previous boot
 
     int64_t now_us;
 
     hh2_Canvas canvas;
+    hh2_Canvas background; // clean copy of the canvas when using the background layer
+    bool background_layer; // set before calling hh2_initState to restore sprites from the background layer
     unsigned zoom_x0, zoom_y0, zoom_width, zoom_height;
     bool is_zoomed;
 
-    bool button_state[2][HH2_NUM_BUTTONS];
+    // One bit per hh2_Button, previous_buttons has the buttons at the end of the last tick to find the edges
+    uint32_t buttons[2];
+    uint32_t previous_buttons[2];
     int mouse_x, mouse_y;
     bool mouse_pressed;
+
+    hh2_HitGrid hit_grid; // touch regions over the canvas, created when the first one is added
+    hh2_TimerHeap timer_heap; // running TTimers by expiration, created when the first one is added
 }
 hh2_State;
 
@@ -73,6 +84,7 @@ bool hh2_initState(hh2_State* state, hh2_Filesys filesys);
 
 void hh2_setButton(hh2_State* state, unsigned port, hh2_Button button, bool pressed);
 void hh2_setMouse(hh2_State* state, int x, int y, bool pressed);
+void hh2_getCanvasMouse(hh2_State const* state, int* x, int* y);
 bool hh2_tick(hh2_State* state, int64_t now_us);
 
 void hh2_destroyState(hh2_State* state);
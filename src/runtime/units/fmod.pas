@@ -28,7 +28,12 @@ end;
 function FSOUND_Sample_Load(Index: Integer; NameOrData: String; InputMode: Cardinal; Offset: Integer; Length: Integer): PFSOUND_SAMPLE;
 begin
     asm
-        return hh2rt.readPcm(nameordata:gsub('\\', '/'))
+        local downmix = (inputmode & fmodtypes.fsound_forcemono) ~= 0
+
+        return {
+            pcm = hh2rt.readPcm((nameordata:gsub('\\', '/')), downmix),
+            loop = (inputmode & fmodtypes.fsound_loop_normal) ~= 0
+        }
     end;
 end;
 
@@ -43,23 +48,36 @@ end;
 procedure FSOUND_PlaySound(Channel: Integer; Sound: PFSOUND_SAMPLE);
 begin
     asm
-        if channel ~= fmodtypes.fsound_free then
-            error('FSOUND_PlaySound can only play a sound in a free channel')
+        if channel == fmodtypes.fsound_free then
+            sound.pcm:play({loop = sound.loop})
+        elseif channel >= 0 then
+            -- Replace whatever is playing in the channel
+            hh2rt.stopVoice(M.channels[channel] or 0)
+            M.channels[channel] = sound.pcm:play({loop = sound.loop})
+        else
+            error('FSOUND_PlaySound can only play a sound in a free or in a specific channel')
         end
-
-        sound:play();
     end;
 end;
 
 procedure FSOUND_StopSound(Channel: Integer);
 begin
     asm
-        if channel ~= fmodtypes.fsound_all then
-            error('FSOUND_StopSound can only stop playing all sounds')
+        if channel == fmodtypes.fsound_all then
+            hh2rt.stopPcms()
+            M.channels = {}
+        elseif channel >= 0 then
+            hh2rt.stopVoice(M.channels[channel] or 0)
+            M.channels[channel] = nil
+        else
+            error('FSOUND_StopSound can only stop all sounds or a specific channel')
         end
-
-        hh2rt.stopPcms()
     end;
 end;
 
+initialization
+    asm
+        -- Voices playing in each FMOD channel
+        M.channels = {}
+    end;
 end.